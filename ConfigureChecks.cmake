@@ -108,6 +108,8 @@ if(UNIX)
 	check_symbol_exists("strerrorname_np" "string.h" HAVE_STRERRORNAME_NP)
 	check_symbol_exists("strptime"      "time.h"     HAVE_STRPTIME)
 	check_symbol_exists("vasprintf"     "stdio.h"    HAVE_VASPRINTF)
+	check_symbol_exists("fopencookie"   "stdio.h"    HAVE_FOPENCOOKIE)
+	check_symbol_exists("funopen"       "stdio.h"    HAVE_FUNOPEN)
 	cmake_pop_check_state()
 endif()
 
@@ -947,7 +947,15 @@ sync_pipe_start(capture_options *capture_opts, GPtrArray *capture_comments,
     }
     if (capture_opts->compress_type) {
         argv = sync_pipe_add_arg(argv, &argc, "--compress-type");
-        argv = sync_pipe_add_arg(argv, &argc, capture_opts->compress_type);
+        if (strcmp(capture_opts->compress_type, "zstd") == 0) {
+            char szstd[ARGV_NUMBER_LEN];
+
+            snprintf(szstd, ARGV_NUMBER_LEN, "zstd:%d:%d",
+                     capture_opts->compress_level, capture_opts->compress_threads);
+            argv = sync_pipe_add_arg(argv, &argc, szstd);
+        } else {
+            argv = sync_pipe_add_arg(argv, &argc, capture_opts->compress_type);
+        }
     }
 
     int ret;
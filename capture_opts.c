@@ -31,9 +31,18 @@
 #include <wsutil/clopts_common.h>
 #include <wsutil/cmdarg_err.h>
 #include <wsutil/file_util.h>
+#include <wsutil/strtoi.h>
 #include <wsutil/ws_pipe.h>
 #include <wsutil/ws_assert.h>
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+/* ZSTD_compressStream2(), which the ring buffer uses, was added in zstd 1.4.0. */
+#if ZSTD_VERSION_NUMBER >= 10400
+#define HAVE_ZSTD_COMPRESSSTREAM2
+#endif
+#endif
+
 #ifdef _WIN32
 #include <wsutil/win32-utils.h>
 #endif
@@ -137,6 +146,8 @@ capture_opts_init(capture_options *capture_opts, GList *(*get_iface_list)(int *,
     capture_opts->print_name_to                   = NULL;
     capture_opts->temp_dir                        = NULL;
     capture_opts->compress_type                   = NULL;
+    capture_opts->compress_level                  = 0;
+    capture_opts->compress_threads                = 1;
     capture_opts->closed_msg                      = NULL;
     capture_opts->extcap_terminate_id             = 0;
     capture_opts->capture_filters_list            = NULL;
@@ -490,6 +501,45 @@ get_ring_arguments(capture_options *capture_opts, const char *arg)
     return true;
 }
 
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+/*
+ * Given the part of a "--compress-type" argument after "zstd", i.e. an
+ * empty string, ":<level>" or ":<level>:<threads>", parse it and set the
+ * zstd parameters.  Return an indication of whether it succeeded or failed
+ * in some fashion.
+ */
+static bool
+get_zstd_params(capture_options *capture_opts, const char *arg)
+{
+    char  **params;
+    int32_t level, threads;
+    bool    ok = true;
+
+    if (*arg == '\0')
+        return true;
+
+    params = g_strsplit(arg + 1, ":", 3);
+    if (params[0] == NULL || !ws_strtoi32(params[0], NULL, &level) ||
+        level < -7 || level > 22) {
+        cmdarg_err("The zstd compression level must be between -7 and 22");
+        ok = false;
+    } else {
+        capture_opts->compress_level = level;
+        if (params[1] != NULL) {
+            if (params[2] != NULL || !ws_strtoi32(params[1], NULL, &threads) ||
+                threads < 0 || threads > 64) {
+                cmdarg_err("The number of zstd compression threads must be between 0 and 64");
+                ok = false;
+            } else {
+                capture_opts->compress_threads = threads;
+            }
+        }
+    }
+    g_strfreev(params);
+    return ok;
+}
+#endif
+
 #ifdef HAVE_PCAP_SETSAMPLING
 /*
  * Given a string of the form "<sampling type>:<value>", as might appear
@@ -1157,13 +1207,26 @@ capture_opts_add_opt(capture_options *capture_opts, int opt, const char *optarg_
 #else
             cmdarg_err("'gzip' compression is not supported");
             return 1;
+#endif
+        } else if (strcmp(optarg_str_p, "zstd") == 0 || g_str_has_prefix(optarg_str_p, "zstd:")) {
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+            if (!get_zstd_params(capture_opts, optarg_str_p + strlen("zstd"))) {
+                return 1;
+            }
+            optarg_str_p = "zstd";
+#else
+            cmdarg_err("'zstd' compression is not supported");
+            return 1;
 #endif
         } else {
+            cmdarg_err("parameter of --compress-type must be one of 'none'"
 #if defined (HAVE_ZLIB) || defined (HAVE_ZLIBNG)
-            cmdarg_err("parameter of --compress-type can be 'none' or 'gzip'");
-#else
-            cmdarg_err("parameter of --compress-type can only be 'none'");
+                       ", 'gzip'"
+#endif
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+                       ", 'zstd[:<level>[:<threads>]]'"
 #endif
+                       );
             return 1;
         }
         capture_opts->compress_type = g_strdup(optarg_str_p);
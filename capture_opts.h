@@ -333,6 +333,8 @@ typedef struct capture_options_tag {
     bool               stop_after_extcaps;    /**< request dumpcap stop after last extcap */
     bool               wait_for_extcap_cbs;   /**< extcaps terminated, waiting for callbacks */
     char              *compress_type;         /**< compress type */
+    int                compress_level;        /**< zstd compression level, 0 for the library default */
+    int                compress_threads;      /**< zstd worker threads, 0 to compress in the writer thread */
     char              *closed_msg;            /**< Dumpcap capture closed message */
     unsigned           extcap_terminate_id;   /**< extcap process termination source ID */
     filter_list_t     *capture_filters_list;  /**< list of saved capture filters */
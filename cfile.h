@@ -62,6 +62,7 @@ struct packet_provider_data {
     frame_data  *prev_cap;
     frame_data_sequence *frames;         /* Sequence of frames, if we're keeping that information */
     GTree       *frames_modified_blocks; /* BST with modified blocks for frames (key = frame_data) */
+    GTree       *frames_shift_offsets;   /* BST with time shift offsets for frames (key = frame_data) */
 };
 
 typedef struct _capture_file {
@@ -136,6 +137,8 @@ const char *cap_file_provider_get_interface_name(struct packet_provider_data *pr
 const char *cap_file_provider_get_interface_description(struct packet_provider_data *prov, uint32_t interface_id, unsigned section_number);
 wtap_block_t cap_file_provider_get_modified_block(struct packet_provider_data *prov, const frame_data *fd);
 void cap_file_provider_set_modified_block(struct packet_provider_data *prov, frame_data *fd, const wtap_block_t new_block);
+void cap_file_provider_get_shift_offset(struct packet_provider_data *prov, const frame_data *fd, nstime_t *shift_offset);
+void cap_file_provider_set_shift_offset(struct packet_provider_data *prov, frame_data *fd, const nstime_t *shift_offset);
 
 #ifdef __cplusplus
 }
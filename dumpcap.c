@@ -58,6 +58,7 @@
 #endif /* _WIN32 */
 
 #include "writecap/pcapio.h"
+#include "writecap/async_writer.h"
 
 #ifndef _WIN32
 #include <sys/un.h>
@@ -121,9 +122,6 @@ FILE *debug_log;   /* for logging debug messages to  */
 #include <stdarg.h> /* va_copy */
 #endif
 
-static GAsyncQueue *pcap_queue;
-static int64_t pcap_queue_bytes;
-static int64_t pcap_queue_packets;
 static int64_t pcap_queue_byte_limit;
 static int64_t pcap_queue_packet_limit;
 
@@ -268,6 +266,56 @@ typedef struct _pcapng_pipe_info {
 
 struct _loop_data; /* forward declaration so we can use it in the cap_pipe_dispatch function pointer */
 
+/*
+ * With use_threads, each capture source hands its packets to the writer
+ * (main) thread through its own single-producer, single-consumer byte
+ * ring. The reader thread copies each packet into preallocated space in
+ * the ring and publishes it by advancing "head"; the writer writes the
+ * packet straight out of the ring and then advances "tail". There is no
+ * allocation and no lock per packet.
+ *
+ * Positions increase monotonically and wrap at 2^32; the offset into the
+ * buffer is the position modulo the (power of two) ring size. A record
+ * that doesn't fit before the end of the buffer is preceded by a wrap
+ * marker, a record length of zero, and starts at offset 0.
+ */
+#define PCAP_RING_ALIGN(len)    (((len) + 7U) & ~7U)
+#define PCAP_RING_MIN_SIZE      (1U << 20)  /* 1 MiB */
+#define PCAP_RING_MAX_SIZE      (1U << 30)  /* 1 GiB */
+#define PCAP_RING_DEFAULT_SIZE  (16U << 20) /* 16 MiB, if there's no byte limit */
+#define PCAP_RING_MAX_BYTE_LIMIT (PCAP_RING_MAX_SIZE / 2)
+#define PCAP_RING_BATCH         64          /* Packets per pcap_dispatch() call in a reader thread */
+
+typedef struct _pcap_ring_record {
+    uint32_t                     length;     /**< Record length including this header, or 0 for a wrap marker */
+    uint32_t                     data_len;
+    uint64_t                     ts;         /**< Writer merge key, in nanoseconds */
+    union {
+        struct pcap_pkthdr       phdr;
+        pcapng_block_header_t    bh;
+    } u;
+} pcap_ring_record;
+
+#define PCAP_RING_RECORD_HDR_LEN    PCAP_RING_ALIGN((uint32_t)sizeof(pcap_ring_record))
+#define PCAP_RING_RECORD_DATA(rec)  ((uint8_t *)(rec) + PCAP_RING_RECORD_HDR_LEN)
+
+typedef struct _pcap_ring {
+    uint8_t                     *buf;
+    uint32_t                     size;           /**< Buffer size, a power of two */
+    uint32_t                     byte_limit;     /**< Stop queueing once this many packet bytes are queued */
+    /* Written by the reader thread */
+    int                          head;           /**< Producer position, accessed atomically */
+    int                          packets_in;     /**< Accessed atomically */
+    int                          bytes_in;       /**< Packet bytes, not counting record headers; accessed atomically */
+    uint32_t                     reserved;       /**< Bytes taken by the record being filled in */
+    uint32_t                     high_water;     /**< Most packet bytes queued at any time */
+    uint32_t                     dropped;        /**< Packets dropped because the ring was full */
+    /* Written by the writer thread */
+    int                          tail;           /**< Consumer position, accessed atomically */
+    int                          packets_out;    /**< Accessed atomically */
+    int                          bytes_out;      /**< Accessed atomically */
+} pcap_ring;
+
 /*
  * A source of packets from which we're capturing.
  */
@@ -283,6 +331,7 @@ typedef struct _capture_src {
     unsigned                     interface_id;
     unsigned                     idb_id;                 /**< If from_pcapng is false, the output IDB interface ID. Otherwise the mapping in src_iface_to_global is used. */
     GThread                     *tid;
+    pcap_ring                   *ring;                   /**< Queue to the writer thread if use_threads */
     int                          snaplen;
     int                          linktype;
     bool                         ts_nsec;                /**< true if we're using nanosecond precision. */
@@ -327,6 +376,15 @@ typedef struct _saved_idb {
     unsigned idb_len;
 } saved_idb_t;
 
+/*
+ * Packets handed to the writer thread that it hadn't written yet at an
+ * update interval.
+ */
+typedef struct _unwritten_packets {
+    uint64_t end;          /* Offset after the last of them, counting the bytes of all files */
+    unsigned count;
+} unwritten_packets_t;
+
 /*
  * Global capture loop state.
  */
@@ -348,6 +406,8 @@ typedef struct _loop_data {
     FILE     *pdh;
     int       save_file_fd;
     char     *io_buffer;           /**< Our IO buffer if we increase the size from the standard size */
+    async_writer *writer;          /**< Writer thread of the output file, if --write-buffer was given */
+    GArray   *unwritten_packets;   /**< unwritten_packets_t's, not yet sent to the sync_pipe */
     uint64_t  bytes_written;       /**< Bytes written for the current file. */
     /* autostop conditions */
     int       packets_written;     /**< Packets written for the current file. */
@@ -358,15 +418,6 @@ typedef struct _loop_data {
     int      interval_s;
 } loop_data;
 
-typedef struct _pcap_queue_element {
-    capture_src        *pcap_src;
-    union {
-        struct pcap_pkthdr  phdr;
-        pcapng_block_header_t  bh;
-    } u;
-    uint8_t             *pd;
-} pcap_queue_element;
-
 /*
  * This needs to be static, so that the SIGINT handler can clear the "go"
  * flag and for saved_shb_idb_lock.
@@ -421,6 +472,8 @@ static GPtrArray *capture_comments;
 static bool quiet;
 static bool really_quiet;
 static bool use_threads;
+static size_t write_buffer_size;    /* --write-buffer, in bytes; 0 to write directly */
+static bool direct_io;
 static uint64_t start_time;
 
 static void capture_loop_write_packet_cb(uint8_t *pcap_src_p, const struct pcap_pkthdr *phdr,
@@ -429,6 +482,7 @@ static void capture_loop_queue_packet_cb(uint8_t *pcap_src_p, const struct pcap_
                                          const uint8_t *pd);
 static void capture_loop_write_pcapng_cb(capture_src *pcap_src, const pcapng_block_header_t *bh, uint8_t *pd);
 static void capture_loop_queue_pcapng_cb(capture_src *pcap_src, const pcapng_block_header_t *bh, uint8_t *pd);
+static void pcap_rings_notify(void);
 static void capture_loop_get_errmsg(char *errmsg, size_t errmsglen,
                                     char *secondary_errmsg,
                                     size_t secondary_errmsglen,
@@ -439,7 +493,10 @@ WS_NORETURN static void exit_main(int err);
 
 static void report_new_capture_file(const char *filename);
 static void report_packet_count(unsigned int packet_count);
-static void report_packet_drops(uint32_t received, uint32_t pcap_drops, uint32_t drops, uint32_t flushed, uint32_t ps_ifdrop, char *name);
+static void report_written_packets(bool file_closed);
+static void report_packet_drops(uint32_t received, uint32_t pcap_drops, uint32_t drops, uint32_t flushed, uint32_t ps_ifdrop, char *name,
+                                const pcap_ring *ring);
+static void report_write_buffer(async_writer *writer, bool reportit);
 static void report_capture_error(const char *error_msg, const char *secondary_error_msg);
 static void report_cfilter_error(capture_options *capture_opts, unsigned i, const char *errmsg);
 
@@ -533,15 +590,19 @@ print_usage(FILE *output)
     fprintf(output, "                           (only for pcapng)\n");
     fprintf(output, "  --temp-dir <directory>   write temporary files to this directory\n");
     fprintf(output, "                           (default: %s)\n", g_get_tmp_dir());
+    fprintf(output, "  --write-buffer <MiB>     write the output file(s) from a separate thread,\n");
+    fprintf(output, "                           through two buffers of this size\n");
+    fprintf(output, "  --direct-io              with --write-buffer, bypass the page cache\n");
     fprintf(output, "\n");
 
     ws_log_print_usage(output);
     fprintf(output, "\n");
 
     fprintf(output, "Miscellaneous:\n");
-    fprintf(output, "  -N <packet_limit>        maximum number of packets buffered within dumpcap\n");
-    fprintf(output, "  -C <byte_limit>          maximum number of bytes used for buffering packets\n");
-    fprintf(output, "                           within dumpcap\n");
+    fprintf(output, "  -N <packet_limit>        maximum number of packets buffered per interface\n");
+    fprintf(output, "  -C <byte_limit>          maximum number of bytes buffered per interface\n");
+    fprintf(output, "                           within dumpcap (at most 536870912; default\n");
+    fprintf(output, "                           1000000, or 16777216 if only -N is given)\n");
     fprintf(output, "  -t                       use a separate thread per interface\n");
     fprintf(output, "  -q                       don't report packet capture counts\n");
     fprintf(output, "  -v, --version            print version information and exit\n");
@@ -3516,7 +3577,14 @@ capture_loop_init_output(capture_options *capture_opts, loop_data *ld, char *err
 
     /* Set up to write to the capture file. */
     if (capture_opts->multi_files_on) {
+        ringbuf_set_async_writer(write_buffer_size, direct_io);
         ld->pdh = ringbuf_init_libpcap_fdopen(&err);
+        ld->writer = ringbuf_async_writer();
+    } else if (write_buffer_size != 0 && !capture_opts->output_to_pipe) {
+        /* Whoever reads a pipe wants the packets promptly; only use this for files. */
+        ld->pdh = async_writer_fdopen(ld->save_file_fd, write_buffer_size, direct_io,
+                                      &ld->writer, &err);
+        ws_debug("capture_loop_init_output: write buffer %zu", write_buffer_size);
     } else {
         ld->pdh = ws_fdopen(ld->save_file_fd, "wb");
         if (ld->pdh == NULL) {
@@ -3556,6 +3624,7 @@ capture_loop_init_output(capture_options *capture_opts, loop_data *ld, char *err
         if (!successful) {
             fclose(ld->pdh);
             ld->pdh = NULL;
+            ld->writer = NULL;
             g_free(ld->io_buffer);
             ld->io_buffer = NULL;
         }
@@ -3592,6 +3661,7 @@ capture_loop_close_output(capture_options *capture_opts, loop_data *ld, int *err
 
     ws_debug("capture_loop_close_output");
 
+    ld->writer = NULL;
     if (capture_opts->multi_files_on) {
         return ringbuf_libpcap_dump_close(&capture_opts->save_file, err_close);
     } else {
@@ -3723,10 +3793,11 @@ capture_loop_dispatch(loop_data *ld,
                  * We don't have pcap_breakloop(), so we only process one packet
                  * per pcap_dispatch() call, to allow a signal to stop the
                  * processing immediately, rather than processing all packets
-                 * in a batch before quitting.
+                 * in a batch before quitting. Reader threads don't handle
+                 * signals, so they can take a batch at a time.
                  */
                 if (use_threads) {
-                    inpkts = pcap_dispatch(pcap_src->pcap_h, 1, capture_loop_queue_packet_cb, (uint8_t *)pcap_src);
+                    inpkts = pcap_dispatch(pcap_src->pcap_h, PCAP_RING_BATCH, capture_loop_queue_packet_cb, (uint8_t *)pcap_src);
                 } else {
                     inpkts = pcap_dispatch(pcap_src->pcap_h, 1, capture_loop_write_packet_cb, (uint8_t *)pcap_src);
                 }
@@ -3760,9 +3831,11 @@ capture_loop_dispatch(loop_data *ld,
              * stop capturing; instead, we check for an indication on a pipe
              * after processing packets.  We therefore process only one packet
              * at a time, so that we can check the pipe after every packet.
+             * Reader threads leave that check to the main thread, so they
+             * can take a batch at a time.
              */
             if (use_threads) {
-                inpkts = pcap_dispatch(pcap_src->pcap_h, 1, capture_loop_queue_packet_cb, (uint8_t *)pcap_src);
+                inpkts = pcap_dispatch(pcap_src->pcap_h, PCAP_RING_BATCH, capture_loop_queue_packet_cb, (uint8_t *)pcap_src);
             } else {
                 inpkts = pcap_dispatch(pcap_src->pcap_h, 1, capture_loop_write_packet_cb, (uint8_t *)pcap_src);
             }
@@ -3903,6 +3976,8 @@ capture_loop_open_output(capture_options *capture_opts, int *save_file_fd,
                                              (capture_opts->has_ring_num_files) ? capture_opts->ring_num_files : 0,
                                              capture_opts->group_read_access,
                                              capture_opts->compress_type,
+                                             capture_opts->compress_level,
+                                             capture_opts->compress_threads,
                                              capture_opts->has_nametimenum);
 
                 /* capfile_name is unused as the ringbuffer provides its own filename. */
@@ -4065,6 +4140,7 @@ do_file_switch_or_stop(capture_options *capture_opts)
         /* Switch to the next ringbuffer file */
         if (ringbuf_switch_file(&global_ld.pdh, &capture_opts->save_file,
                                 &global_ld.save_file_fd, &global_ld.err)) {
+            global_ld.writer = ringbuf_async_writer();
 
             /* File switch succeeded: reset the conditions */
             global_ld.bytes_written = 0;
@@ -4081,6 +4157,7 @@ do_file_switch_or_stop(capture_options *capture_opts)
             if (!successful) {
                 fclose(global_ld.pdh);
                 global_ld.pdh = NULL;
+                global_ld.writer = NULL;
                 global_ld.go = false;
                 g_free(global_ld.io_buffer);
                 global_ld.io_buffer = NULL;
@@ -4093,14 +4170,11 @@ do_file_switch_or_stop(capture_options *capture_opts)
                 global_ld.next_interval_time = get_next_time_interval(global_ld.interval_s);
             }
             fflush(global_ld.pdh);
-            if (global_ld.inpkts_to_sync_pipe) {
-                if (!quiet)
-                    report_packet_count(global_ld.inpkts_to_sync_pipe);
-                global_ld.inpkts_to_sync_pipe = 0;
-            }
+            report_written_packets(true);
             report_new_capture_file(capture_opts->save_file);
         } else {
             /* File switch failed: stop here */
+            global_ld.writer = NULL;
             global_ld.go = false;
             return false;
         }
@@ -4124,6 +4198,7 @@ pcap_read_handler(void* arg)
     while (global_ld.go && pcap_src->cap_pipe_err == PIPOK) {
         /* dispatch incoming packets */
         capture_loop_dispatch(&global_ld, errmsg, sizeof(errmsg), pcap_src);
+        pcap_rings_notify();
     }
 
     ws_info("Stopped thread for interface %d.", pcap_src->interface_id);
@@ -4131,44 +4206,222 @@ pcap_read_handler(void* arg)
     return (NULL);
 }
 
-/* Try to pop an item off the packet queue and if it exists, write it */
+static GMutex pcap_ring_mutex;
+static GCond pcap_ring_cond;
+static int pcap_ring_writer_waiting;
+
+static pcap_ring *
+pcap_ring_new(int64_t byte_limit)
+{
+    pcap_ring *ring = g_new0(pcap_ring, 1);
+    uint32_t   size = PCAP_RING_MIN_SIZE;
+
+    /* Larger limits are reduced, with a warning, when parsing -C. */
+    if (byte_limit <= 0) {
+        byte_limit = PCAP_RING_DEFAULT_SIZE;
+    } else if (byte_limit > PCAP_RING_MAX_BYTE_LIMIT) {
+        byte_limit = PCAP_RING_MAX_BYTE_LIMIT;
+    }
+    /*
+     * The limit is on packet bytes, as with the old queue. Leave room
+     * for the record headers, for a packet that starts just below the
+     * limit, and for the space skipped when wrapping; if there are so
+     * many small packets that the headers fill the ring, we drop before
+     * reaching the limit.
+     */
+    while (size < 2 * byte_limit) {
+        size <<= 1;
+    }
+    ring->buf = (uint8_t *)g_malloc(size);
+    ring->size = size;
+    ring->byte_limit = (uint32_t)byte_limit;
+    return ring;
+}
+
+static void
+pcap_ring_free(pcap_ring *ring)
+{
+    if (ring) {
+        g_free(ring->buf);
+        g_free(ring);
+    }
+}
+
+/*
+ * Reader thread: reserve room for a record with data_len bytes of data.
+ * Returns NULL, and counts a drop, if that would exceed one of the
+ * queue limits.
+ */
+static pcap_ring_record *
+pcap_ring_reserve(pcap_ring *ring, uint32_t data_len)
+{
+    unsigned head = (unsigned)g_atomic_int_get(&ring->head);
+    unsigned used = head - (unsigned)g_atomic_int_get(&ring->tail);
+    unsigned queued = (unsigned)g_atomic_int_get(&ring->bytes_in) - (unsigned)g_atomic_int_get(&ring->bytes_out);
+    uint32_t offset = head & (ring->size - 1);
+    uint32_t to_end = ring->size - offset;
+    uint32_t rec_len;
+    uint32_t needed;
+
+    if (data_len > ring->size ||
+        queued >= ring->byte_limit ||
+        (pcap_queue_packet_limit != 0 &&
+         g_atomic_int_get(&ring->packets_in) - g_atomic_int_get(&ring->packets_out) >= pcap_queue_packet_limit)) {
+        ring->dropped++;
+        return NULL;
+    }
+    rec_len = PCAP_RING_RECORD_HDR_LEN + PCAP_RING_ALIGN(data_len);
+    needed = rec_len > to_end ? to_end + rec_len : rec_len;
+    if (needed > ring->size - used) {
+        ring->dropped++;
+        return NULL;
+    }
+    if (rec_len > to_end) {
+        /* Wrap to the start of the buffer. */
+        ((pcap_ring_record *)(void *)(ring->buf + offset))->length = 0;
+        offset = 0;
+    }
+    if (queued + data_len > ring->high_water) {
+        ring->high_water = queued + data_len;
+    }
+    ring->reserved = needed;
+    return (pcap_ring_record *)(void *)(ring->buf + offset);
+}
+
+/* Reader thread: make a record returned by pcap_ring_reserve() visible to the writer. */
+static void
+pcap_ring_commit(pcap_ring *ring, pcap_ring_record *rec, uint32_t data_len)
+{
+    rec->length = PCAP_RING_RECORD_HDR_LEN + PCAP_RING_ALIGN(data_len);
+    rec->data_len = data_len;
+    g_atomic_int_inc(&ring->packets_in);
+    g_atomic_int_add(&ring->bytes_in, (int)data_len);
+    g_atomic_int_set(&ring->head, (int)((unsigned)g_atomic_int_get(&ring->head) + ring->reserved));
+}
+
+/* Writer thread: return the oldest record in the ring without removing it. */
+static pcap_ring_record *
+pcap_ring_peek(pcap_ring *ring)
+{
+    unsigned          head = (unsigned)g_atomic_int_get(&ring->head);
+    unsigned          tail = (unsigned)g_atomic_int_get(&ring->tail);
+    uint32_t          offset = tail & (ring->size - 1);
+    pcap_ring_record *rec;
+
+    if (head == tail) {
+        return NULL;
+    }
+    rec = (pcap_ring_record *)(void *)(ring->buf + offset);
+    if (rec->length == 0) {
+        /* A wrap marker is always published together with the record after it. */
+        g_atomic_int_set(&ring->tail, (int)(tail + ring->size - offset));
+        rec = (pcap_ring_record *)(void *)ring->buf;
+    }
+    return rec;
+}
+
+/* Writer thread: give the space of the record returned by pcap_ring_peek() back to the reader. */
+static void
+pcap_ring_release(pcap_ring *ring, pcap_ring_record *rec)
+{
+    g_atomic_int_inc(&ring->packets_out);
+    g_atomic_int_add(&ring->bytes_out, (int)rec->data_len);
+    g_atomic_int_set(&ring->tail, (int)((unsigned)g_atomic_int_get(&ring->tail) + rec->length));
+}
+
 static bool
-capture_loop_dequeue_packet(void) {
-    pcap_queue_element *queue_element;
-
-    g_async_queue_lock(pcap_queue);
-    queue_element = (pcap_queue_element *)g_async_queue_timeout_pop_unlocked(pcap_queue, WRITER_THREAD_TIMEOUT);
-    if (queue_element) {
-        if (queue_element->pcap_src->from_pcapng) {
-            pcap_queue_bytes -= queue_element->u.bh.block_total_length;
-        } else {
-            pcap_queue_bytes -= queue_element->u.phdr.caplen;
+pcap_rings_empty(void)
+{
+    for (unsigned i = 0; i < global_ld.pcaps->len; i++) {
+        capture_src *pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
+
+        if (g_atomic_int_get(&pcap_src->ring->head) != g_atomic_int_get(&pcap_src->ring->tail)) {
+            return false;
         }
-        pcap_queue_packets -= 1;
     }
-    g_async_queue_unlock(pcap_queue);
-    if (queue_element) {
-        if (queue_element->pcap_src->from_pcapng) {
-            ws_info("Dequeued a block of type 0x%08x of length %d captured on interface %d.",
-                  queue_element->u.bh.block_type, queue_element->u.bh.block_total_length,
-                  queue_element->pcap_src->interface_id);
+    return true;
+}
 
-            capture_loop_write_pcapng_cb(queue_element->pcap_src,
-                                        &queue_element->u.bh,
-                                        queue_element->pd);
-        } else {
-            ws_info("Dequeued a packet of length %d captured on interface %d.",
-                queue_element->u.phdr.caplen, queue_element->pcap_src->interface_id);
+/*
+ * Reader thread: wake up the writer if it's waiting for packets. This is
+ * called once per batch, and only takes the lock if the writer is asleep.
+ */
+static void
+pcap_rings_notify(void)
+{
+    if (g_atomic_int_get(&pcap_ring_writer_waiting)) {
+        g_mutex_lock(&pcap_ring_mutex);
+        g_cond_signal(&pcap_ring_cond);
+        g_mutex_unlock(&pcap_ring_mutex);
+    }
+}
+
+/* Writer thread: wait up to WRITER_THREAD_TIMEOUT for a reader to queue something. */
+static void
+pcap_rings_wait(void)
+{
+    int64_t end_time = g_get_monotonic_time() + WRITER_THREAD_TIMEOUT;
+
+    g_mutex_lock(&pcap_ring_mutex);
+    g_atomic_int_set(&pcap_ring_writer_waiting, 1);
+    if (pcap_rings_empty()) {
+        g_cond_wait_until(&pcap_ring_cond, &pcap_ring_mutex, end_time);
+    }
+    g_atomic_int_set(&pcap_ring_writer_waiting, 0);
+    g_mutex_unlock(&pcap_ring_mutex);
+}
+
+/*
+ * Find the queued record with the lowest timestamp across all capture
+ * sources. Each ring is in capture order, so this merges whatever the
+ * readers have queued so far.
+ */
+static pcap_ring_record *
+pcap_rings_next(capture_src **next_src)
+{
+    pcap_ring_record *next_rec = NULL;
+
+    for (unsigned i = 0; i < global_ld.pcaps->len; i++) {
+        capture_src      *pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
+        pcap_ring_record *rec = pcap_ring_peek(pcap_src->ring);
 
-            capture_loop_write_packet_cb((uint8_t *) queue_element->pcap_src,
-                                        &queue_element->u.phdr,
-                                        queue_element->pd);
+        if (rec && (next_rec == NULL || rec->ts < next_rec->ts)) {
+            next_rec = rec;
+            *next_src = pcap_src;
         }
-        g_free(queue_element->pd);
-        g_free(queue_element);
-        return true;
     }
-    return false;
+    return next_rec;
+}
+
+/* Try to take the next packet off the packet queues and if it exists, write it */
+static bool
+capture_loop_dequeue_packet(bool wait) {
+    capture_src      *pcap_src = NULL;
+    pcap_ring_record *rec;
+
+    rec = pcap_rings_next(&pcap_src);
+    if (rec == NULL && wait) {
+        pcap_rings_wait();
+        rec = pcap_rings_next(&pcap_src);
+    }
+    if (rec == NULL) {
+        return false;
+    }
+    if (pcap_src->from_pcapng) {
+        ws_info("Dequeued a block of type 0x%08x of length %d captured on interface %d.",
+              rec->u.bh.block_type, rec->u.bh.block_total_length,
+              pcap_src->interface_id);
+
+        capture_loop_write_pcapng_cb(pcap_src, &rec->u.bh, PCAP_RING_RECORD_DATA(rec));
+    } else {
+        ws_info("Dequeued a packet of length %d captured on interface %d.",
+            rec->u.phdr.caplen, pcap_src->interface_id);
+
+        capture_loop_write_packet_cb((uint8_t *) pcap_src, &rec->u.phdr,
+                                     PCAP_RING_RECORD_DATA(rec));
+    }
+    pcap_ring_release(pcap_src->ring, rec);
+    return true;
 }
 
 /*
@@ -4238,6 +4491,7 @@ capture_loop_start(capture_options *capture_opts, bool *stats_known, struct pcap
     global_ld.pdh                 = NULL;
     global_ld.save_file_fd        = -1;
     global_ld.io_buffer           = NULL;
+    global_ld.writer              = NULL;
     global_ld.file_count          = 0;
     global_ld.file_duration_timer = NULL;
     global_ld.next_interval_time  = 0;
@@ -4348,9 +4602,10 @@ capture_loop_start(capture_options *capture_opts, bool *stats_known, struct pcap
     /* WOW, everything is prepared! */
     /* please fasten your seat belts, we will enter now the actual capture loop */
     if (use_threads) {
-        pcap_queue = g_async_queue_new();
-        pcap_queue_bytes = 0;
-        pcap_queue_packets = 0;
+        for (i = 0; i < global_ld.pcaps->len; i++) {
+            pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
+            pcap_src->ring = pcap_ring_new(pcap_queue_byte_limit);
+        }
         for (i = 0; i < global_ld.pcaps->len; i++) {
             pcap_src = g_array_index(global_ld.pcaps, capture_src *, i);
             /* XXX - Add an interface name here? */
@@ -4360,7 +4615,7 @@ capture_loop_start(capture_options *capture_opts, bool *stats_known, struct pcap
     while (global_ld.go) {
         /* dispatch incoming packets */
         if (use_threads) {
-            bool dequeued = capture_loop_dequeue_packet();
+            bool dequeued = capture_loop_dequeue_packet(true);
 
             if (dequeued) {
                 inpkts = 1;
@@ -4391,6 +4646,8 @@ capture_loop_start(capture_options *capture_opts, bool *stats_known, struct pcap
         if (global_ld.report_packet_count) {
             fprintf(stderr, "%u packet%s captured\n", global_ld.packets_captured,
                     plurality(global_ld.packets_captured, "", "s"));
+            if (global_ld.writer != NULL)
+                report_write_buffer(global_ld.writer, true);
             global_ld.report_packet_count = false;
         }
 #endif
@@ -4432,18 +4689,24 @@ capture_loop_start(capture_options *capture_opts, bool *stats_known, struct pcap
             }
 #endif
             /* Let the parent process know. */
-            if (global_ld.inpkts_to_sync_pipe) {
+            if (global_ld.inpkts_to_sync_pipe || global_ld.unwritten_packets->len) {
                 /* do sync here */
                 fflush(global_ld.pdh);
+                if (global_ld.writer != NULL) {
+                    /* Don't let packets sit in a partly filled buffer for
+                       long. Don't wait for the writer thread, though; we
+                       only tell our parent about what it has written. */
+                    async_writer_flush(global_ld.writer, false);
+                }
 
-                /* Send our parent a message saying we've written out
-                   "global_ld.inpkts_to_sync_pipe" packets to the capture file. */
-                if (!quiet)
-                    report_packet_count(global_ld.inpkts_to_sync_pipe);
-
-                global_ld.inpkts_to_sync_pipe = 0;
+                /* Send our parent a message saying how many packets
+                   we've written out to the capture file. */
+                report_written_packets(false);
             }
 
+            if (global_ld.writer != NULL)
+                report_write_buffer(global_ld.writer, false);
+
             /* check capture duration condition */
             if (autostop_duration_timer != NULL && g_timer_elapsed(autostop_duration_timer, NULL) >= capture_opts->autostop_duration) {
                 /* The maximum capture time has elapsed; stop the capture. */
@@ -4477,7 +4740,7 @@ capture_loop_start(capture_options *capture_opts, bool *stats_known, struct pcap
             ws_info("Thread of interface %u terminated.", pcap_src->interface_id);
         }
         while (1) {
-            bool dequeued = capture_loop_dequeue_packet();
+            bool dequeued = capture_loop_dequeue_packet(false);
             if (!dequeued) {
                 break;
             }
@@ -4625,16 +4888,14 @@ capture_loop_start(capture_options *capture_opts, bool *stats_known, struct pcap
     if (capture_opts->saving_to_file) {
         /* close the output file */
         close_ok = capture_loop_close_output(capture_opts, &global_ld, &err_close);
+        if (write_buffer_size != 0 && !capture_opts->output_to_pipe)
+            report_write_buffer(NULL, !really_quiet);
     } else
         close_ok = true;
 
     /* there might be packets not yet notified to the parent */
     /* (do this after closing the file, so all packets are already flushed) */
-    if (global_ld.inpkts_to_sync_pipe) {
-        if (!quiet)
-            report_packet_count(global_ld.inpkts_to_sync_pipe);
-        global_ld.inpkts_to_sync_pipe = 0;
-    }
+    report_written_packets(true);
 
     /* If we've displayed a message about a write error, there's no point
        in displaying another message about an error on close. */
@@ -4678,7 +4939,10 @@ capture_loop_start(capture_options *capture_opts, bool *stats_known, struct pcap
                 report_capture_error(errmsg, please_report_bug());
             }
         }
-        report_packet_drops(received, pcap_dropped, pcap_src->dropped, pcap_src->flushed, stats->ps_ifdrop, interface_opts->display_name);
+        report_packet_drops(received, pcap_dropped, pcap_src->dropped, pcap_src->flushed, stats->ps_ifdrop, interface_opts->display_name,
+                            pcap_src->ring);
+        pcap_ring_free(pcap_src->ring);
+        pcap_src->ring = NULL;
     }
 
     /* close the input file (pcap or capture pipe) */
@@ -4951,9 +5215,8 @@ static void
 capture_loop_queue_packet_cb(uint8_t *pcap_src_p, const struct pcap_pkthdr *phdr,
                              const uint8_t *pd)
 {
-    capture_src        *pcap_src = (capture_src *) (void *) pcap_src_p;
-    pcap_queue_element *queue_element;
-    bool                limit_reached;
+    capture_src      *pcap_src = (capture_src *) (void *) pcap_src_p;
+    pcap_ring_record *rec;
 
     /* We may be called multiple times from pcap_dispatch(); if we've set
        the "stop capturing" flag, ignore this packet, as we're not
@@ -4963,54 +5226,28 @@ capture_loop_queue_packet_cb(uint8_t *pcap_src_p, const struct pcap_pkthdr *phdr
         return;
     }
 
-    queue_element = g_new(pcap_queue_element, 1);
-    if (queue_element == NULL) {
-       pcap_src->dropped++;
-       return;
-    }
-    queue_element->pcap_src = pcap_src;
-    queue_element->u.phdr = *phdr;
-    queue_element->pd = (uint8_t *)g_malloc(phdr->caplen);
-    if (queue_element->pd == NULL) {
-        pcap_src->dropped++;
-        g_free(queue_element);
-        return;
-    }
-    memcpy(queue_element->pd, pd, phdr->caplen);
-    g_async_queue_lock(pcap_queue);
-    if (((pcap_queue_byte_limit == 0) || (pcap_queue_bytes < pcap_queue_byte_limit)) &&
-        ((pcap_queue_packet_limit == 0) || (pcap_queue_packets < pcap_queue_packet_limit))) {
-        limit_reached = false;
-        g_async_queue_push_unlocked(pcap_queue, queue_element);
-        pcap_queue_bytes += phdr->caplen;
-        pcap_queue_packets += 1;
-    } else {
-        limit_reached = true;
-    }
-    g_async_queue_unlock(pcap_queue);
-    if (limit_reached) {
+    rec = pcap_ring_reserve(pcap_src->ring, phdr->caplen);
+    if (rec == NULL) {
         pcap_src->dropped++;
-        g_free(queue_element->pd);
-        g_free(queue_element);
         ws_info("Dropped a packet of length %d captured on interface %u.",
               phdr->caplen, pcap_src->interface_id);
-    } else {
-        pcap_src->received++;
-        ws_info("Queued a packet of length %d captured on interface %u.",
-              phdr->caplen, pcap_src->interface_id);
+        return;
     }
-    /* I don't want to hold the mutex over the debug output. So the
-       output may be wrong */
-    ws_info("Queue size is now %" PRId64 " bytes (%" PRId64 " packets)",
-          pcap_queue_bytes, pcap_queue_packets);
+    rec->u.phdr = *phdr;
+    rec->ts = (uint64_t)phdr->ts.tv_sec * 1000000000 +
+              (uint64_t)phdr->ts.tv_usec * (pcap_src->ts_nsec ? 1 : 1000);
+    memcpy(PCAP_RING_RECORD_DATA(rec), pd, phdr->caplen);
+    pcap_ring_commit(pcap_src->ring, rec, phdr->caplen);
+    pcap_src->received++;
+    ws_info("Queued a packet of length %d captured on interface %u.",
+          phdr->caplen, pcap_src->interface_id);
 }
 
 /* one pcapng block was captured, queue it */
 static void
 capture_loop_queue_pcapng_cb(capture_src *pcap_src, const pcapng_block_header_t *bh, uint8_t *pd)
 {
-    pcap_queue_element *queue_element;
-    bool                limit_reached;
+    pcap_ring_record *rec;
 
     /* We may be called multiple times from pcap_dispatch(); if we've set
        the "stop capturing" flag, ignore this packet, as we're not
@@ -5020,46 +5257,28 @@ capture_loop_queue_pcapng_cb(capture_src *pcap_src, const pcapng_block_header_t
         return;
     }
 
-    queue_element = g_new(pcap_queue_element, 1);
-    if (queue_element == NULL) {
-       pcap_src->dropped++;
-       return;
-    }
-    queue_element->pcap_src = pcap_src;
-    queue_element->u.bh = *bh;
-    queue_element->pd = (uint8_t *)g_malloc(bh->block_total_length);
-    if (queue_element->pd == NULL) {
-        pcap_src->dropped++;
-        g_free(queue_element);
-        return;
-    }
-    memcpy(queue_element->pd, pd, bh->block_total_length);
-    g_async_queue_lock(pcap_queue);
-    if (((pcap_queue_byte_limit == 0) || (pcap_queue_bytes < pcap_queue_byte_limit)) &&
-        ((pcap_queue_packet_limit == 0) || (pcap_queue_packets < pcap_queue_packet_limit))) {
-        limit_reached = false;
-        g_async_queue_push_unlocked(pcap_queue, queue_element);
-        pcap_queue_bytes += bh->block_total_length;
-        pcap_queue_packets += 1;
-    } else {
-        limit_reached = true;
-    }
-    g_async_queue_unlock(pcap_queue);
-    if (limit_reached) {
+    rec = pcap_ring_reserve(pcap_src->ring, bh->block_total_length);
+    if (rec == NULL) {
         pcap_src->dropped++;
-        g_free(queue_element->pd);
-        g_free(queue_element);
         ws_info("Dropped a packet of length %d captured on interface %u.",
               bh->block_total_length, pcap_src->interface_id);
-    } else {
-        pcap_src->received++;
-        ws_info("Queued a block of type 0x%08x of length %d captured on interface %u.",
-              bh->block_type, bh->block_total_length, pcap_src->interface_id);
+        return;
     }
-    /* I don't want to hold the mutex over the debug output. So the
-       output may be wrong */
-    ws_info("Queue size is now %" PRId64 " bytes (%" PRId64 " packets)",
-          pcap_queue_bytes, pcap_queue_packets);
+    rec->u.bh = *bh;
+    /*
+     * Block timestamps are in the units of the interface that the block
+     * refers to, so we don't try to compare them with other sources.
+     * Use the time the block arrived instead, so that the blocks are
+     * merged with the packets of the other sources in about the order
+     * in which they arrived, and a busy pcapng pipe can't hold up the
+     * other sources until their queues overflow.
+     */
+    rec->ts = (uint64_t)g_get_real_time() * 1000;
+    memcpy(PCAP_RING_RECORD_DATA(rec), pd, bh->block_total_length);
+    pcap_ring_commit(pcap_src->ring, rec, bh->block_total_length);
+    pcap_src->received++;
+    ws_info("Queued a block of type 0x%08x of length %d captured on interface %u.",
+          bh->block_type, bh->block_total_length, pcap_src->interface_id);
 }
 
 static int
@@ -5141,6 +5360,8 @@ gather_dumpcap_runtime_info(feature_list l)
 #ifdef _WIN32
 #define LONGOPT_SIGNAL_PIPE        LONGOPT_BASE_APPLICATION+4
 #endif
+#define LONGOPT_WRITE_BUFFER       LONGOPT_BASE_APPLICATION+5
+#define LONGOPT_DIRECT_IO          LONGOPT_BASE_APPLICATION+6
 
 /* And now our feature presentation... [ fade to music ] */
 int
@@ -5158,6 +5379,8 @@ main(int argc, char *argv[])
 #ifdef _WIN32
         {"signal-pipe", ws_required_argument, NULL, LONGOPT_SIGNAL_PIPE},
 #endif
+        {"write-buffer", ws_required_argument, NULL, LONGOPT_WRITE_BUFFER},
+        {"direct-io", ws_no_argument, NULL, LONGOPT_DIRECT_IO},
         {0, 0, 0, 0 }
     };
 
@@ -5326,6 +5549,7 @@ main(int argc, char *argv[])
     global_ld.pcapng_passthrough = false;
     global_ld.saved_shb = NULL;
     global_ld.saved_idbs = g_array_new(FALSE, TRUE, sizeof(saved_idb_t));
+    global_ld.unwritten_packets = g_array_new(FALSE, FALSE, sizeof(unwritten_packets_t));
 
     err_msg = ws_init_sockets();
     if (err_msg != NULL)
@@ -5551,6 +5775,25 @@ main(int argc, char *argv[])
             }
             g_ptr_array_add(capture_comments, g_strdup(ws_optarg));
             break;
+        case LONGOPT_WRITE_BUFFER:
+        {
+            int mib;
+
+            if (!async_writer_is_supported()) {
+                cmdarg_err("--write-buffer isn't supported on this platform");
+                exit_main(1);
+            }
+            mib = get_positive_int(ws_optarg, "write buffer size");
+            if (mib > 1024) {
+                cmdarg_err("The write buffer size can't be more than 1024 MiB");
+                exit_main(1);
+            }
+            write_buffer_size = (size_t)mib * 1024 * 1024;
+            break;
+        }
+        case LONGOPT_DIRECT_IO:
+            direct_io = true;
+            break;
         case 'Z':
             capture_child = true;
             /*
@@ -5637,6 +5880,11 @@ main(int argc, char *argv[])
             break;
         case 'C':
             pcap_queue_byte_limit = get_positive_int(ws_optarg, "byte_limit");
+            if (pcap_queue_byte_limit > PCAP_RING_MAX_BYTE_LIMIT) {
+                ws_warning("The byte limit can't be more than %u; using %u",
+                           PCAP_RING_MAX_BYTE_LIMIT, PCAP_RING_MAX_BYTE_LIMIT);
+                pcap_queue_byte_limit = PCAP_RING_MAX_BYTE_LIMIT;
+            }
             break;
         case 'N':
             pcap_queue_packet_limit = get_positive_int(ws_optarg, "packet_limit");
@@ -5712,6 +5960,11 @@ main(int argc, char *argv[])
             exit_main(1);
         }
 
+        if (direct_io && write_buffer_size == 0) {
+            cmdarg_err("--direct-io can only be used with --write-buffer.");
+            exit_main(1);
+        }
+
         /* Was the ring buffer option specified and, if so, does it make sense? */
         if (global_capture_opts.multi_files_on) {
             /* Ring buffer works only under certain conditions:
@@ -6110,6 +6363,52 @@ dumpcap_log_writer(const char *domain, enum ws_log_level level,
 /* indication report routines */
 
 
+/*
+ * Report the packets written since the last report. With --write-buffer,
+ * that's only the ones the writer thread has written so far, unless the
+ * file has been closed; the others are remembered, and reported once it
+ * has written them.
+ */
+static void
+report_written_packets(bool file_closed)
+{
+    unsigned packet_count = 0;
+    unsigned i;
+
+    if (global_ld.writer != NULL && !file_closed) {
+        async_writer_stats stats;
+
+        async_writer_get_stats(global_ld.writer, &stats);
+        if (global_ld.inpkts_to_sync_pipe) {
+            unwritten_packets_t unwritten;
+
+            unwritten.end = stats.bytes_written + stats.in_flight + stats.buffered;
+            unwritten.count = global_ld.inpkts_to_sync_pipe;
+            g_array_append_val(global_ld.unwritten_packets, unwritten);
+            global_ld.inpkts_to_sync_pipe = 0;
+        }
+        for (i = 0; i < global_ld.unwritten_packets->len; i++) {
+            unwritten_packets_t *unwritten = &g_array_index(global_ld.unwritten_packets, unwritten_packets_t, i);
+
+            if (unwritten->end > stats.bytes_written)
+                break;
+            packet_count += unwritten->count;
+        }
+        g_array_remove_range(global_ld.unwritten_packets, 0, i);
+    } else {
+        for (i = 0; i < global_ld.unwritten_packets->len; i++) {
+            packet_count += g_array_index(global_ld.unwritten_packets, unwritten_packets_t, i).count;
+        }
+        g_array_set_size(global_ld.unwritten_packets, 0);
+        packet_count += global_ld.inpkts_to_sync_pipe;
+        global_ld.inpkts_to_sync_pipe = 0;
+    }
+
+    if (packet_count && !quiet)
+        report_packet_count(packet_count);
+}
+
+
 static void
 report_packet_count(unsigned int packet_count)
 {
@@ -6210,7 +6509,8 @@ report_capture_error(const char *error_msg, const char *secondary_error_msg)
 }
 
 static void
-report_packet_drops(uint32_t received, uint32_t pcap_drops, uint32_t drops, uint32_t flushed, uint32_t ps_ifdrop, char *name)
+report_packet_drops(uint32_t received, uint32_t pcap_drops, uint32_t drops, uint32_t flushed, uint32_t ps_ifdrop, char *name,
+                    const pcap_ring *ring)
 {
     uint32_t total_drops = pcap_drops + drops + flushed;
 
@@ -6219,6 +6519,10 @@ report_packet_drops(uint32_t received, uint32_t pcap_drops, uint32_t drops, uint
 
         ws_debug("Packets received/dropped on interface '%s': %u/%u (pcap:%u/dumpcap:%u/flushed:%u/ps_ifdrop:%u)",
             name, received, total_drops, pcap_drops, drops, flushed, ps_ifdrop);
+        if (ring) {
+            ws_debug("Packet queue on interface '%s': high water %u/%u bytes, %u dropped when full",
+                name, ring->high_water, ring->byte_limit, ring->dropped);
+        }
         sync_pipe_write_string_msg(sync_pipe_fd, SP_DROPS, tmp);
         g_free(tmp);
     } else {
@@ -6227,12 +6531,47 @@ report_packet_drops(uint32_t received, uint32_t pcap_drops, uint32_t drops, uint
                 "Packets received/dropped on interface '%s': %u/%u (pcap:%u/dumpcap:%u/flushed:%u/ps_ifdrop:%u) (%.1f%%)\n",
                 name, received, total_drops, pcap_drops, drops, flushed, ps_ifdrop,
                 received ? 100.0 * received / (received + total_drops) : 0.0);
+            if (ring) {
+                fprintf(stderr,
+                    "Packet queue on interface '%s': high water %u/%u bytes, %u dropped when full\n",
+                    name, ring->high_water, ring->byte_limit, ring->dropped);
+            }
             /* stderr could be line buffered */
             fflush(stderr);
         }
     }
 }
 
+/*
+ * Report how full the write buffers are (if writer is non-null) and how
+ * often the capture had to wait for the writer thread.
+ */
+static void
+report_write_buffer(async_writer *writer, bool reportit)
+{
+    async_writer_stats stats;
+
+    async_writer_get_stats(writer, &stats);
+    if (writer != NULL) {
+        ws_debug("Write buffer: %zu/%zu bytes filled, %zu bytes being written%s",
+            stats.buffered, stats.buffer_size, stats.in_flight,
+            stats.direct_io ? " (direct I/O)" : "");
+    }
+    ws_debug("Write buffer: %" PRIu64 " bytes written, %u stalls", stats.bytes_written, stats.stalls);
+
+    if (!capture_child && reportit) {
+        if (writer != NULL) {
+            fprintf(stderr, "Write buffer: %zu/%zu bytes filled, %zu bytes being written%s\n",
+                stats.buffered, stats.buffer_size, stats.in_flight,
+                stats.direct_io ? " (direct I/O)" : "");
+        }
+        fprintf(stderr, "Write buffer: %" PRIu64 " bytes written, capture waited for the disk %u time%s\n",
+            stats.bytes_written, stats.stalls, plurality(stats.stalls, "", "s"));
+        /* stderr could be line buffered */
+        fflush(stderr);
+    }
+}
+
 
 /************************************************************************************************/
 /* signal_pipe handling */
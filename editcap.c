@@ -90,6 +90,7 @@ struct select_item {
 typedef struct _fd_hash_t {
     uint8_t    digest[16];
     uint32_t   len;
+    bool       in_index;    /* entry is in use, and counted in fd_index[] */
     nstime_t   frame_time;
 } fd_hash_t;
 
@@ -100,6 +101,22 @@ static fd_hash_t fd_hash[MAX_DUP_DEPTH];
 static int       dup_window    = DEFAULT_DUP_DEPTH;
 static int       cur_dup_entry;
 
+/*
+ * Index of the (digest, length) pairs currently in the fd_hash[] window,
+ * so that a frame can be checked against a window of up to MAX_DUP_DEPTH
+ * frames without scanning all of it.  Open addressing with linear
+ * probing; a slot with a zero count is free.  It has at least twice as
+ * many slots as the window has entries, so probe sequences stay short.
+ */
+typedef struct _fd_index_t {
+    uint8_t    digest[16];
+    uint32_t   len;
+    uint32_t   count;       /* number of entries in the window with this digest and length */
+} fd_index_t;
+
+static fd_index_t *fd_index;
+static uint32_t    fd_index_mask;
+
 static uint32_t  ignored_bytes;  /* Used with -I */
 
 #define ONE_BILLION 1000000000
@@ -640,15 +657,112 @@ set_unused_info(const wtap_packet_header *phdr, uint8_t* fd) {
     }
 }
 
+static void
+fd_index_init(void)
+{
+    uint32_t size = 1;
+
+    while (size < 2 * (uint32_t)dup_window)
+        size <<= 1;
+    fd_index = g_new0(fd_index_t, size);
+    fd_index_mask = size - 1;
+}
+
+static inline uint32_t
+fd_index_slot(const uint8_t *digest, uint32_t len)
+{
+    /* The digest is already uniformly distributed. */
+    return (pletoh32(digest) ^ (len * 0x9E3779B1U)) & fd_index_mask;
+}
+
+/* Returns the slot for this digest and length, or the free slot where it
+ * would go. */
+static uint32_t
+fd_index_find(const uint8_t *digest, uint32_t len)
+{
+    uint32_t i = fd_index_slot(digest, len);
+
+    while (fd_index[i].count != 0) {
+        if (fd_index[i].len == len && memcmp(fd_index[i].digest, digest, 16) == 0)
+            break;
+        i = (i + 1) & fd_index_mask;
+    }
+    return i;
+}
+
+static void
+fd_index_add(const fd_hash_t *entry)
+{
+    uint32_t i = fd_index_find(entry->digest, entry->len);
+
+    if (fd_index[i].count == 0) {
+        memcpy(fd_index[i].digest, entry->digest, 16);
+        fd_index[i].len = entry->len;
+    }
+    fd_index[i].count++;
+}
+
+static void
+fd_index_remove(const fd_hash_t *entry)
+{
+    uint32_t i = fd_index_find(entry->digest, entry->len);
+    uint32_t j, home;
+
+    ws_assert(fd_index[i].count != 0);
+    if (--fd_index[i].count != 0)
+        return;
+
+    /*
+     * Backward shift deletion: move up any following entries in the
+     * probe sequence that can't otherwise be reached anymore.
+     */
+    for (j = (i + 1) & fd_index_mask; fd_index[j].count != 0; j = (j + 1) & fd_index_mask) {
+        home = fd_index_slot(fd_index[j].digest, fd_index[j].len);
+        /* Leave it if its home slot is cyclically in (i, j]. */
+        if (((j - home) & fd_index_mask) < ((j - i) & fd_index_mask))
+            continue;
+        fd_index[i] = fd_index[j];
+        fd_index[j].count = 0;
+        i = j;
+    }
+}
+
+/*
+ * Replace the oldest entry in the fd_hash[] window with the digest of this
+ * frame, and return the number of other entries in the window with the
+ * same digest and length.
+ */
+static uint32_t
+dup_window_add(const uint8_t *fd, uint32_t len, uint32_t offset)
+{
+    fd_hash_t *entry;
+    uint32_t count;
+
+    cur_dup_entry++;
+    if (cur_dup_entry >= dup_window)
+        cur_dup_entry = 0;
+
+    entry = &fd_hash[cur_dup_entry];
+    if (entry->in_index)
+        fd_index_remove(entry);
+
+    /* Calculate our digest */
+    gcry_md_hash_buffer(GCRY_MD_MD5, entry->digest, &fd[offset], len - offset);
+
+    entry->len = len;
+    count = fd_index[fd_index_find(entry->digest, entry->len)].count;
+    fd_index_add(entry);
+    entry->in_index = true;
+
+    return count;
+}
+
 static bool
 is_duplicate(uint8_t* fd, uint32_t len) {
-    int i;
     const struct ieee80211_radiotap_header* tap_header;
 
     /*Hint to ignore some bytes at the start of the frame for the digest calculation(-I option) */
     uint32_t offset = ignored_bytes;
-    uint32_t new_len;
-    uint8_t *new_fd;
 
     if (len <= ignored_bytes) {
         offset = 0;
@@ -662,30 +776,8 @@ is_duplicate(uint8_t* fd, uint32_t len) {
             offset = 0;
     }
 
-    new_fd  = &fd[offset];
-    new_len = len - (offset);
-
-    cur_dup_entry++;
-    if (cur_dup_entry >= dup_window)
-        cur_dup_entry = 0;
-
-    /* Calculate our digest */
-    gcry_md_hash_buffer(GCRY_MD_MD5, fd_hash[cur_dup_entry].digest, new_fd, new_len);
-
-    fd_hash[cur_dup_entry].len = len;
-
     /* Look for duplicates */
-    for (i = 0; i < dup_window; i++) {
-        if (i == cur_dup_entry)
-            continue;
-
-        if (fd_hash[i].len == fd_hash[cur_dup_entry].len
-            && memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0) {
-            return true;
-        }
-    }
-
-    return false;
+    return dup_window_add(fd, len, offset) != 0;
 }
 
 static bool
@@ -694,24 +786,18 @@ is_duplicate_rel_time(uint8_t* fd, uint32_t len, const nstime_t *current) {
 
     /*Hint to ignore some bytes at the start of the frame for the digest calculation(-I option) */
     uint32_t offset = ignored_bytes;
-    uint32_t new_len;
-    uint8_t *new_fd;
 
     if (len <= ignored_bytes) {
         offset = 0;
     }
 
-    new_fd  = &fd[offset];
-    new_len = len - (offset);
-
-    cur_dup_entry++;
-    if (cur_dup_entry >= dup_window)
-        cur_dup_entry = 0;
-
-    /* Calculate our digest */
-    gcry_md_hash_buffer(GCRY_MD_MD5, fd_hash[cur_dup_entry].digest, new_fd, new_len);
+    if (dup_window_add(fd, len, offset) == 0) {
+        /* No other frame in the window has this digest. */
+        fd_hash[cur_dup_entry].frame_time.secs = current->secs;
+        fd_hash[cur_dup_entry].frame_time.nsecs = current->nsecs;
+        return false;
+    }
 
-    fd_hash[cur_dup_entry].len = len;
     fd_hash[cur_dup_entry].frame_time.secs = current->secs;
     fd_hash[cur_dup_entry].frame_time.nsecs = current->nsecs;
 
@@ -731,9 +817,9 @@ is_duplicate_rel_time(uint8_t* fd, uint32_t len, const nstime_t *current) {
      * always the case!!).
      *
      * The fd_hash[] table was deliberately created large (1,000,000).
-     * Looking for time related duplicates in large trace files with
-     * non-fractional dup time window values can potentially take
-     * a long time to complete.
+     * We only get here if fd_index[] says there's another frame with
+     * the same digest somewhere in it, so most frames don't need to be
+     * checked this way at all.
      */
 
     for (i = cur_dup_entry - 1;; i--) {
@@ -1961,8 +2047,10 @@ main(int argc, char *argv[])
         for (i = 0; i < dup_window; i++) {
             memset(&fd_hash[i].digest, 0, 16);
             fd_hash[i].len = 0;
+            fd_hash[i].in_index = false;
             nstime_set_unset(&fd_hash[i].frame_time);
         }
+        fd_index_init();
     }
 
     /* Set up an array of all IDBs seen */
@@ -2613,6 +2701,7 @@ clean_exit:
         g_array_free(idbs_seen, TRUE);
     }
     g_free(params.idb_inf);
+    g_free(fd_index);
     wtap_dump_params_cleanup(&params);
     if (wth != NULL)
         wtap_close(wth);
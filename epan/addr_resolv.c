@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include <wsutil/strtoi.h>
 #include <wsutil/ws_assert.h>
@@ -107,6 +108,7 @@
 #define ENAME_VLANS     "vlans"
 #define ENAME_SS7PCS    "ss7pcs"
 #define ENAME_ENTERPRISES "enterprises"
+#define ENAME_DNS_CACHE "dns_cache"
 
 #define HASHETHSIZE      2048
 #define HASHHOSTSIZE     2048
@@ -309,6 +311,7 @@ e_addr_resolve gbl_resolv_flags = {
  */
 static unsigned name_resolve_concurrency = 500;
 static bool resolve_synchronously;
+static unsigned dns_cache_lifetime; /* hours; 0 disables the DNS cache file */
 
 /*
  *  Global variables (can be changed in GUI sections)
@@ -356,6 +359,23 @@ typedef struct _async_hostent {
 static void
 c_ares_ghba_cb(void *arg, int status, int timeouts _U_, struct hostent *he);
 
+/*
+ * Results from the external resolver, kept in the DNS cache file so that
+ * later runs need not query the same addresses again. Addresses that
+ * have no name are remembered as well, with an empty name.
+ */
+typedef struct _dns_cache_entry {
+    time_t  expires;
+    char    name[MAXNAMELEN];
+} dns_cache_entry_t;
+
+static wmem_map_t *dns_cache_ipv4;
+static wmem_map_t *dns_cache_ipv6;
+static bool dns_cache_dirty;
+
+static void
+dns_cache_record(int family, const void *addrp, const char *name);
+
 /*
  * Submitted synchronous queries trigger a callback (c_ares_ghba_sync_cb()).
  * The callback processes the response, sets completed to true if
@@ -456,6 +476,7 @@ c_ares_ghba_sync_cb(void *arg, int status, int timeouts _U_, struct hostent *he)
     char **p;
 
     if (status == ARES_SUCCESS) {
+        dns_cache_record(sdd->family, &sdd->addr, he->h_name);
         for (p = he->h_addr_list; *p != NULL; p++) {
             switch(sdd->family) {
                 case AF_INET:
@@ -470,6 +491,8 @@ c_ares_ghba_sync_cb(void *arg, int status, int timeouts _U_, struct hostent *he)
             }
         }
 
+    } else if (status == ARES_ENOTFOUND) {
+        dns_cache_record(sdd->family, &sdd->addr, NULL);
     }
 
     /*
@@ -1281,6 +1304,7 @@ c_ares_ghba_cb(void *arg, int status, int timeouts _U_, struct hostent *he) {
     async_dns_in_flight--;
 
     if (status == ARES_SUCCESS) {
+        dns_cache_record(caqm->family, &caqm->addr, he->h_name);
         for (p = he->h_addr_list; *p != NULL; p++) {
             switch(caqm->family) {
                 case AF_INET:
@@ -1294,6 +1318,8 @@ c_ares_ghba_cb(void *arg, int status, int timeouts _U_, struct hostent *he) {
                     break;
             }
         }
+    } else if (status == ARES_ENOTFOUND) {
+        dns_cache_record(caqm->family, &caqm->addr, NULL);
     }
     wmem_free(addr_resolv_scope, caqm);
 }
@@ -2657,6 +2683,193 @@ vlan_name_lookup(const unsigned id)
 } /* vlan_name_lookup */
 /* VLAN END */
 
+/*
+ * DNS cache file. Each line is "<address> <name> <expiry>", where the name
+ * is "-" for an address that has no name and the expiry is in seconds
+ * since the Epoch. Only results from the external resolver are stored;
+ * names from hosts files, name resolution blocks and dissected packets
+ * are not.
+ */
+static dns_cache_entry_t *
+dns_cache_add(int family, const void *addrp, const char *name, time_t expires)
+{
+    dns_cache_entry_t *entry;
+
+    if (family == AF_INET) {
+        uint32_t addr = *(const uint32_t *)addrp;
+        entry = (dns_cache_entry_t *)wmem_map_lookup(dns_cache_ipv4, GUINT_TO_POINTER(addr));
+        if (!entry) {
+            entry = wmem_new(addr_resolv_scope, dns_cache_entry_t);
+            wmem_map_insert(dns_cache_ipv4, GUINT_TO_POINTER(addr), entry);
+        }
+    } else {
+        entry = (dns_cache_entry_t *)wmem_map_lookup(dns_cache_ipv6, addrp);
+        if (!entry) {
+            ws_in6_addr *addr_key = wmem_new(addr_resolv_scope, ws_in6_addr);
+            memcpy(addr_key, addrp, sizeof(ws_in6_addr));
+            entry = wmem_new(addr_resolv_scope, dns_cache_entry_t);
+            wmem_map_insert(dns_cache_ipv6, addr_key, entry);
+        }
+    }
+    entry->expires = expires;
+    (void) g_strlcpy(entry->name, name ? name : "", MAXNAMELEN);
+    return entry;
+}
+
+static void
+dns_cache_record(int family, const void *addrp, const char *name)
+{
+    if (dns_cache_lifetime == 0 || !dns_cache_ipv4 ||
+            (family != AF_INET && family != AF_INET6))
+        return;
+
+    dns_cache_add(family, addrp, name, time(NULL) + (time_t)dns_cache_lifetime * 3600);
+    dns_cache_dirty = true;
+}
+
+static void
+dns_cache_read(void)
+{
+    char *path;
+    FILE *cf;
+    char line[MAX_LINELEN];
+    char *addr_str, *name, *expires_str;
+    union {
+        uint32_t ip4_addr;
+        ws_in6_addr ip6_addr;
+    } host_addr;
+    int family;
+    int64_t expires;
+    time_t now = time(NULL);
+
+    path = get_persconffile_path(ENAME_DNS_CACHE, false);
+    cf = ws_fopen(path, "r");
+    g_free(path);
+    if (cf == NULL)
+        return;
+
+    while (fgetline(line, sizeof(line), cf) >= 0) {
+        if (line[0] == '#')
+            continue;
+
+        if ((addr_str = strtok(line, " \t")) == NULL ||
+                (name = strtok(NULL, " \t")) == NULL ||
+                (expires_str = strtok(NULL, " \t")) == NULL ||
+                !ws_strtoi64(expires_str, NULL, &expires))
+            continue;
+
+        if (ws_inet_pton6(addr_str, &host_addr.ip6_addr)) {
+            family = AF_INET6;
+        } else if (ws_inet_pton4(addr_str, &host_addr.ip4_addr)) {
+            family = AF_INET;
+        } else {
+            continue;
+        }
+
+        if (expires <= now) {
+            /* Drop it from the file the next time it is written. */
+            dns_cache_dirty = true;
+            continue;
+        }
+
+        if (strcmp(name, "-") == 0)
+            name = NULL;
+        dns_cache_add(family, &host_addr, name, (time_t)expires);
+
+        if (family == AF_INET) {
+            if (name) {
+                add_ipv4_name(host_addr.ip4_addr, name, false);
+            } else {
+                hashipv4_t *tp = (hashipv4_t *)wmem_map_lookup(ipv4_hash_table, GUINT_TO_POINTER(host_addr.ip4_addr));
+                if (!tp) {
+                    tp = new_ipv4(host_addr.ip4_addr);
+                    fill_dummy_ip4(host_addr.ip4_addr, tp);
+                    wmem_map_insert(ipv4_hash_table, GUINT_TO_POINTER(host_addr.ip4_addr), tp);
+                }
+                /* Known not to resolve, don't ask again. */
+                tp->flags |= TRIED_RESOLVE_ADDRESS;
+            }
+        } else {
+            if (name) {
+                add_ipv6_name(&host_addr.ip6_addr, name, false);
+            } else {
+                hashipv6_t *tp = (hashipv6_t *)wmem_map_lookup(ipv6_hash_table, &host_addr.ip6_addr);
+                if (!tp) {
+                    ws_in6_addr *addr_key = wmem_new(addr_resolv_scope, ws_in6_addr);
+                    memcpy(addr_key, &host_addr.ip6_addr, sizeof(ws_in6_addr));
+                    tp = new_ipv6(&host_addr.ip6_addr);
+                    fill_dummy_ip6(tp);
+                    wmem_map_insert(ipv6_hash_table, addr_key, tp);
+                }
+                tp->flags |= TRIED_RESOLVE_ADDRESS;
+            }
+        }
+    }
+
+    fclose(cf);
+}
+
+static void
+dns_cache_write_ipv4(void *key, void *value, void *user_data)
+{
+    uint32_t addr = GPOINTER_TO_UINT(key);
+    dns_cache_entry_t *entry = (dns_cache_entry_t *)value;
+    char addr_str[WS_INET_ADDRSTRLEN];
+
+    ip_addr_to_str_buf(&addr, addr_str, sizeof(addr_str));
+    fprintf((FILE *)user_data, "%s %s %" PRId64 "\n", addr_str,
+            entry->name[0] ? entry->name : "-", (int64_t)entry->expires);
+}
+
+static void
+dns_cache_write_ipv6(void *key, void *value, void *user_data)
+{
+    dns_cache_entry_t *entry = (dns_cache_entry_t *)value;
+    char addr_str[WS_INET6_ADDRSTRLEN];
+
+    ip6_to_str_buf((const ws_in6_addr *)key, addr_str, sizeof(addr_str));
+    fprintf((FILE *)user_data, "%s %s %" PRId64 "\n", addr_str,
+            entry->name[0] ? entry->name : "-", (int64_t)entry->expires);
+}
+
+static void
+dns_cache_write(void)
+{
+    char *pf_dir_path;
+    char *path, *tmp_path;
+    FILE *cf;
+
+    if (!dns_cache_dirty || dns_cache_lifetime == 0 || !dns_cache_ipv4)
+        return;
+    dns_cache_dirty = false;
+
+    if (create_persconffile_dir(&pf_dir_path) == -1) {
+        g_free(pf_dir_path);
+        return;
+    }
+
+    /*
+     * Write a temporary file and rename it, so that another instance
+     * reading the cache at the same time sees either the old or the new
+     * contents.
+     */
+    path = get_persconffile_path(ENAME_DNS_CACHE, false);
+    tmp_path = ws_strdup_printf("%s.tmp", path);
+    if ((cf = ws_fopen(tmp_path, "w")) != NULL) {
+        fputs("# Wireshark DNS cache, see the \"DNS cache lifetime\" preference.\n"
+              "# <address> <name or -> <expiry time in seconds since the Epoch>\n", cf);
+        wmem_map_foreach(dns_cache_ipv4, dns_cache_write_ipv4, cf);
+        wmem_map_foreach(dns_cache_ipv6, dns_cache_write_ipv6, cf);
+        if (fclose(cf) == 0) {
+            ws_rename(tmp_path, path);
+        } else {
+            ws_unlink(tmp_path);
+        }
+    }
+    g_free(tmp_path);
+    g_free(path);
+}
+
 static bool
 read_hosts_file (const char *hostspath, bool store_entries)
 {
@@ -3275,6 +3488,16 @@ addr_resolve_pref_init(module_t *nameres)
             10,
             &name_resolve_concurrency);
 
+    prefs_register_uint_preference(nameres, "dns_cache_lifetime",
+            "DNS cache lifetime (hours)",
+            "How long names (and the lack of them) found by your"
+            " system's resolver are remembered in the \"dns_cache\""
+            " file in your personal configuration directory, so that"
+            " later runs need not look them up again. 0 disables"
+            " the cache.",
+            10,
+            &dns_cache_lifetime);
+
     prefs_register_obsolete_preference(nameres, "hosts_file_handling");
 
     prefs_register_bool_preference(nameres, "vlan_name",
@@ -3497,6 +3720,18 @@ host_name_lookup_init(void)
     ws_assert(async_dns_queue_head == NULL);
     async_dns_queue_head = wmem_list_new(addr_resolv_scope);
 
+    /*
+     * Load the results of earlier external lookups first, so that the
+     * hosts files below take precedence. They're used like a hosts
+     * file even if external lookups are off for this session.
+     */
+    dns_cache_dirty = false;
+    if (dns_cache_lifetime > 0 && gbl_resolv_flags.network_name) {
+        dns_cache_ipv4 = wmem_map_new(addr_resolv_scope, g_direct_hash, g_direct_equal);
+        dns_cache_ipv6 = wmem_map_new(addr_resolv_scope, ipv6_oat_hash, ipv6_equal);
+        dns_cache_read();
+    }
+
     /*
      * The manually resolved lists are the only address resolution maps
      * that are not reset by addr_resolv_cleanup(), because they are
@@ -3559,6 +3794,10 @@ host_name_lookup_cleanup(void)
 
     _host_name_lookup_cleanup();
 
+    dns_cache_write();
+    dns_cache_ipv4 = NULL;
+    dns_cache_ipv6 = NULL;
+
     ipxnet_hash_table = NULL;
     ipv4_hash_table = NULL;
     ipv6_hash_table = NULL;
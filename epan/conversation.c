@@ -122,6 +122,18 @@ static wmem_map_t *conversation_hashtable_exact_addr;
  */
 static wmem_map_t *conversation_hashtable_exact_addr_port;
 
+/*
+ * Hash table for conversations with no wildcards between two IPv4 or two
+ * IPv6 addresses. These are by far the most common conversations (every
+ * TCP and UDP flow has one), so instead of element lists they are keyed
+ * by conversation_ip_key_t, which packs the addresses and ports into a
+ * fixed-width structure with a precomputed hash. Lookups then don't have
+ * to walk an element list, dereference address data or compare types.
+ * Conversations that would go into conversation_hashtable_exact_addr_port
+ * are transparently redirected here, see conversation_route_hashtable.
+ */
+static wmem_map_t *conversation_hashtable_exact_ip_port;
+
 /*
  * Hash table for conversations with one wildcard address.
  */
@@ -164,6 +176,21 @@ static uint32_t new_index;
  */
 static address null_address_ = ADDRESS_INIT_NONE;
 
+/*
+ * Key for conversation_hashtable_exact_ip_port. Keys are zeroed before
+ * being filled in, so unused address bytes (IPv4) and padding compare
+ * equal and the whole structure can be compared with memcmp.
+ */
+typedef struct {
+    uint32_t hash;              /* precomputed, compared first */
+    uint32_t ctype;             /* conversation_type */
+    uint32_t port1;
+    uint32_t port2;
+    uint32_t addr_type;         /* AT_IPv4 or AT_IPv6 */
+    uint8_t  addr1[16];
+    uint8_t  addr2[16];
+} conversation_ip_key_t;
+
 
 /* Element count including the terminating CE_CONVERSATION_TYPE */
 #define MAX_CONVERSATION_ELEMENTS 8 // Arbitrary.
@@ -531,6 +558,101 @@ conversation_match_element_list(const void *v1, const void *v2)
     return TRUE;
 }
 
+static inline uint64_t
+conversation_ip_key_mix(uint64_t hash_val, uint32_t word)
+{
+    hash_val = (hash_val ^ word) * UINT64_C(0x9E3779B97F4A7C15);
+    return hash_val ^ (hash_val >> 32);
+}
+
+/*
+ * Fill in a conversation_ip_key_t for {addr1, port1, addr2, port2, ctype}.
+ * Returns false if the addresses aren't both IPv4 or both IPv6, in which
+ * case the conversation has to be looked up by its element list.
+ */
+static bool
+conversation_ip_key_init(conversation_ip_key_t *key, const address *addr1, const uint32_t port1,
+                         const address *addr2, const uint32_t port2, const conversation_type ctype)
+{
+    uint64_t hash_val;
+    uint32_t word;
+    int addr_len;
+
+    if (addr1->type != addr2->type || addr1->len != addr2->len) {
+        return false;
+    }
+    switch (addr1->type) {
+    case AT_IPv4:
+        addr_len = 4;
+        break;
+    case AT_IPv6:
+        addr_len = 16;
+        break;
+    default:
+        return false;
+    }
+    if (addr1->len != addr_len) {
+        return false;
+    }
+
+    memset(key, 0, sizeof(*key));
+    key->ctype = ctype;
+    key->port1 = port1;
+    key->port2 = port2;
+    key->addr_type = addr1->type;
+    memcpy(key->addr1, addr1->data, addr_len);
+    memcpy(key->addr2, addr2->data, addr_len);
+
+    hash_val = conversation_ip_key_mix(key->addr_type, key->ctype);
+    hash_val = conversation_ip_key_mix(hash_val, port1 << 16 | port2);
+    for (int i = 0; i < addr_len; i += 4) {
+        memcpy(&word, &key->addr1[i], sizeof(word));
+        hash_val = conversation_ip_key_mix(hash_val, word);
+        memcpy(&word, &key->addr2[i], sizeof(word));
+        hash_val = conversation_ip_key_mix(hash_val, word);
+    }
+    key->hash = (uint32_t)hash_val;
+
+    return true;
+}
+
+static unsigned
+conversation_hash_ip_key(const void *v)
+{
+    return ((const conversation_ip_key_t *)v)->hash;
+}
+
+static gboolean
+conversation_match_ip_key(const void *v1, const void *v2)
+{
+    return memcmp(v1, v2, sizeof(conversation_ip_key_t)) == 0;
+}
+
+/*
+ * Exact address+port keys between IP hosts are stored in
+ * conversation_hashtable_exact_ip_port instead of
+ * conversation_hashtable_exact_addr_port. Given the table a key belongs
+ * to, return the table that actually holds it and set *map_key to the key
+ * to use for it (either elements, or ip_key filled in from elements).
+ */
+static wmem_map_t *
+conversation_route_hashtable(wmem_map_t *hashtable, const conversation_element_t *elements,
+                             conversation_ip_key_t *ip_key, const void **map_key)
+{
+    *map_key = elements;
+
+    /* Every key in this table has the {addr1, port1, addr2, port2, ctype} layout. */
+    if (hashtable == conversation_hashtable_exact_addr_port &&
+            conversation_ip_key_init(ip_key, &elements[ADDR1_IDX].addr_val, elements[PORT1_IDX].port_val,
+                                     &elements[ADDR2_IDX].addr_val, elements[PORT2_IDX].port_val,
+                                     elements[ENDP_EXACT_IDX].conversation_type_val)) {
+        *map_key = ip_key;
+        return conversation_hashtable_exact_ip_port;
+    }
+
+    return hashtable;
+}
+
 /**
  * Create a new hash tables for conversations.
  */
@@ -561,6 +683,15 @@ conversation_init(void)
     wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), exact_map_key),
                     conversation_hashtable_exact_addr_port);
 
+    // Registered so that get_conversation_hashtables() shows it, but
+    // no element list maps to this name.
+    char *exact_ip_map_key = wmem_strdup_printf(wmem_epan_scope(), "%s (IP)", exact_map_key);
+    conversation_hashtable_exact_ip_port = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
+                                                                  conversation_hash_ip_key,
+                                                                  conversation_match_ip_key);
+    wmem_map_insert(conversation_hashtable_element_list, exact_ip_map_key,
+                    conversation_hashtable_exact_ip_port);
+
     conversation_element_t addrs_elements[ADDRS_IDX_COUNT] = {
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
         { CE_ADDRESS, .addr_val = ADDRESS_INIT_NONE },
@@ -712,15 +843,21 @@ static void
 conversation_insert_into_hashtable(wmem_map_t *hashtable, conversation_t *conv)
 {
     conversation_t *chain_head, *chain_tail, *cur, *prev;
+    conversation_ip_key_t ip_key;
+    const void *map_key;
 
-    chain_head = (conversation_t *)wmem_map_lookup(hashtable, conv->key_ptr);
+    hashtable = conversation_route_hashtable(hashtable, conv->key_ptr, &ip_key, &map_key);
+    chain_head = (conversation_t *)wmem_map_lookup(hashtable, map_key);
 
     if (NULL==chain_head) {
         /* New entry */
         conv->next = NULL;
         conv->last = conv;
 
-        wmem_map_insert(hashtable, conv->key_ptr, conv);
+        if (map_key == &ip_key) {
+            map_key = wmem_memdup(wmem_file_scope(), &ip_key, sizeof(ip_key));
+        }
+        wmem_map_insert(hashtable, map_key, conv);
         DPRINT(("created a new conversation chain"));
     }
     else {
@@ -749,7 +886,7 @@ conversation_insert_into_hashtable(wmem_map_t *hashtable, conversation_t *conv)
                 conv->next = chain_head;
                 conv->last = chain_tail;
                 chain_head->last = NULL;
-                wmem_map_insert(hashtable, conv->key_ptr, conv);
+                wmem_map_insert(hashtable, map_key, conv);
             }
             else {
                 /* Inserting into the middle of the chain */
@@ -769,8 +906,11 @@ static void
 conversation_remove_from_hashtable(wmem_map_t *hashtable, conversation_t *conv)
 {
     conversation_t *chain_head, *cur, *prev;
+    conversation_ip_key_t ip_key;
+    const void *map_key;
 
-    chain_head = (conversation_t *)wmem_map_lookup(hashtable, conv->key_ptr);
+    hashtable = conversation_route_hashtable(hashtable, conv->key_ptr, &ip_key, &map_key);
+    chain_head = (conversation_t *)wmem_map_lookup(hashtable, map_key);
 
     if (conv == chain_head) {
         /* We are currently the front of the chain */
@@ -779,7 +919,7 @@ conversation_remove_from_hashtable(wmem_map_t *hashtable, conversation_t *conv)
              * update next pointer, but do not call
              * wmem_map_remove() either because the conv data
              * will be re-inserted. */
-            wmem_map_steal(hashtable, conv->key_ptr);
+            wmem_map_steal(hashtable, map_key);
         }
         else {
             /* Update the head of the chain */
@@ -791,7 +931,7 @@ conversation_remove_from_hashtable(wmem_map_t *hashtable, conversation_t *conv)
             else
                 chain_head->latest_found = conv->latest_found;
 
-            wmem_map_insert(hashtable, chain_head->key_ptr, chain_head);
+            wmem_map_insert(hashtable, map_key, chain_head);
         }
     }
     else {
@@ -1324,12 +1464,14 @@ conversation_set_addr2(conversation_t *conv, const address *addr)
     DENDENT();
 }
 
-static conversation_t *conversation_lookup_hashtable(wmem_map_t *conversation_hashtable, const uint32_t frame_num, conversation_element_t *conv_key)
+/*
+ * Find the conversation in a hash chain that was set up most recently
+ * at or before frame_num.
+ */
+static conversation_t *conversation_lookup_chain(conversation_t *chain_head, const uint32_t frame_num)
 {
     conversation_t* convo = NULL;
     conversation_t* match = NULL;
-    conversation_t* chain_head = NULL;
-    chain_head = (conversation_t *)wmem_map_lookup(conversation_hashtable, conv_key);
 
     if (chain_head && (chain_head->setup_frame <= frame_num)) {
         match = chain_head;
@@ -1354,6 +1496,15 @@ static conversation_t *conversation_lookup_hashtable(wmem_map_t *conversation_ha
     return match;
 }
 
+static conversation_t *conversation_lookup_hashtable(wmem_map_t *conversation_hashtable, const uint32_t frame_num, conversation_element_t *conv_key)
+{
+    conversation_ip_key_t ip_key;
+    const void *map_key;
+
+    conversation_hashtable = conversation_route_hashtable(conversation_hashtable, conv_key, &ip_key, &map_key);
+    return conversation_lookup_chain((conversation_t *)wmem_map_lookup(conversation_hashtable, map_key), frame_num);
+}
+
 conversation_t *find_conversation_full(const uint32_t frame_num, conversation_element_t *elements)
 {
     char *el_list_map_key = conversation_element_list_name(NULL, elements);
@@ -1374,6 +1525,12 @@ static conversation_t *
 conversation_lookup_exact(const uint32_t frame_num, const address *addr1, const uint32_t port1,
                           const address *addr2, const uint32_t port2, const conversation_type ctype)
 {
+    conversation_ip_key_t ip_key;
+
+    if (conversation_ip_key_init(&ip_key, addr1, port1, addr2, port2, ctype)) {
+        return conversation_lookup_chain((conversation_t *)wmem_map_lookup(conversation_hashtable_exact_ip_port, &ip_key), frame_num);
+    }
+
     conversation_element_t key[EXACT_IDX_COUNT] = {
         { CE_ADDRESS, .addr_val = *addr1 },
         { CE_PORT, .port_val = port1 },
@@ -2664,6 +2664,7 @@ Dot11DecryptRsnaPwd2PskStep(
     unsigned char *output)
 {
     unsigned char digest[MAX_SSID_LENGTH+4] = { 0 };  /* SSID plus 4 bytes of count */
+    gcry_md_hd_t hmac_handle;
     int i, j;
 
     if (ssidLength > MAX_SSID_LENGTH) {
@@ -2683,37 +2684,100 @@ Dot11DecryptRsnaPwd2PskStep(
 
     /* output = U1 */
     memcpy(output, digest, 20);
+
+    /* The key is the same for every iteration, so set it once and just
+     * reset the HMAC state (which keeps the key) between iterations,
+     * rather than opening and keying a new handle 4096 times. */
+    if (gcry_md_open(&hmac_handle, GCRY_MD_SHA1, GCRY_MD_FLAG_HMAC)) {
+        return DOT11DECRYPT_RET_UNSUCCESS;
+    }
+    if (gcry_md_setkey(hmac_handle, ppBytes, ppLength)) {
+        gcry_md_close(hmac_handle);
+        return DOT11DECRYPT_RET_UNSUCCESS;
+    }
     for (i = 1; i < iterations; i++) {
         /* Un = PRF(P, Un-1) */
-        if (ws_hmac_buffer(GCRY_MD_SHA1, digest, digest, HASH_SHA1_LENGTH, ppBytes, ppLength)) {
-          return DOT11DECRYPT_RET_UNSUCCESS;
-        }
+        gcry_md_reset(hmac_handle);
+        gcry_md_write(hmac_handle, digest, HASH_SHA1_LENGTH);
+        memcpy(digest, gcry_md_read(hmac_handle, GCRY_MD_SHA1), HASH_SHA1_LENGTH);
 
         /* output = output xor Un */
         for (j = 0; j < 20; j++) {
             output[j] ^= digest[j];
         }
     }
+    gcry_md_close(hmac_handle);
 
     return DOT11DECRYPT_RET_SUCCESS;
 }
 
+/*
+ * Passphrase-to-PSK results, keyed by SSID and passphrase. Deriving a PSK
+ * takes 8192 HMAC-SHA1 operations, and the same derivation is needed for
+ * every key setup, every EAPOL handshake tried with a wildcard SSID key,
+ * and again after every reload or profile change, so keep the results for
+ * the lifetime of the process. The PSK depends only on the SSID and the
+ * passphrase, so this is safe to share between contexts.
+ */
+#define DOT11DECRYPT_PSK_CACHE_MAX 4096
+
+static GHashTable *psk_cache;
+
+static GBytes *
+Dot11DecryptPskCacheKey(const struct DOT11DECRYPT_KEY_ITEMDATA_PWD *userPwd)
+{
+    GByteArray *key_ba = g_byte_array_new();
+    uint8_t ssid_len = (uint8_t)userPwd->SsidLen;
+
+    /* The SSID length keeps ("ab", "cdefghij") and ("abc", "defghij") apart. */
+    g_byte_array_append(key_ba, &ssid_len, 1);
+    g_byte_array_append(key_ba, (const uint8_t *)userPwd->Ssid, (unsigned)userPwd->SsidLen);
+    g_byte_array_append(key_ba, (const uint8_t *)userPwd->Passphrase, (unsigned)userPwd->PassphraseLen);
+    return g_byte_array_free_to_bytes(key_ba);
+}
+
 static int
 Dot11DecryptRsnaPwd2Psk(
     const struct DOT11DECRYPT_KEY_ITEMDATA_PWD *userPwd,
     unsigned char *output)
 {
     unsigned char m_output[40] = { 0 };
-    GByteArray *pp_ba = g_byte_array_new();
+    GByteArray *pp_ba;
+    GBytes *cache_key;
+    const unsigned char *cached;
+    bool derived;
+
+    if (psk_cache == NULL) {
+        psk_cache = g_hash_table_new_full(g_bytes_hash, g_bytes_equal,
+                                          (GDestroyNotify)g_bytes_unref, g_free);
+    }
+    cache_key = Dot11DecryptPskCacheKey(userPwd);
+    cached = (const unsigned char *)g_hash_table_lookup(psk_cache, cache_key);
+    if (cached != NULL) {
+        memcpy(output, cached, DOT11DECRYPT_WPA_PWD_PSK_LEN);
+        g_bytes_unref(cache_key);
+        return 0;
+    }
 
+    pp_ba = g_byte_array_new();
     g_byte_array_append(pp_ba, userPwd->Passphrase, (unsigned)userPwd->PassphraseLen);
 
-    Dot11DecryptRsnaPwd2PskStep(pp_ba->data, pp_ba->len, userPwd->Ssid, userPwd->SsidLen, 4096, 1, m_output);
-    Dot11DecryptRsnaPwd2PskStep(pp_ba->data, pp_ba->len, userPwd->Ssid, userPwd->SsidLen, 4096, 2, &m_output[20]);
+    derived = Dot11DecryptRsnaPwd2PskStep(pp_ba->data, pp_ba->len, userPwd->Ssid, userPwd->SsidLen, 4096, 1, m_output) == DOT11DECRYPT_RET_SUCCESS;
+    derived = Dot11DecryptRsnaPwd2PskStep(pp_ba->data, pp_ba->len, userPwd->Ssid, userPwd->SsidLen, 4096, 2, &m_output[20]) == DOT11DECRYPT_RET_SUCCESS && derived;
 
     memcpy(output, m_output, DOT11DECRYPT_WPA_PWD_PSK_LEN);
     g_byte_array_free(pp_ba, true);
 
+    if (!derived) {
+        g_bytes_unref(cache_key);
+        return 0;
+    }
+
+    if (g_hash_table_size(psk_cache) >= DOT11DECRYPT_PSK_CACHE_MAX) {
+        g_hash_table_remove_all(psk_cache);
+    }
+    g_hash_table_insert(psk_cache, cache_key, g_memdup2(m_output, DOT11DECRYPT_WPA_PWD_PSK_LEN));
+
     return 0;
 }
 
@@ -72,6 +72,7 @@ dfvm_opcode_tostr(dfvm_opcode_t code)
 		case DFVM_STACK_POP:		return "STACK_POP";
 		case DFVM_NOT_ALL_ZERO:		return "NOT_ALL_ZERO";
 		case DFVM_NO_OP:		return "NO_OP";
+		case DFVM_TEST_TREE:		return "TEST_TREE";
 	}
 	return "(fix-opcode-string)";
 }
@@ -283,6 +284,31 @@ dfvm_value_tostr(dfvm_value_t *v)
 	return s;
 }
 
+/* Operator used when dumping a relation fused into DFVM_TEST_TREE. */
+static const char *
+relation_tostr(dfvm_opcode_t op)
+{
+	switch (op) {
+		case DFVM_ALL_EQ:		return "===";
+		case DFVM_ANY_EQ:		return "==";
+		case DFVM_ALL_NE:		return "!=";
+		case DFVM_ANY_NE:		return "!==";
+		case DFVM_ALL_GT:
+		case DFVM_ANY_GT:		return ">";
+		case DFVM_ALL_GE:
+		case DFVM_ANY_GE:		return ">=";
+		case DFVM_ALL_LT:
+		case DFVM_ANY_LT:		return "<";
+		case DFVM_ALL_LE:
+		case DFVM_ANY_LE:		return "<=";
+		case DFVM_ALL_CONTAINS:
+		case DFVM_ANY_CONTAINS:		return "contains";
+		default:
+			break;
+	}
+	return "(fix-relation-string)";
+}
+
 static char *
 value_type_tostr(dfvm_value_t *v, bool show_ftype)
 {
@@ -558,6 +584,13 @@ append_op_args(wmem_strbuf_t *buf, dfvm_insn_t *insn, GSList **stack_print,
 			wmem_strbuf_append_printf(buf, "%s%s", arg1_str, arg1_str_type);
 			break;
 
+		case DFVM_TEST_TREE:
+			wmem_strbuf_append_printf(buf, "%s%s %s %s%s",
+						arg1_str, arg1_str_type,
+						relation_tostr(arg3->value.numeric),
+						arg2_str, arg2_str_type);
+			break;
+
 		case DFVM_SET_ADD_RANGE:
 			wmem_strbuf_append_printf(buf, "%s%s .. %s%s",
 						arg1_str, arg1_str_type, arg2_str, arg2_str_type);
@@ -1111,6 +1144,65 @@ all_test(dfilter_t *df, DFVMCompareFunc cmp,
 	return cmp_test(df, cmp, arg1, arg2, MATCH_ALL);
 }
 
+/* Compares the values of a field in the tree with a constant, without
+ * loading them into a register first. arg3 is the opcode of the original
+ * relation. This is the common "field <op> constant" case (e.g.
+ * "tcp.port == 443"), see fuse_field_tests() in gencode.c. */
+static bool
+test_tree(proto_tree *tree, dfvm_value_t *arg1, dfvm_value_t *arg2,
+				dfvm_value_t *arg3)
+{
+	header_field_info *hfinfo = arg1->value.hfinfo;
+	const fvalue_t	*fv2 = dfvm_value_get_fvalue(arg2);
+	DFVMCompareFunc	cmp;
+	enum match_how	how;
+	GPtrArray	*finfos;
+	field_info	*finfo;
+	ft_bool_t	have_match;
+	bool		found = false;
+
+	switch (arg3->value.numeric) {
+		case DFVM_ALL_EQ:	how = MATCH_ALL; cmp = fvalue_eq; break;
+		case DFVM_ANY_EQ:	how = MATCH_ANY; cmp = fvalue_eq; break;
+		case DFVM_ALL_NE:	how = MATCH_ALL; cmp = fvalue_ne; break;
+		case DFVM_ANY_NE:	how = MATCH_ANY; cmp = fvalue_ne; break;
+		case DFVM_ALL_GT:	how = MATCH_ALL; cmp = fvalue_gt; break;
+		case DFVM_ANY_GT:	how = MATCH_ANY; cmp = fvalue_gt; break;
+		case DFVM_ALL_GE:	how = MATCH_ALL; cmp = fvalue_ge; break;
+		case DFVM_ANY_GE:	how = MATCH_ANY; cmp = fvalue_ge; break;
+		case DFVM_ALL_LT:	how = MATCH_ALL; cmp = fvalue_lt; break;
+		case DFVM_ANY_LT:	how = MATCH_ANY; cmp = fvalue_lt; break;
+		case DFVM_ALL_LE:	how = MATCH_ALL; cmp = fvalue_le; break;
+		case DFVM_ANY_LE:	how = MATCH_ANY; cmp = fvalue_le; break;
+		case DFVM_ALL_CONTAINS:	how = MATCH_ALL; cmp = fvalue_contains; break;
+		case DFVM_ANY_CONTAINS:	how = MATCH_ANY; cmp = fvalue_contains; break;
+		default:
+			ASSERT_DFVM_OP_NOT_REACHED(arg3->value.numeric);
+	}
+
+	while (hfinfo) {
+		/* The caller should NOT free the GPtrArray. */
+		finfos = proto_get_finfo_ptr_array(tree, hfinfo->id);
+		if (finfos != NULL) {
+			for (unsigned i = 0; i < finfos->len; i++) {
+				finfo = finfos->pdata[i];
+				found = true;
+				have_match = cmp(finfo->value, fv2);
+				if (how == MATCH_ALL && have_match == FT_FALSE) {
+					return false;
+				}
+				else if (how == MATCH_ANY && have_match == FT_TRUE) {
+					return true;
+				}
+			}
+		}
+		hfinfo = hfinfo->same_name_next;
+	}
+
+	/* As with READ_TREE, a field that is not present is false. */
+	return how == MATCH_ALL && found;
+}
+
 static bool
 any_matches(dfilter_t *df, dfvm_value_t *arg1, dfvm_value_t *arg2)
 {
@@ -1688,6 +1780,10 @@ dfvm_apply_full(dfilter_t *df, proto_tree *tree, GPtrArray **fvals)
 				accum = read_tree(df, tree, arg1, arg2, arg3);
 				break;
 
+			case DFVM_TEST_TREE:
+				accum = test_tree(tree, arg1, arg2, arg3);
+				break;
+
 			case DFVM_READ_REFERENCE:
 				accum = read_reference(df, arg1, arg2, NULL);
 				break;
@@ -100,6 +100,7 @@ typedef enum {
 	DFVM_STACK_POP,
 	DFVM_NOT_ALL_ZERO,
 	DFVM_NO_OP,
+	DFVM_TEST_TREE,		/* READ_TREE fused with a comparison to a constant */
 } dfvm_opcode_t;
 
 const char *
@@ -918,6 +918,111 @@ optimize(dfwork_t *dfw)
 	}
 }
 
+static bool
+value_is_register(dfvm_value_t *v, uint32_t reg)
+{
+	return v != NULL && v->type == REGISTER && v->value.numeric == reg;
+}
+
+/* Returns true if any instruction other than the pair at id1/id2
+ * uses the register. */
+static bool
+register_is_shared(dfwork_t *dfw, uint32_t reg, int id1, int id2)
+{
+	dfvm_insn_t	*insn;
+
+	for (int id = 0; id < (int)dfw->insns->len; id++) {
+		if (id == id1 || id == id2)
+			continue;
+		insn = g_ptr_array_index(dfw->insns, id);
+		if (value_is_register(insn->arg1, reg) ||
+				value_is_register(insn->arg2, reg) ||
+				value_is_register(insn->arg3, reg))
+			return true;
+	}
+	return false;
+}
+
+static bool
+is_jump_target(dfwork_t *dfw, int target)
+{
+	dfvm_insn_t	*insn;
+
+	for (unsigned id = 0; id < dfw->insns->len; id++) {
+		insn = g_ptr_array_index(dfw->insns, id);
+		if ((insn->op == DFVM_IF_TRUE_GOTO || insn->op == DFVM_IF_FALSE_GOTO) &&
+				insn->arg1->value.numeric == (uint32_t)target)
+			return true;
+	}
+	return false;
+}
+
+/* Replaces the sequence
+ *
+ *	READ_TREE	field -> R
+ *	IF_FALSE_GOTO	X
+ *	ANY_EQ		R == constant
+ *
+ * with a single TEST_TREE instruction that compares the field values in
+ * the tree with the constant directly. This saves filling (and clearing)
+ * a register for every packet in the most common kind of filter. The
+ * branch is kept and the comparison replaced with a no-op so that no jump
+ * targets need to be renumbered. */
+static void
+fuse_field_tests(dfwork_t *dfw)
+{
+	dfvm_insn_t	*read, *branch, *test;
+	uint32_t	reg;
+
+	for (int id = 0; id + 2 < (int)dfw->insns->len; id++) {
+		read = g_ptr_array_index(dfw->insns, id);
+		branch = g_ptr_array_index(dfw->insns, id + 1);
+		test = g_ptr_array_index(dfw->insns, id + 2);
+
+		if (read->op != DFVM_READ_TREE || read->arg1->type != HFINFO)
+			continue;
+		if (branch->op != DFVM_IF_FALSE_GOTO)
+			continue;
+
+		switch (test->op) {
+			case DFVM_ALL_EQ:
+			case DFVM_ANY_EQ:
+			case DFVM_ALL_NE:
+			case DFVM_ANY_NE:
+			case DFVM_ALL_GT:
+			case DFVM_ANY_GT:
+			case DFVM_ALL_GE:
+			case DFVM_ANY_GE:
+			case DFVM_ALL_LT:
+			case DFVM_ANY_LT:
+			case DFVM_ALL_LE:
+			case DFVM_ANY_LE:
+			case DFVM_ALL_CONTAINS:
+			case DFVM_ANY_CONTAINS:
+				break;
+			default:
+				continue;
+		}
+
+		reg = read->arg2->value.numeric;
+		if (!value_is_register(test->arg1, reg) || test->arg2->type != FVALUE)
+			continue;
+		/* The register must not be reused by another test, nor returned
+		 * to the caller (DF_RETURN_VALUES). */
+		if (register_is_shared(dfw, reg, id, id + 2))
+			continue;
+		if (is_jump_target(dfw, id + 1) || is_jump_target(dfw, id + 2))
+			continue;
+
+		/* READ_TREE field, R becomes TEST_TREE field, constant, op. */
+		dfvm_value_unref(read->arg2);
+		read->arg2 = dfvm_value_ref(test->arg2);
+		read->arg3 = dfvm_value_ref(dfvm_value_new_uint(test->op));
+		read->op = DFVM_TEST_TREE;
+		dfvm_insn_replace_no_op(test);
+	}
+}
+
 void
 dfw_gencode(dfwork_t *dfw)
 {
@@ -930,6 +1035,7 @@ dfw_gencode(dfwork_t *dfw)
 	dfw_append_insn(dfw, insn);
 	if (dfw->flags & DF_OPTIMIZE) {
 		optimize(dfw);
+		fuse_field_tests(dfw);
 	}
 }
 
@@ -1007,8 +1007,10 @@ dissect_frame(tvbuff_t *tvb, packet_info *pinfo, proto_tree *parent_tree, void*
 								  " the valid range is 0-1000000000",
 								  (long) pinfo->abs_ts.nsecs);
 			}
+			nstime_t shift_offset;
+			epan_get_shift_offset(pinfo->epan, pinfo->fd, &shift_offset);
 			item = proto_tree_add_time(fh_tree, hf_frame_shift_offset, tvb,
-					    0, 0, &(pinfo->fd->shift_offset));
+					    0, 0, &shift_offset);
 			proto_item_set_generated(item);
 
 			if (proto_field_is_referenced(tree, hf_frame_time_delta)) {
@@ -1784,6 +1784,8 @@ init_tcp_conversation_data(packet_info *pinfo, int direction)
     if (tcp_reassemble_out_of_order) {
         tcpd->flow1.ooo_segments=wmem_list_new(wmem_file_scope());
         tcpd->flow2.ooo_segments=wmem_list_new(wmem_file_scope());
+        tcpd->flow1.ooo_frames=wmem_map_new(wmem_file_scope(), g_direct_hash, g_direct_equal);
+        tcpd->flow2.ooo_frames=wmem_map_new(wmem_file_scope(), g_direct_hash, g_direct_equal);
     }
 
     /* Only allocate the data if its actually going to be analyzed */
@@ -4123,6 +4125,7 @@ msp_add_out_of_order(packet_info *pinfo, struct tcp_multisegment_pdu *msp, struc
         }
         updated_maxnextseq = false;
         tvb_free(tvb_data);
+        wmem_map_remove(tcpd->fwd->ooo_frames, GUINT_TO_POINTER(fd->frame));
         wmem_list_remove_frame(tcpd->fwd->ooo_segments, curr_entry);
         curr_entry = wmem_list_head(tcpd->fwd->ooo_segments);
 
@@ -4483,11 +4486,8 @@ again:
              * we want to be consistent between passes.
              */
             ooo_segment_item *fd;
-            fd = wmem_new0(pinfo->pool, ooo_segment_item);
-            fd->frame = pinfo->num;
-            fd->seq = seq;
-            fd->len = nxtseq - seq;
-            if (wmem_list_find_custom(tcpd->fwd->ooo_segments, fd, compare_ooo_segment_item)) {
+            fd = (ooo_segment_item *)wmem_map_lookup(tcpd->fwd->ooo_frames, GUINT_TO_POINTER(pinfo->num));
+            if (fd && fd->seq == seq) {
                 has_gap = true;
             }
         }
@@ -4605,6 +4605,7 @@ again:
              * which means that these bytes exist. */
             fd->data = tvb_memdup(wmem_file_scope(), tvb, offset, fd->len);
             wmem_list_append_sorted(tcpd->fwd->ooo_segments, fd, compare_ooo_segment_item);
+            wmem_map_insert(tcpd->fwd->ooo_frames, GUINT_TO_POINTER(fd->frame), fd);
         }
         ipfd_head = NULL;
     } else {
@@ -385,6 +385,9 @@ typedef struct _tcp_flow_t {
 
 	/* A sorted list of pending out-of-order segments. */
 	wmem_list_t *ooo_segments;
+	/* The same segments, indexed by frame number, for looking them up
+	 * on later passes without walking the list. */
+	wmem_map_t *ooo_frames;
 
 	/* Process info, currently discovered via IPFIX */
 	tcp_process_info_t* process_info;
@@ -6167,6 +6167,40 @@ ssl_get_record_info(tvbuff_t *parent_tvb, int proto, packet_info *pinfo, int rec
 }
 /* Links SSL records with the real packet data. }}} */
 
+/*
+ * Secrets read from the keylog file. Parsing a large keylog (matching the
+ * regex and decoding the hex of every line) is slow, and the master key
+ * maps are emptied whenever a capture file is closed, so the file used to
+ * be read again in full for every capture file opened. Instead, keep the
+ * parsed secrets, allocated outside of any wmem scope, for as long as the
+ * keylog file stays the same, and only put them back into the maps when
+ * they are recreated; only lines appended since are parsed.
+ */
+typedef struct tls_keylog_entry {
+    unsigned    group;      /* index into the match groups */
+    StringInfo  key;
+    StringInfo  secret;
+    /* followed by the key and secret data */
+} tls_keylog_entry_t;
+
+static struct {
+    char       *filename;   /* keylog file the entries were read from */
+    GPtrArray  *entries;    /* tls_keylog_entry_t, in file order */
+    bool        replayed;   /* entries are in the current master key maps */
+    GPtrArray  *stale;      /* cleared entries, which the current maps may still refer to */
+} tls_keylog_cache;
+
+/* Free the entries dropped by tls_keylog_cache_clear(), once the master key
+ * maps that referred to them are gone. */
+static void
+tls_keylog_cache_free_stale(void)
+{
+    if (tls_keylog_cache.stale) {
+        g_ptr_array_free(tls_keylog_cache.stale, true);
+        tls_keylog_cache.stale = NULL;
+    }
+}
+
 /* initialize/reset per capture state data (ssl sessions cache). {{{ */
 void
 ssl_common_init(ssl_master_key_map_t *mk_map,
@@ -6192,7 +6226,7 @@ ssl_common_init(ssl_master_key_map_t *mk_map,
 }
 
 void
-ssl_common_cleanup(ssl_master_key_map_t *mk_map, FILE **ssl_keylog_file,
+ssl_common_cleanup(ssl_master_key_map_t *mk_map, FILE **ssl_keylog_file _U_,
                    StringInfo *decrypted_data, StringInfo *compressed_data)
 {
     g_hash_table_destroy(mk_map->session);
@@ -6213,12 +6247,11 @@ ssl_common_cleanup(ssl_master_key_map_t *mk_map, FILE **ssl_keylog_file,
     g_free(decrypted_data->data);
     g_free(compressed_data->data);
 
-    /* close the previous keylog file now that the cache are cleared, this
-     * allows the cache to be filled with the full keylog file contents. */
-    if (*ssl_keylog_file) {
-        fclose(*ssl_keylog_file);
-        *ssl_keylog_file = NULL;
-    }
+    /* The keylog file stays open: the secrets read from it so far are kept
+     * in the keylog cache and put back into the new maps by the next
+     * ssl_load_keyfile(), which then continues reading where it stopped. */
+    tls_keylog_cache.replayed = false;
+    tls_keylog_cache_free_stale();
 }
 /* }}} */
 
@@ -6682,10 +6715,12 @@ typedef struct ssl_master_key_match_group {
     GHashTable *master_key_ht;
 } ssl_master_key_match_group_t;
 
-void
-tls_keylog_process_lines(const ssl_master_key_map_t *mk_map, const uint8_t *data, unsigned datalen)
+#define TLS_KEYLOG_GROUP_COUNT 11
+
+static void
+tls_keylog_match_groups(const ssl_master_key_map_t *mk_map, ssl_master_key_match_group_t *mk_groups)
 {
-    ssl_master_key_match_group_t mk_groups[] = {
+    const ssl_master_key_match_group_t groups[TLS_KEYLOG_GROUP_COUNT] = {
         { "encrypted_pmk",  mk_map->pre_master },
         { "session_id",     mk_map->session },
         { "client_random",  mk_map->crandom },
@@ -6700,6 +6735,86 @@ tls_keylog_process_lines(const ssl_master_key_map_t *mk_map, const uint8_t *data
         { "exporter",           mk_map->tls13_exporter },
     };
 
+    memcpy(mk_groups, groups, sizeof(groups));
+}
+
+static tls_keylog_entry_t *
+tls_keylog_cache_add(unsigned group, const char *hex_key, const char *hex_secret)
+{
+    size_t key_len = strlen(hex_key) / 2;
+    size_t secret_len = strlen(hex_secret) / 2;
+    tls_keylog_entry_t *entry = (tls_keylog_entry_t *)g_malloc(sizeof(tls_keylog_entry_t) + key_len + secret_len);
+    uint8_t *data = (uint8_t *)(entry + 1);
+
+    /* The regex only matches an even number of hex digits. */
+    entry->group = group;
+    entry->key.data = data;
+    entry->key.data_len = (unsigned)key_len;
+    for (size_t i = 0; i < key_len; i++) {
+        data[i] = ws_xton(hex_key[i*2]) << 4 | ws_xton(hex_key[i*2 + 1]);
+    }
+    data += key_len;
+    entry->secret.data = data;
+    entry->secret.data_len = (unsigned)secret_len;
+    for (size_t i = 0; i < secret_len; i++) {
+        data[i] = ws_xton(hex_secret[i*2]) << 4 | ws_xton(hex_secret[i*2 + 1]);
+    }
+
+    if (!tls_keylog_cache.entries) {
+        tls_keylog_cache.entries = g_ptr_array_new_with_free_func(g_free);
+    }
+    g_ptr_array_add(tls_keylog_cache.entries, entry);
+    return entry;
+}
+
+static void
+tls_keylog_cache_clear(void)
+{
+    g_free(tls_keylog_cache.filename);
+    tls_keylog_cache.filename = NULL;
+    if (tls_keylog_cache.entries) {
+        /* The current master key maps may still point into the entries;
+         * keep them until the maps are destroyed. */
+        if (!tls_keylog_cache.stale) {
+            tls_keylog_cache.stale = g_ptr_array_new_with_free_func((GDestroyNotify)g_ptr_array_unref);
+        }
+        g_ptr_array_add(tls_keylog_cache.stale, tls_keylog_cache.entries);
+        tls_keylog_cache.entries = NULL;
+    }
+    tls_keylog_cache.replayed = false;
+}
+
+/* Put the cached keylog file secrets into (newly created) master key maps. */
+static void
+tls_keylog_cache_replay(const ssl_master_key_map_t *mk_map)
+{
+    ssl_master_key_match_group_t mk_groups[TLS_KEYLOG_GROUP_COUNT];
+
+    tls_keylog_cache.replayed = true;
+    if (!tls_keylog_cache.entries) {
+        return;
+    }
+    tls_keylog_match_groups(mk_map, mk_groups);
+    for (unsigned i = 0; i < tls_keylog_cache.entries->len; i++) {
+        tls_keylog_entry_t *entry = (tls_keylog_entry_t *)g_ptr_array_index(tls_keylog_cache.entries, i);
+        g_hash_table_insert(mk_groups[entry->group].master_key_ht, &entry->key, &entry->secret);
+    }
+    ssl_debug_printf("%s restored %u secrets from %s\n", G_STRFUNC,
+                     tls_keylog_cache.entries->len, tls_keylog_cache.filename);
+}
+
+/*
+ * Process lines from a TLS key log. If from_keylog_file is set, the secrets
+ * are also added to the keylog file cache, and allocated accordingly.
+ */
+static void
+tls_keylog_process_lines_full(const ssl_master_key_map_t *mk_map, const uint8_t *data, unsigned datalen,
+                              bool from_keylog_file)
+{
+    ssl_master_key_match_group_t mk_groups[TLS_KEYLOG_GROUP_COUNT];
+
+    tls_keylog_match_groups(mk_map, mk_groups);
+
     /* The format of the file is a series of records with one of the following formats:
      *   - "RSA xxxx yyyy"
      *     Where xxxx are the first 8 bytes of the encrypted pre-master secret (hex-encoded)
@@ -6763,7 +6878,7 @@ tls_keylog_process_lines(const ssl_master_key_map_t *mk_map, const uint8_t *data
         GMatchInfo *mi;
         if (g_regex_match_full(regex, line, linelen, 0, G_REGEX_MATCH_ANCHORED, &mi, NULL)) {
             char *hex_key, *hex_pre_ms_or_ms;
-            StringInfo *key = wmem_new(wmem_file_scope(), StringInfo);
+            StringInfo *key = NULL;
             StringInfo *pre_ms_or_ms = NULL;
             GHashTable *ht = NULL;
 
@@ -6782,11 +6897,6 @@ tls_keylog_process_lines(const ssl_master_key_map_t *mk_map, const uint8_t *data
             /* There is always a match, otherwise the regex is wrong. */
             DISSECTOR_ASSERT(hex_pre_ms_or_ms && strlen(hex_pre_ms_or_ms));
 
-            /* convert from hex to bytes and save to hashtable */
-            pre_ms_or_ms = wmem_new(wmem_file_scope(), StringInfo);
-            from_hex(pre_ms_or_ms, hex_pre_ms_or_ms, strlen(hex_pre_ms_or_ms));
-            g_free(hex_pre_ms_or_ms);
-
             /* Find a master key from any format (CLIENT_RANDOM, SID, ...) */
             for (unsigned i = 0; i < G_N_ELEMENTS(mk_groups); i++) {
                 ssl_master_key_match_group_t *g = &mk_groups[i];
@@ -6794,12 +6904,23 @@ tls_keylog_process_lines(const ssl_master_key_map_t *mk_map, const uint8_t *data
                 if (hex_key && *hex_key) {
                     ssl_debug_printf("    matched %s\n", g->re_group_name);
                     ht = g->master_key_ht;
-                    from_hex(key, hex_key, strlen(hex_key));
+                    /* convert from hex to bytes and save to hashtable */
+                    if (from_keylog_file) {
+                        tls_keylog_entry_t *entry = tls_keylog_cache_add(i, hex_key, hex_pre_ms_or_ms);
+                        key = &entry->key;
+                        pre_ms_or_ms = &entry->secret;
+                    } else {
+                        key = wmem_new(wmem_file_scope(), StringInfo);
+                        from_hex(key, hex_key, strlen(hex_key));
+                        pre_ms_or_ms = wmem_new(wmem_file_scope(), StringInfo);
+                        from_hex(pre_ms_or_ms, hex_pre_ms_or_ms, strlen(hex_pre_ms_or_ms));
+                    }
                     g_free(hex_key);
                     break;
                 }
                 g_free(hex_key);
             }
+            g_free(hex_pre_ms_or_ms);
             DISSECTOR_ASSERT(ht); /* Cannot be reached, or regex is wrong. */
 
             g_hash_table_insert(ht, key, pre_ms_or_ms);
@@ -6812,6 +6933,12 @@ tls_keylog_process_lines(const ssl_master_key_map_t *mk_map, const uint8_t *data
     }
 }
 
+void
+tls_keylog_process_lines(const ssl_master_key_map_t *mk_map, const uint8_t *data, unsigned datalen)
+{
+    tls_keylog_process_lines_full(mk_map, data, datalen, false);
+}
+
 void
 ssl_load_keyfile(const char *tls_keylog_filename, FILE **keylog_file,
                  const ssl_master_key_map_t *mk_map)
@@ -6837,12 +6964,32 @@ ssl_load_keyfile(const char *tls_keylog_filename, FILE **keylog_file,
         *keylog_file = NULL;
     }
 
+    /* if a different keylog file is configured, or it got truncated, the
+     * cached secrets are stale; read it again from the start. */
+    if (*keylog_file) {
+        ws_statb64 statb;
+        if (g_strcmp0(tls_keylog_cache.filename, tls_keylog_filename) != 0 ||
+                ws_fstat64(ws_fileno(*keylog_file), &statb) != 0 ||
+                statb.st_size < ws_ftell64(*keylog_file)) {
+            ssl_debug_printf("%s keylog file changed, re-reading it\n", G_STRFUNC);
+            fclose(*keylog_file);
+            *keylog_file = NULL;
+        }
+    }
+
     if (*keylog_file == NULL) {
+        /* (Re-)reading the file from the start, forget what was read before. */
+        tls_keylog_cache_clear();
         *keylog_file = ws_fopen(tls_keylog_filename, "r");
         if (!*keylog_file) {
             ssl_debug_printf("%s failed to open SSL keylog\n", G_STRFUNC);
             return;
         }
+        tls_keylog_cache.filename = g_strdup(tls_keylog_filename);
+        tls_keylog_cache.replayed = true;
+    } else if (!tls_keylog_cache.replayed) {
+        /* The maps were recreated since the last call. */
+        tls_keylog_cache_replay(mk_map);
     }
 
     for (;;) {
@@ -6859,7 +7006,7 @@ ssl_load_keyfile(const char *tls_keylog_filename, FILE **keylog_file,
             }
             break;
         }
-        tls_keylog_process_lines(mk_map, (uint8_t *)line, (int)strlen(line));
+        tls_keylog_process_lines_full(mk_map, (uint8_t *)line, (int)strlen(line), true);
     }
 }
 /** SSL keylog file handling. }}} */
@@ -791,7 +791,9 @@ tls_get_master_key_map(bool load_secrets);
 extern void
 tls_keylog_process_lines(const ssl_master_key_map_t *mk_map, const uint8_t *data, unsigned len);
 
-/* tries to update the secrets cache from the given filename */
+/* tries to update the secrets cache from the given filename. Secrets read
+ * earlier are kept across ssl_common_cleanup() and restored from memory, only
+ * lines appended to the file since the last call are parsed. */
 extern void
 ssl_load_keyfile(const char *ssl_keylog_filename, FILE **keylog_file,
                  const ssl_master_key_map_t *mk_map);
@@ -490,6 +490,15 @@ epan_get_modified_block(const epan_t *session, const frame_data *fd)
 	return NULL;
 }
 
+void
+epan_get_shift_offset(const epan_t *session, const frame_data *fd, nstime_t *shift_offset)
+{
+	if (fd->has_shift_offset && session->funcs.get_shift_offset)
+		session->funcs.get_shift_offset(session->prov, fd, shift_offset);
+	else
+		nstime_set_zero(shift_offset);
+}
+
 const char *
 epan_get_interface_name(const epan_t *session, uint32_t interface_id, unsigned section_number)
 {
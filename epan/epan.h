@@ -51,6 +51,7 @@ struct packet_provider_funcs {
 	const char *(*get_interface_name)(struct packet_provider_data *prov, uint32_t interface_id, unsigned section_number);
 	const char *(*get_interface_description)(struct packet_provider_data *prov, uint32_t interface_id, unsigned section_number);
 	wtap_block_t (*get_modified_block)(struct packet_provider_data *prov, const frame_data *fd);
+	void (*get_shift_offset)(struct packet_provider_data *prov, const frame_data *fd, nstime_t *shift_offset);
 };
 
 /**
@@ -157,6 +158,13 @@ WS_DLL_PUBLIC epan_t *epan_new(struct packet_provider_data *prov,
 
 WS_DLL_PUBLIC wtap_block_t epan_get_modified_block(const epan_t *session, const frame_data *fd);
 
+/**
+ * Get how much the absolute time stamp of the frame has been shifted,
+ * or zero if it hasn't been.  Time shifts are rare, so the provider
+ * keeps them in a side table rather than in every frame_data.
+ */
+WS_DLL_PUBLIC void epan_get_shift_offset(const epan_t *session, const frame_data *fd, nstime_t *shift_offset);
+
 WS_DLL_PUBLIC const char *epan_get_interface_name(const epan_t *session, uint32_t interface_id, unsigned section_number);
 
 WS_DLL_PUBLIC const char *epan_get_interface_description(const epan_t *session, uint32_t interface_id, unsigned section_number);
@@ -166,6 +166,7 @@ frame_data_init(frame_data *fdata, uint32_t num, const wtap_rec *rec,
   fdata->marked = 0;
   fdata->ref_time = 0;
   fdata->ignored = 0;
+  fdata->hidden_by_dissector = 0;
   fdata->has_ts = (rec->presence_flags & WTAP_HAS_TS) ? 1 : 0;
   fdata->tcp_snd_manual_analysis = 0;
   switch (rec->rec_type) {
@@ -231,8 +232,7 @@ frame_data_init(frame_data *fdata, uint32_t num, const wtap_rec *rec,
   fdata->has_modified_block = 0;
   fdata->need_colorize = 0;
   fdata->color_filter = NULL;
-  fdata->shift_offset.secs = 0;
-  fdata->shift_offset.nsecs = 0;
+  fdata->has_shift_offset = 0;
   fdata->frame_ref_num = 0;
   fdata->prev_dis_num = 0;
 }
@@ -55,6 +55,10 @@ typedef enum {
    Try to keep it close to, and less than or equal to, a power of 2.
    "Smaller than a power of 2" is OK for ILP32 platforms.
 
+   Fields that are only set for a few frames, if any, belong in a side
+   table rather than in here; see epan_get_shift_offset().  With
+   that, this is 80 bytes on LP64 and LLP64 platforms.
+
    XXX - shuffle the fields to try to keep the most commonly-accessed
    fields within the first 16 or 32 bytes, so they all fit in a cache
    line? */
@@ -86,9 +90,10 @@ typedef struct _frame_data {
   unsigned int has_ts           : 1; /**< 1 = has time stamp, 0 = no time stamp */
   unsigned int has_modified_block : 1; /** 1 = block for this packet has been modified */
   unsigned int need_colorize    : 1; /**< 1 = need to (re-)calculate packet color */
+  unsigned int has_shift_offset : 1; /**< 1 = abs_ts has been shifted, see epan_get_shift_offset() */
+  unsigned int hidden_by_dissector : 1; /**< 1 = a dissector cleared passed_dfilter the last time the frame was dissected */
   unsigned int tsprec           : 4; /**< Time stamp precision -2^tsprec gives up to femtoseconds */
   nstime_t     abs_ts;       /**< Absolute timestamp */
-  nstime_t     shift_offset; /**< How much the abs_tm of the frame is shifted */
   uint32_t     frame_ref_num; /**< Previous reference frame (0 if this is one) */
   uint32_t     prev_dis_num; /**< Previous displayed frame (0 if first one) */
 } frame_data;
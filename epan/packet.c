@@ -33,6 +33,7 @@
 #include <epan/wmem_scopes.h>
 
 #include <epan/column-info.h>
+#include <epan/conversation.h>
 #include <epan/exceptions.h>
 #include <epan/reassemble.h>
 #include <epan/stream.h>
@@ -82,9 +83,23 @@ struct data_source {
  *
  * "protocol" is the protocol associated with the dissector table. Used
  * for determining dependencies.
+ *
+ * "uint_index" is, for a uint dissector table, a direct index of the
+ * entries in "hash_table" with values below DTBL_UINT_INDEX_LIMIT, so
+ * that looking up e.g. a port number or an Ethertype doesn't need to
+ * hash. It's an array of pages of DTBL_UINT_PAGE_SIZE entries, indexed
+ * by the upper bits of the value; pages without entries aren't allocated.
+ * It's built by the first lookup in the table, so tables that are never
+ * used for dissection don't pay for it, and is kept up to date when
+ * entries are added, changed or removed.
  */
+#define DTBL_UINT_PAGE_BITS	8
+#define DTBL_UINT_PAGE_SIZE	(1U << DTBL_UINT_PAGE_BITS)
+#define DTBL_UINT_INDEX_LIMIT	(DTBL_UINT_PAGE_SIZE * DTBL_UINT_PAGE_SIZE)
+
 struct dissector_table {
 	GHashTable	*hash_table;
+	dtbl_entry_t	***uint_index;
 	GSList		*dissector_handles;
 	const char	*ui_name;
 	ftenum_t	type;
@@ -187,11 +202,25 @@ destroy_heuristic_dissector_list(void *data)
 	g_slice_free(struct heur_dissector_list, dissector_list);
 }
 
+static void
+dtbl_uint_index_free(dissector_table_t sub_dissectors)
+{
+	unsigned i;
+
+	if (sub_dissectors->uint_index == NULL)
+		return;
+	for (i = 0; i < DTBL_UINT_PAGE_SIZE; i++)
+		g_free(sub_dissectors->uint_index[i]);
+	g_free(sub_dissectors->uint_index);
+	sub_dissectors->uint_index = NULL;
+}
+
 static void
 destroy_dissector_table(void *data)
 {
 	struct dissector_table *table = (struct dissector_table *)data;
 
+	dtbl_uint_index_free(table);
 	g_hash_table_destroy(table->hash_table);
 	g_slist_free(table->dissector_handles);
 	g_slice_free(struct dissector_table, data);
@@ -336,6 +365,17 @@ register_shutdown_routine(void (*func)(void))
 	shutdown_routines = g_slist_prepend(shutdown_routines, (void *)func);
 }
 
+static void
+reset_heur_dissector_stats(void *key _U_, void *value, void *user_data _U_)
+{
+	heur_dtbl_entry_t *hdtbl_entry = (heur_dtbl_entry_t *)value;
+
+	hdtbl_entry->attempts = 0;
+	hdtbl_entry->accepts = 0;
+	hdtbl_entry->time_ns = 0;
+	hdtbl_entry->cache_hits = 0;
+}
+
 /* Initialize all data structures used for dissection. */
 void
 init_dissection(void)
@@ -360,6 +400,9 @@ init_dissection(void)
 
 	/* Initialize the expert infos */
 	expert_packet_init();
+
+	/* Count the heuristic dissectors for this file only */
+	g_hash_table_foreach(heuristic_short_names, reset_heur_dissector_stats, NULL);
 }
 
 void
@@ -1130,6 +1173,60 @@ find_dissector_table(const char *name)
 	return dissector_table;
 }
 
+/* Set the entry for a value in the index of a uint dissector table. */
+static void
+dtbl_uint_index_set(dissector_table_t sub_dissectors, const uint32_t pattern,
+		    dtbl_entry_t *dtbl_entry)
+{
+	dtbl_entry_t **page = sub_dissectors->uint_index[pattern >> DTBL_UINT_PAGE_BITS];
+
+	if (page == NULL) {
+		if (dtbl_entry == NULL)
+			return;
+		page = g_new0(dtbl_entry_t *, DTBL_UINT_PAGE_SIZE);
+		sub_dissectors->uint_index[pattern >> DTBL_UINT_PAGE_BITS] = page;
+	}
+	page[pattern & (DTBL_UINT_PAGE_SIZE - 1)] = dtbl_entry;
+}
+
+static void
+dtbl_uint_index_add_entry(void *key, void *value, void *user_data)
+{
+	dissector_table_t sub_dissectors = (dissector_table_t)user_data;
+	uint32_t pattern = GPOINTER_TO_UINT(key);
+
+	if (pattern < DTBL_UINT_INDEX_LIMIT)
+		dtbl_uint_index_set(sub_dissectors, pattern, (dtbl_entry_t *)value);
+}
+
+static void
+dtbl_uint_index_build(dissector_table_t sub_dissectors)
+{
+	sub_dissectors->uint_index = g_new0(dtbl_entry_t **, DTBL_UINT_PAGE_SIZE);
+	g_hash_table_foreach(sub_dissectors->hash_table, dtbl_uint_index_add_entry, sub_dissectors);
+}
+
+/* Add or replace an entry in a uint dissector table. */
+static void
+dtbl_uint_insert(dissector_table_t sub_dissectors, const uint32_t pattern,
+		 dtbl_entry_t *dtbl_entry)
+{
+	g_hash_table_insert(sub_dissectors->hash_table,
+			     GUINT_TO_POINTER(pattern), (void *)dtbl_entry);
+	if (sub_dissectors->uint_index != NULL && pattern < DTBL_UINT_INDEX_LIMIT)
+		dtbl_uint_index_set(sub_dissectors, pattern, dtbl_entry);
+}
+
+/* Remove an entry from a uint dissector table. */
+static void
+dtbl_uint_remove(dissector_table_t sub_dissectors, const uint32_t pattern)
+{
+	if (sub_dissectors->uint_index != NULL && pattern < DTBL_UINT_INDEX_LIMIT)
+		dtbl_uint_index_set(sub_dissectors, pattern, NULL);
+	g_hash_table_remove(sub_dissectors->hash_table,
+			    GUINT_TO_POINTER(pattern));
+}
+
 /* Find an entry in a uint dissector table. */
 static dtbl_entry_t *
 find_uint_dtbl_entry(dissector_table_t sub_dissectors, const uint32_t pattern)
@@ -1159,6 +1256,14 @@ find_uint_dtbl_entry(dissector_table_t sub_dissectors, const uint32_t pattern)
 	/*
 	 * Find the entry.
 	 */
+	if (pattern < DTBL_UINT_INDEX_LIMIT) {
+		dtbl_entry_t **page;
+
+		if (G_UNLIKELY(sub_dissectors->uint_index == NULL))
+			dtbl_uint_index_build(sub_dissectors);
+		page = sub_dissectors->uint_index[pattern >> DTBL_UINT_PAGE_BITS];
+		return page ? page[pattern & (DTBL_UINT_PAGE_SIZE - 1)] : NULL;
+	}
 	return (dtbl_entry_t *)g_hash_table_lookup(sub_dissectors->hash_table,
 				   GUINT_TO_POINTER(pattern));
 }
@@ -1240,8 +1345,7 @@ dissector_add_uint(const char *name, const uint32_t pattern, dissector_handle_t
 	dtbl_entry->initial = dtbl_entry->current;
 
 	/* do the table insertion */
-	g_hash_table_insert(sub_dissectors->hash_table,
-			     GUINT_TO_POINTER(pattern), (void *)dtbl_entry);
+	dtbl_uint_insert(sub_dissectors, pattern, dtbl_entry);
 
 	/*
 	 * Now, if this table supports "Decode As", add this handle
@@ -1396,8 +1500,7 @@ dissector_delete_uint(const char *name, const uint32_t pattern,
 		/*
 		 * Found - remove it.
 		 */
-		g_hash_table_remove(sub_dissectors->hash_table,
-				    GUINT_TO_POINTER(pattern));
+		dtbl_uint_remove(sub_dissectors, pattern);
 	}
 }
 
@@ -1469,6 +1572,8 @@ void dissector_delete_all(const char *name, dissector_handle_t handle)
 	ws_assert (sub_dissectors);
 
 	g_hash_table_foreach_remove (sub_dissectors->hash_table, dissector_delete_all_check, handle);
+	/* Rebuilt by the next lookup */
+	dtbl_uint_index_free(sub_dissectors);
 }
 
 static void
@@ -1478,6 +1583,7 @@ dissector_delete_from_table(gpointer key _U_, gpointer value, gpointer user_data
 	ws_assert (sub_dissectors);
 
 	g_hash_table_foreach_remove(sub_dissectors->hash_table, dissector_delete_all_check, user_data);
+	dtbl_uint_index_free(sub_dissectors);
 	sub_dissectors->dissector_handles = g_slist_remove(sub_dissectors->dissector_handles, user_data);
 }
 
@@ -1509,8 +1615,7 @@ dissector_change_uint(const char *name, const uint32_t pattern, dissector_handle
 		 * to decode it, just remove the entry to save memory.
 		 */
 		if (handle == NULL && dtbl_entry->initial == NULL) {
-			g_hash_table_remove(sub_dissectors->hash_table,
-					    GUINT_TO_POINTER(pattern));
+			dtbl_uint_remove(sub_dissectors, pattern);
 			return;
 		}
 		dtbl_entry->current = handle;
@@ -1530,8 +1635,7 @@ dissector_change_uint(const char *name, const uint32_t pattern, dissector_handle
 	dtbl_entry->current = handle;
 
 	/* do the table insertion */
-	g_hash_table_insert(sub_dissectors->hash_table,
-			     GUINT_TO_POINTER(pattern), (void *)dtbl_entry);
+	dtbl_uint_insert(sub_dissectors, pattern, dtbl_entry);
 }
 
 /* Reset an entry in a uint dissector table to its initial value. */
@@ -1558,8 +1662,7 @@ dissector_reset_uint(const char *name, const uint32_t pattern)
 	if (dtbl_entry->initial != NULL) {
 		dtbl_entry->current = dtbl_entry->initial;
 	} else {
-		g_hash_table_remove(sub_dissectors->hash_table,
-				    GUINT_TO_POINTER(pattern));
+		dtbl_uint_remove(sub_dissectors, pattern);
 	}
 }
 
@@ -2779,6 +2882,7 @@ register_dissector_table(const char *name, const char *ui_name, const int proto,
 		ws_error("The dissector table %s (%s) is registering an unsupported type - are you using a buggy plugin?", name, ui_name);
 		ws_assert_not_reached();
 	}
+	sub_dissectors->uint_index = NULL;
 	sub_dissectors->dissector_handles = NULL;
 	sub_dissectors->ui_name = ui_name;
 	sub_dissectors->type    = type;
@@ -2809,6 +2913,7 @@ dissector_table_t register_custom_dissector_table(const char *name,
 							       key_destroy_func,
 							       &g_free);
 
+	sub_dissectors->uint_index = NULL;
 	sub_dissectors->dissector_handles = NULL;
 	sub_dissectors->ui_name = ui_name;
 	sub_dissectors->type    = FT_BYTES; /* Consider key a "blob" of data, no need to really create new type */
@@ -2971,6 +3076,10 @@ heur_dissector_add(const char *name, heur_dissector_t dissector, const char *dis
 	hdtbl_entry->list_name = g_strdup(name);
 	hdtbl_entry->enabled   = (enable == HEURISTIC_ENABLE);
 	hdtbl_entry->enabled_by_default = (enable == HEURISTIC_ENABLE);
+	hdtbl_entry->attempts = 0;
+	hdtbl_entry->accepts = 0;
+	hdtbl_entry->time_ns = 0;
+	hdtbl_entry->cache_hits = 0;
 
 	/* do the table insertion */
 	g_hash_table_insert(heuristic_short_names, (void *)hdtbl_entry->short_name, hdtbl_entry);
@@ -3025,6 +3134,112 @@ heur_dissector_delete(const char *name, heur_dissector_t dissector, const int pr
 	}
 }
 
+/*
+ * Heuristic dissector statistics and the per-conversation heuristic cache.
+ */
+static int proto_heur;
+static bool heur_timing;
+static bool heur_conversation_cache;
+
+/*
+ * The heuristic dissectors that accepted the packets of a conversation,
+ * one per heuristic dissector list, in file scope.
+ */
+typedef struct heur_conv_cache {
+	heur_dissector_list_t    list;
+	heur_dtbl_entry_t       *hdtbl_entry;
+	struct heur_conv_cache  *next;
+} heur_conv_cache_t;
+
+void
+heur_dissector_set_timing(bool enable)
+{
+	heur_timing = enable;
+}
+
+/* A monotonic clock, so that the time can't go backwards while a heuristic runs. */
+static inline uint64_t
+heur_clock_ns(void)
+{
+	return (uint64_t)g_get_monotonic_time() * 1000;
+}
+
+static bool
+heur_dissector_is_enabled(const heur_dtbl_entry_t *hdtbl_entry)
+{
+	return hdtbl_entry->protocol == NULL ||
+		(proto_is_protocol_enabled(hdtbl_entry->protocol) && hdtbl_entry->enabled);
+}
+
+/*
+ * Call one heuristic dissector; returns the number of bytes it consumed,
+ * 0 if it rejected the packet.
+ */
+static int
+call_heur_dissector_entry(heur_dtbl_entry_t *hdtbl_entry, tvbuff_t *tvb,
+			  packet_info *pinfo, proto_tree *tree, void *data,
+			  uint16_t saved_can_desegment, unsigned saved_layers_len)
+{
+	int       proto_id;
+	int       len;
+	bool      consumed_none;
+	unsigned  saved_desegment_len;
+	unsigned  saved_tree_count = tree ? tree->tree_data->count : 0;
+	uint64_t  start_ns = 0;
+
+	/* XXX - why set this now and above? */
+	pinfo->can_desegment = saved_can_desegment-(saved_can_desegment>0);
+
+	if (hdtbl_entry->protocol != NULL) {
+		proto_id = proto_get_id(hdtbl_entry->protocol);
+		/* do NOT change this behavior - wslua uses the protocol short name set here in order
+		   to determine which Lua-based heurisitc dissector to call */
+		pinfo->current_proto =
+			proto_get_protocol_short_name(hdtbl_entry->protocol);
+
+		/*
+		 * Add the protocol name to the layers; we'll remove it
+		 * if the dissector fails.
+		 */
+		add_layer(pinfo, proto_id);
+	}
+
+	pinfo->heur_list_name = hdtbl_entry->list_name;
+
+	saved_desegment_len = pinfo->desegment_len;
+	hdtbl_entry->attempts++;
+	if (heur_timing)
+		start_ns = heur_clock_ns();
+	len = (hdtbl_entry->dissector)(tvb, pinfo, tree, data);
+	if (heur_timing)
+		hdtbl_entry->time_ns += heur_clock_ns() - start_ns;
+	consumed_none = len == 0 || (pinfo->desegment_len != saved_desegment_len && pinfo->desegment_offset == 0);
+	if (hdtbl_entry->protocol != NULL &&
+		(consumed_none || (tree && saved_tree_count == tree->tree_data->count))) {
+		/*
+		 * We added a protocol layer above. The dissector
+		 * didn't consume any data or it didn't add any
+		 * items to the tree so remove it from the list.
+		 */
+		while (wmem_list_count(pinfo->layers) > saved_layers_len) {
+			/*
+			 * Only reduce the layer number if the dissector
+			 * didn't consume data. Since tree can be NULL on
+			 * the first pass, we cannot check it or it will
+			 * break dissectors that rely on a stable value.
+			 */
+			remove_last_layer(pinfo, consumed_none);
+		}
+	}
+	if (len) {
+		hdtbl_entry->accepts++;
+		if (ws_log_msg_is_active(WS_LOG_DOMAIN, LOG_LEVEL_DEBUG)) {
+			ws_debug("Frame: %d | Layers: %s | Dissector: %s\n", pinfo->num, proto_list_layers(pinfo), hdtbl_entry->short_name);
+		}
+	}
+	return len;
+}
+
 bool
 dissector_try_heuristic(heur_dissector_list_t sub_dissectors, tvbuff_t *tvb,
 			packet_info *pinfo, proto_tree *tree, heur_dtbl_entry_t **heur_dtbl_entry, void *data)
@@ -3037,11 +3252,9 @@ dissector_try_heuristic(heur_dissector_list_t sub_dissectors, tvbuff_t *tvb,
 	uint16_t           saved_can_desegment;
 	unsigned           saved_layers_len = 0;
 	heur_dtbl_entry_t *hdtbl_entry;
-	int                proto_id;
-	int                len;
-	bool               consumed_none;
-	unsigned           saved_desegment_len;
-	unsigned           saved_tree_count = tree ? tree->tree_data->count : 0;
+	heur_dtbl_entry_t *cached_entry = NULL;
+	heur_conv_cache_t *cache = NULL;
+	conversation_t    *conv = NULL;
 
 	/* can_desegment is set to 2 by anyone which offers this api/service.
 	   then every time a subdissector is called it is decremented by one.
@@ -3065,61 +3278,45 @@ dissector_try_heuristic(heur_dissector_list_t sub_dissectors, tvbuff_t *tvb,
 
 	DISSECTOR_ASSERT(saved_layers_len < prefs.gui_max_tree_depth);
 
-	for (entry = sub_dissectors->dissectors; entry != NULL;
-	    entry = g_slist_next(entry)) {
-		/* XXX - why set this now and above? */
-		pinfo->can_desegment = saved_can_desegment-(saved_can_desegment>0);
-		hdtbl_entry = (heur_dtbl_entry_t *)entry->data;
-
-		if (hdtbl_entry->protocol != NULL &&
-			(!proto_is_protocol_enabled(hdtbl_entry->protocol)||(hdtbl_entry->enabled==false))) {
-			/*
-			 * No - don't try this dissector.
-			 */
-			continue;
+	if (heur_conversation_cache) {
+		/*
+		 * Try the heuristic dissector that accepted the previous
+		 * packet of this conversation first. Don't create a
+		 * conversation just for this.
+		 */
+		conv = find_conversation_pinfo(pinfo, 0);
+		if (conv != NULL) {
+			for (cache = (heur_conv_cache_t *)conversation_get_proto_data(conv, proto_heur);
+			    cache != NULL; cache = cache->next) {
+				if (cache->list == sub_dissectors)
+					break;
+			}
 		}
-
-		if (hdtbl_entry->protocol != NULL) {
-			proto_id = proto_get_id(hdtbl_entry->protocol);
-			/* do NOT change this behavior - wslua uses the protocol short name set here in order
-			   to determine which Lua-based heurisitc dissector to call */
-			pinfo->current_proto =
-				proto_get_protocol_short_name(hdtbl_entry->protocol);
-
-			/*
-			 * Add the protocol name to the layers; we'll remove it
-			 * if the dissector fails.
-			 */
-			add_layer(pinfo, proto_id);
+		if (cache != NULL && heur_dissector_is_enabled(cache->hdtbl_entry)) {
+			cached_entry = cache->hdtbl_entry;
+			if (call_heur_dissector_entry(cached_entry, tvb, pinfo, tree, data,
+			    saved_can_desegment, saved_layers_len)) {
+				cached_entry->cache_hits++;
+				*heur_dtbl_entry = cached_entry;
+				status = true;
+			}
 		}
+	}
 
-		pinfo->heur_list_name = hdtbl_entry->list_name;
+	for (entry = sub_dissectors->dissectors; entry != NULL && !status;
+	    entry = g_slist_next(entry)) {
+		hdtbl_entry = (heur_dtbl_entry_t *)entry->data;
 
-		saved_desegment_len = pinfo->desegment_len;
-		len = (hdtbl_entry->dissector)(tvb, pinfo, tree, data);
-		consumed_none = len == 0 || (pinfo->desegment_len != saved_desegment_len && pinfo->desegment_offset == 0);
-		if (hdtbl_entry->protocol != NULL &&
-			(consumed_none || (tree && saved_tree_count == tree->tree_data->count))) {
+		if (!heur_dissector_is_enabled(hdtbl_entry) || hdtbl_entry == cached_entry) {
 			/*
-			 * We added a protocol layer above. The dissector
-			 * didn't consume any data or it didn't add any
-			 * items to the tree so remove it from the list.
+			 * No - don't try this dissector (again).
 			 */
-			while (wmem_list_count(pinfo->layers) > saved_layers_len) {
-				/*
-				 * Only reduce the layer number if the dissector
-				 * didn't consume data. Since tree can be NULL on
-				 * the first pass, we cannot check it or it will
-				 * break dissectors that rely on a stable value.
-				 */
-				remove_last_layer(pinfo, consumed_none);
-			}
+			prev_entry = entry;
+			continue;
 		}
-		if (len) {
-			if (ws_log_msg_is_active(WS_LOG_DOMAIN, LOG_LEVEL_DEBUG)) {
-				ws_debug("Frame: %d | Layers: %s | Dissector: %s\n", pinfo->num, proto_list_layers(pinfo), hdtbl_entry->short_name);
-			}
 
+		if (call_heur_dissector_entry(hdtbl_entry, tvb, pinfo, tree, data,
+		    saved_can_desegment, saved_layers_len)) {
 			*heur_dtbl_entry = hdtbl_entry;
 
 			/* Bubble the matched entry to the top for faster search next time. */
@@ -3127,6 +3324,17 @@ dissector_try_heuristic(heur_dissector_list_t sub_dissectors, tvbuff_t *tvb,
 				sub_dissectors->dissectors = g_slist_remove_link(sub_dissectors->dissectors, entry);
 				sub_dissectors->dissectors = g_slist_concat(entry, sub_dissectors->dissectors);
 			}
+
+			if (conv != NULL) {
+				/* Remember it for the next packet of the conversation. */
+				if (cache == NULL) {
+					cache = wmem_new(wmem_file_scope(), heur_conv_cache_t);
+					cache->list = sub_dissectors;
+					cache->next = (heur_conv_cache_t *)conversation_get_proto_data(conv, proto_heur);
+					conversation_add_proto_data(conv, proto_heur, cache);
+				}
+				cache->hdtbl_entry = hdtbl_entry;
+			}
 			status = true;
 			break;
 		}
@@ -3139,6 +3347,28 @@ dissector_try_heuristic(heur_dissector_list_t sub_dissectors, tvbuff_t *tvb,
 	return status;
 }
 
+void
+register_heur_dissector_prefs(void)
+{
+	module_t *heur_module;
+
+	proto_heur = proto_register_protocol("Heuristic dissectors", "Heuristic dissectors", "_ws.heuristic");
+
+	/* Not really a protocol; disabling it makes no sense. */
+	proto_set_cant_toggle(proto_heur);
+
+	heur_module = prefs_register_protocol(proto_heur, NULL);
+	prefs_register_bool_preference(heur_module, "conversation_cache",
+	    "Try the last matching heuristic dissector of a conversation first",
+	    "Remember which heuristic dissector accepted the last packet of a "
+	    "conversation and try it first for the following packets of that "
+	    "conversation, instead of trying the heuristic dissectors in order. "
+	    "This is faster when many heuristic dissectors are enabled, but if "
+	    "more than one of them would accept a packet, the one that is used "
+	    "can change.",
+	    &heur_conversation_cache);
+}
+
 typedef struct heur_dissector_foreach_info {
 	void *        caller_data;
 	DATFunc_heur  caller_func;
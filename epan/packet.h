@@ -55,6 +55,9 @@ extern void packet_init(void);
 extern void packet_cache_proto_handles(void);
 extern void packet_cleanup(void);
 
+/* Register the pseudo-protocol with the heuristic dissector preferences */
+extern void register_heur_dissector_prefs(void);
+
 /* Handle for dissectors you call directly or register with "dissector_add_uint()".
    This handle is opaque outside of "packet.c". */
 struct dissector_handle;
@@ -468,6 +471,11 @@ typedef struct heur_dtbl_entry {
 	char *short_name;     /* string used for "internal" use to uniquely identify heuristic */
 	bool enabled;
 	bool enabled_by_default;
+	/* Statistics, for e.g. "tshark -z heur,stat"; reset by init_dissection() */
+	uint64_t attempts;    /* number of times the dissector was called */
+	uint64_t accepts;     /* number of times it accepted the packet */
+	uint64_t time_ns;     /* time spent in it, including the dissectors it called, if timed */
+	uint64_t cache_hits;  /* number of accepts where it was tried first because it was cached on the conversation */
 } heur_dtbl_entry_t;
 
 /** A protocol uses this function to register a heuristic sub-dissector list.
@@ -527,6 +535,16 @@ WS_DLL_PUBLIC void dissector_all_heur_tables_foreach_table (DATFunc_heur_table f
 /* true if a heur_dissector list of that name exists to be registered into */
 WS_DLL_PUBLIC bool has_heur_dissector_list(const char *name);
 
+/** Measure the time spent in each heuristic dissector.
+ *
+ * The time is added to the time_ns member of the heur_dtbl_entry_t. As
+ * this reads the clock twice for each heuristic dissector that is tried,
+ * it's off unless something, e.g. "tshark -z heur,stat", wants it.
+ *
+ * @param[in] enable true to measure the time.
+ */
+WS_DLL_PUBLIC void heur_dissector_set_timing(bool enable);
+
 /** Try all the dissectors in a given heuristic dissector list. This is done,
  *  until we find one that recognizes the protocol.
  *  Call this while the parent dissector running.
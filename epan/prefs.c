@@ -3711,7 +3711,7 @@ prefs_register_modules(void)
 
     prefs_register_uint_preference(gui_module, "packet_list_cached_rows_max",
                                    "Maximum cached rows",
-                                   "Maximum number of rows that can be sorted by columns that require dissection. Increasing this increases memory consumption by caching column text",
+                                   "Maximum number of rows whose column text is cached. Increasing this increases memory consumption, but avoids redissecting rows when scrolling or sorting by columns that require dissection",
                                    10,
                                    &prefs.gui_packet_list_cached_rows_max);
 
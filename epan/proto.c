@@ -48,6 +48,7 @@
 #include "osi-utils.h"
 #include "expert.h"
 #include "show_exception.h"
+#include "reassemble.h"
 #include "in_cksum.h"
 #include "register-int.h"
 
@@ -611,6 +612,8 @@ proto_init(GSList *register_all_plugin_protocols_list,
 	register_byte_array_string_decodinws_error();
 	register_date_time_string_decodinws_error();
 	register_string_errors();
+	register_reassembly_limits();
+	register_heur_dissector_prefs();
 	ftypes_register_pseudofields();
 	col_register_protocol();
 
@@ -14,6 +14,9 @@
 
 #include <epan/packet.h>
 #include <epan/exceptions.h>
+#include <epan/expert.h>
+#include <epan/prefs.h>
+#include <epan/proto_data.h>
 #include <epan/reassemble.h>
 #include <epan/tvbuff-int.h>
 
@@ -432,6 +435,180 @@ reassembled_table_insert(GHashTable *reassembled_table, reassembled_key *key, fr
 	g_hash_table_insert(reassembled_table, key, fd_head);
 }
 
+/*
+ * Limits for tables that don't have their own, from the preferences.
+ */
+static reassembly_table_limits reassembly_default_limits;
+static unsigned reassembly_max_table_mbytes;
+static unsigned reassembly_max_age_frames;
+static unsigned reassembly_max_age_secs;
+
+static int proto_reassembly;
+static expert_field ei_reassembly_evicted;
+static expert_field ei_reassembly_evicting;
+
+/*
+ * Frames with fragments of incomplete reassemblies that were discarded
+ * because of the limits, so that they can be flagged when dissected again.
+ */
+static wmem_map_t *reassembly_evicted_frames;
+
+/*
+ * Frames in which incomplete reassemblies were discarded, with the number
+ * discarded, so that they can be flagged as soon as they're dissected,
+ * including in a single pass.
+ */
+static wmem_map_t *reassembly_evicting_frames;
+
+/*
+ * Incomplete reassemblies in a table's fragment table are kept on a list,
+ * least recently used first, and the fragment data they hold is counted
+ * in the table's statistics. Completed reassemblies (FD_DEFRAGMENTED) are
+ * never on the list, since a later pass might still need them.
+ */
+static void
+lru_remove(reassembly_table *table, fragment_head *fd_head)
+{
+	if (fd_head->lru_prev)
+		fd_head->lru_prev->lru_next = fd_head->lru_next;
+	else
+		table->lru_first = fd_head->lru_next;
+	if (fd_head->lru_next)
+		fd_head->lru_next->lru_prev = fd_head->lru_prev;
+	else
+		table->lru_last = fd_head->lru_prev;
+	fd_head->lru_prev = NULL;
+	fd_head->lru_next = NULL;
+}
+
+static void
+lru_append(reassembly_table *table, fragment_head *fd_head)
+{
+	fd_head->lru_prev = table->lru_last;
+	fd_head->lru_next = NULL;
+	if (table->lru_last)
+		table->lru_last->lru_next = fd_head;
+	else
+		table->lru_first = fd_head;
+	table->lru_last = fd_head;
+}
+
+static void
+lru_unlink(reassembly_table *table, fragment_head *fd_head)
+{
+	if (!fd_head->lru_linked)
+		return;
+
+	lru_remove(table, fd_head);
+	fd_head->lru_linked = false;
+	table->stats.entries--;
+	table->stats.bytes -= fd_head->lru_bytes;
+	fd_head->lru_bytes = 0;
+}
+
+/*
+ * Mark an incomplete reassembly as used in this frame, with "added_bytes"
+ * more bytes of fragment data. Only called on the first pass.
+ */
+static void
+lru_touch(reassembly_table *table, fragment_head *fd_head,
+	  const packet_info *pinfo, const uint32_t added_bytes)
+{
+	fragment_item *fd;
+
+	if (fd_head->table_key == NULL || (fd_head->flags & FD_DEFRAGMENTED)) {
+		lru_unlink(table, fd_head);
+		return;
+	}
+
+	if (fd_head->lru_linked) {
+		if (table->lru_last != fd_head) {
+			lru_remove(table, fd_head);
+			lru_append(table, fd_head);
+		}
+		fd_head->lru_bytes += added_bytes;
+		table->stats.bytes += added_bytes;
+	} else {
+		/* New, or no longer defragmented (partial reassembly). */
+		lru_append(table, fd_head);
+		fd_head->lru_linked = true;
+		fd_head->lru_bytes = 0;
+		for (fd = fd_head->next; fd; fd = fd->next)
+			fd_head->lru_bytes += fd->len;
+		table->stats.entries++;
+		table->stats.bytes += fd_head->lru_bytes;
+	}
+	if (table->stats.bytes > table->stats.peak_bytes)
+		table->stats.peak_bytes = table->stats.bytes;
+
+	fd_head->lru_frame = pinfo->num;
+	fd_head->lru_secs = pinfo->abs_ts.secs;
+}
+
+/*
+ * Discard an incomplete reassembly, remembering its frames.
+ */
+static void
+fragment_evict(reassembly_table *table, fragment_head *fd_head,
+	       const packet_info *pinfo)
+{
+	fragment_item *fd;
+	unsigned count;
+
+	table->stats.evictions++;
+	table->stats.evicted_bytes += fd_head->lru_bytes;
+	if (reassembly_evicted_frames) {
+		for (fd = fd_head->next; fd; fd = fd->next)
+			wmem_map_insert(reassembly_evicted_frames, GUINT_TO_POINTER(fd->frame), GUINT_TO_POINTER(1));
+	}
+	if (reassembly_evicting_frames) {
+		count = GPOINTER_TO_UINT(wmem_map_lookup(reassembly_evicting_frames, GUINT_TO_POINTER(pinfo->num)));
+		wmem_map_insert(reassembly_evicting_frames, GUINT_TO_POINTER(pinfo->num), GUINT_TO_POINTER(count + 1));
+	}
+
+	lru_unlink(table, fd_head);
+	g_hash_table_remove(table->fragment_table, fd_head->table_key);
+	free_all_fragments(NULL, fd_head, NULL);
+}
+
+/*
+ * Discard the least recently used incomplete reassemblies while the table
+ * is over its limits. Called on the first pass once the reassembly that
+ * a fragment is added to has been looked up, which marks it as used in
+ * the current frame, and before the fragment is added. Reassemblies used
+ * in the current frame are never discarded, as the dissector might still
+ * have a pointer to them.
+ */
+static void
+reassembly_table_enforce_limits(reassembly_table *table, const packet_info *pinfo)
+{
+	const reassembly_table_limits *limits;
+	fragment_head *fd_head;
+
+	limits = table->has_limits ? &table->limits : &reassembly_default_limits;
+	if (limits->max_bytes == 0 && limits->max_age_frames == 0 && limits->max_age_secs == 0)
+		return;
+
+	while ((fd_head = table->lru_first) != NULL && fd_head->lru_frame < pinfo->num) {
+		if (!(limits->max_bytes && table->stats.bytes > limits->max_bytes) &&
+		    !(limits->max_age_frames && pinfo->num - fd_head->lru_frame > limits->max_age_frames) &&
+		    !(limits->max_age_secs && pinfo->abs_ts.secs - fd_head->lru_secs > (time_t)limits->max_age_secs))
+			break;
+		fragment_evict(table, fd_head, pinfo);
+	}
+}
+
+static void
+reassembly_table_reset_stats(reassembly_table *table)
+{
+	const char *name = table->stats.name;
+
+	table->lru_first = NULL;
+	table->lru_last = NULL;
+	memset(&table->stats, 0, sizeof(table->stats));
+	table->stats.name = name;
+}
+
 typedef struct register_reassembly_table {
 	reassembly_table *table;
 	const reassembly_table_functions *funcs;
@@ -470,6 +647,7 @@ reassembly_table_init(reassembly_table *table,
 		table->persistent_key_func = funcs->persistent_key_func;
 	if (table->free_temporary_key_func == NULL)
 		table->free_temporary_key_func = funcs->free_temporary_key_func;
+	reassembly_table_reset_stats(table);
 	if (table->fragment_table != NULL) {
 		/*
 		 * The fragment hash table exists.
@@ -515,6 +693,7 @@ reassembly_table_destroy(reassembly_table *table)
 	table->temporary_key_func = NULL;
 	table->persistent_key_func = NULL;
 	table->free_temporary_key_func = NULL;
+	reassembly_table_reset_stats(table);
 	if (table->fragment_table != NULL) {
 		/*
 		 * The fragment hash table exists.
@@ -552,6 +731,26 @@ reassembly_table_destroy(reassembly_table *table)
 	}
 }
 
+void
+reassembly_table_set_limits(reassembly_table *table,
+			    const reassembly_table_limits *limits)
+{
+	if (limits) {
+		table->limits = *limits;
+		table->has_limits = true;
+	} else {
+		memset(&table->limits, 0, sizeof(table->limits));
+		table->has_limits = false;
+	}
+}
+
+void
+reassembly_table_get_stats(const reassembly_table *table,
+			   reassembly_table_stats *stats)
+{
+	*stats = table->stats;
+}
+
 /*
  * Look up an fd_head in the fragment table, optionally returning the key
  * for it.
@@ -575,6 +774,9 @@ lookup_fd_head(reassembly_table *table, const packet_info *pinfo,
 	/* Free the key */
 	table->free_temporary_key_func(key);
 
+	if (value != NULL && !pinfo->fd->visited)
+		lru_touch(table, (fragment_head *)value, pinfo, 0);
+
 	return (fragment_head *)value;
 }
 
@@ -585,6 +787,7 @@ static void *
 insert_fd_head(reassembly_table *table, fragment_head *fd_head,
 	       const packet_info *pinfo, const uint32_t id, const void *data)
 {
+	fragment_head *old_fd_head;
 	void *key;
 
 	/*
@@ -592,7 +795,24 @@ insert_fd_head(reassembly_table *table, fragment_head *fd_head,
 	 * so make a persistent version of it.
 	 */
 	key = table->persistent_key_func(pinfo, id, data);
-	g_hash_table_insert(table->fragment_table, key, fd_head);
+
+	/*
+	 * If there's already a reassembly with this key, it's no longer in
+	 * the table after this. Replace the key as well, so that the key we
+	 * return stays valid.
+	 */
+	old_fd_head = (fragment_head *)g_hash_table_lookup(table->fragment_table, key);
+	if (old_fd_head != NULL) {
+		lru_unlink(table, old_fd_head);
+		old_fd_head->table_key = NULL;
+	}
+	g_hash_table_replace(table->fragment_table, key, fd_head);
+
+	fd_head->table_key = key;
+	if (table->stats.name == NULL)
+		table->stats.name = pinfo->current_proto;
+	if (!pinfo->fd->visited)
+		lru_touch(table, fd_head, pinfo, 0);
 	return key;
 }
 
@@ -623,6 +843,7 @@ fragment_delete(reassembly_table *table, const packet_info *pinfo,
 		return NULL;
 	}
 
+	lru_unlink(table, fd_head);
 	fd_tvb_data=fd_head->tvb_data;
 	/* loop over all partial fragments and free any tvbuffs */
 	for(fd=fd_head->next;fd;){
@@ -1010,6 +1231,14 @@ fragment_set_partial_reassembly(reassembly_table *table,
 static void
 fragment_unhash(reassembly_table *table, void *key)
 {
+	fragment_head *fd_head;
+
+	fd_head = (fragment_head *)g_hash_table_lookup(table->fragment_table, key);
+	if (fd_head != NULL) {
+		lru_unlink(table, fd_head);
+		fd_head->table_key = NULL;
+	}
+
 	/*
 	 * Remove the entry from the fragment table.
 	 */
@@ -1530,6 +1759,7 @@ fragment_add_common(reassembly_table *table, tvbuff_t *tvb, const int offset,
 	fragment_head *fd_head;
 	fragment_item *fd_item;
 	bool already_added;
+	bool complete;
 
 
 	/*
@@ -1543,6 +1773,9 @@ fragment_add_common(reassembly_table *table, tvbuff_t *tvb, const int offset,
 
 	fd_head = lookup_fd_head(table, pinfo, id, data, NULL);
 
+	if (!pinfo->fd->visited)
+		reassembly_table_enforce_limits(table, pinfo);
+
 #if 0
 	/* debug output of associated fragments. */
 	/* leave it here for future debugging sessions */
@@ -1696,8 +1929,10 @@ fragment_add_common(reassembly_table *table, tvbuff_t *tvb, const int offset,
 		insert_fd_head(table, fd_head, pinfo, id, data);
 	}
 
-	if (fragment_add_work(fd_head, tvb, offset, pinfo, frag_offset,
-		frag_data_len, more_frags, frag_frame, false)) {
+	complete = fragment_add_work(fd_head, tvb, offset, pinfo, frag_offset,
+		frag_data_len, more_frags, frag_frame, false);
+	lru_touch(table, fd_head, pinfo, frag_data_len);
+	if (complete) {
 		/*
 		 * Reassembly is complete.
 		 */
@@ -1768,6 +2003,7 @@ fragment_add_check_with_fallback(reassembly_table *table, tvbuff_t *tvb, const i
 	fragment_head *fd_head;
 	void *orig_key;
 	bool late_retransmission = false;
+	bool complete;
 
 	/*
 	 * If this isn't the first pass, look for this frame in the table
@@ -1784,6 +2020,7 @@ fragment_add_check_with_fallback(reassembly_table *table, tvbuff_t *tvb, const i
 	 * the memory allocated for the original key, for example before calling g_hash_table_remove()
 	 */
 	fd_head = lookup_fd_head(table, pinfo, id, data, &orig_key);
+	reassembly_table_enforce_limits(table, pinfo);
 	if ((fd_head == NULL) && (fallback_frame != pinfo->num)) {
 		/* Check if there is completed reassembly reachable from fallback frame */
 		reass_key.frame = fallback_frame;
@@ -1818,8 +2055,10 @@ fragment_add_check_with_fallback(reassembly_table *table, tvbuff_t *tvb, const i
 		return NULL;
 	}
 
-	if (fragment_add_work(fd_head, tvb, offset, pinfo, frag_offset,
-		frag_data_len, more_frags, pinfo->num, late_retransmission)) {
+	complete = fragment_add_work(fd_head, tvb, offset, pinfo, frag_offset,
+		frag_data_len, more_frags, pinfo->num, late_retransmission);
+	lru_touch(table, fd_head, pinfo, frag_data_len);
+	if (complete) {
 		/* Nothing left to do if it was a late retransmission */
 		if (late_retransmission) {
 			return fd_head;
@@ -2193,6 +2432,7 @@ fragment_add_seq_common(reassembly_table *table, tvbuff_t *tvb,
 {
 	fragment_head *fd_head;
 	void *orig_key;
+	bool complete;
 
 	fd_head = lookup_fd_head(table, pinfo, id, data, &orig_key);
 
@@ -2207,6 +2447,8 @@ fragment_add_seq_common(reassembly_table *table, tvbuff_t *tvb,
 		}
 	}
 
+	reassembly_table_enforce_limits(table, pinfo);
+
 	if (fd_head==NULL){
 		/* not found, this must be the first snooped fragment for this
 		 * packet. Create list-head.
@@ -2264,8 +2506,10 @@ fragment_add_seq_common(reassembly_table *table, tvbuff_t *tvb,
 		}
 	}
 
-	if (fragment_add_seq_work(fd_head, tvb, offset, pinfo,
-				  frag_number, frag_data_len, more_frags)) {
+	complete = fragment_add_seq_work(fd_head, tvb, offset, pinfo,
+					 frag_number, frag_data_len, more_frags);
+	lru_touch(table, fd_head, pinfo, frag_data_len);
+	if (complete) {
 		/*
 		 * Reassembly is complete.
 		 */
@@ -2756,20 +3000,10 @@ fragment_start_seq_check(reassembly_table *table, const packet_info *pinfo,
 
 	if (fd_head == NULL) {
 		/* Create list-head. */
-		fd_head = g_slice_new(fragment_head);
-		fd_head->next = NULL;
-		fd_head->first_gap = NULL;
-		fd_head->contiguous_len = 0;
-		fd_head->frame = 0;
-		fd_head->len = 0;
-		fd_head->fragment_nr_offset = 0;
+		fd_head = new_head(FD_BLOCKSEQUENCE|FD_DATALEN_SET);
 		fd_head->datalen = tot_len;
-		fd_head->reassembled_in = 0;
-		fd_head->reas_in_layer_num = 0;
-		fd_head->flags = FD_BLOCKSEQUENCE|FD_DATALEN_SET;
-		fd_head->tvb_data = NULL;
-		fd_head->error = NULL;
 
+		reassembly_table_enforce_limits(table, pinfo);
 		insert_fd_head(table, fd_head, pinfo, id, data);
 	}
 }
@@ -2849,6 +3083,23 @@ process_reassembled_data(tvbuff_t *tvb, const int offset, packet_info *pinfo,
 	tvbuff_t *next_tvb;
 	bool update_col_info;
 	proto_item *frag_tree_item;
+	unsigned evicted;
+
+	/*
+	 * If adding a fragment in this frame made us discard incomplete
+	 * reassemblies because of the limits, say so, once per frame.
+	 */
+	if (reassembly_evicting_frames &&
+	    !p_get_proto_data(pinfo->pool, pinfo, proto_reassembly, 0)) {
+		evicted = GPOINTER_TO_UINT(wmem_map_lookup(reassembly_evicting_frames, GUINT_TO_POINTER(pinfo->num)));
+		if (evicted != 0) {
+			p_add_proto_data(pinfo->pool, pinfo, proto_reassembly, 0, GUINT_TO_POINTER(1));
+			proto_tree_add_expert_format(tree, pinfo, &ei_reassembly_evicting,
+				tvb, offset, -1,
+				"%u incomplete reassembl%s discarded while adding this fragment (reassembly limits exceeded)",
+				evicted, plurality(evicted, "y", "ies"));
+		}
+	}
 
 	if (fd_head != NULL && pinfo->num == fd_head->reassembled_in && pinfo->curr_layer_num == fd_head->reas_in_layer_num) {
 		/*
@@ -2908,6 +3159,16 @@ process_reassembled_data(tvbuff_t *tvb, const int offset, packet_info *pinfo,
 				0, 0, fd_head->reassembled_in);
 			proto_item_set_generated(fei);
 		}
+
+		/*
+		 * If the reassembly this fragment belonged to was
+		 * discarded because of the limits, say so.
+		 */
+		if (fd_head == NULL && reassembly_evicted_frames &&
+		    wmem_map_contains(reassembly_evicted_frames, GUINT_TO_POINTER(pinfo->num))) {
+			proto_tree_add_expert(tree, pinfo, &ei_reassembly_evicted,
+				tvb, offset, -1);
+		}
 	}
 	return next_tvb;
 }
@@ -3159,6 +3420,77 @@ void reassembly_tables_init(void)
 	register_cleanup_routine(&reassembly_table_cleanup_reg_tables);
 }
 
+static void
+reassembly_limits_apply(void)
+{
+	reassembly_default_limits.max_bytes = (uint64_t)reassembly_max_table_mbytes << 20;
+	reassembly_default_limits.max_age_frames = reassembly_max_age_frames;
+	reassembly_default_limits.max_age_secs = reassembly_max_age_secs;
+}
+
+void
+register_reassembly_limits(void)
+{
+	static ei_register_info ei[] = {
+		{ &ei_reassembly_evicted,
+			{ "_ws.reassembly.evicted", PI_REASSEMBLE, PI_WARN,
+			  "Incomplete reassembly discarded (reassembly limits exceeded)", EXPFILL }
+		},
+		{ &ei_reassembly_evicting,
+			{ "_ws.reassembly.evicting", PI_REASSEMBLE, PI_WARN,
+			  "Incomplete reassemblies discarded while adding this fragment (reassembly limits exceeded)", EXPFILL }
+		},
+	};
+
+	expert_module_t *expert_reassembly;
+	module_t *reassembly_module;
+
+	proto_reassembly = proto_register_protocol("Reassembly", "Reassembly", "_ws.reassembly");
+
+	expert_reassembly = expert_register_protocol(proto_reassembly);
+	expert_register_field_array(expert_reassembly, ei, array_length(ei));
+
+	/* "Reassembly" isn't really a protocol; disabling it makes no sense. */
+	proto_set_cant_toggle(proto_reassembly);
+
+	reassembly_module = prefs_register_protocol(proto_reassembly, reassembly_limits_apply);
+	prefs_register_uint_preference(reassembly_module, "max_table_size",
+	    "Maximum memory per reassembly table (MiB)",
+	    "Discard the least recently used incomplete reassemblies of a "
+	    "reassembly table when their fragments take up more than this. "
+	    "0 means no limit. Useful for long running live captures.",
+	    10, &reassembly_max_table_mbytes);
+	prefs_register_uint_preference(reassembly_module, "max_age_frames",
+	    "Maximum age of incomplete reassemblies (frames)",
+	    "Discard incomplete reassemblies that haven't received a fragment "
+	    "in this many frames. 0 means no limit.",
+	    10, &reassembly_max_age_frames);
+	prefs_register_uint_preference(reassembly_module, "max_age_seconds",
+	    "Maximum age of incomplete reassemblies (seconds)",
+	    "Discard incomplete reassemblies that haven't received a fragment "
+	    "in this many seconds of capture time. 0 means no limit.",
+	    10, &reassembly_max_age_secs);
+
+	reassembly_evicted_frames = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
+	    g_direct_hash, g_direct_equal);
+	reassembly_evicting_frames = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
+	    g_direct_hash, g_direct_equal);
+}
+
+void
+reassembly_tables_foreach_stats(reassembly_table_stats_func func,
+				void *user_data)
+{
+	for (GList *item = reassembly_table_list; item; item = item->next) {
+		register_reassembly_table_t *reg_table = (register_reassembly_table_t *)item->data;
+
+		/* Skip tables that haven't been used. */
+		if (reg_table->table->stats.name == NULL)
+			continue;
+		func(&reg_table->table->stats, user_data);
+	}
+}
+
 static void
 reassembly_table_free(void *p, void *user_data _U_)
 {
@@ -95,6 +95,17 @@ typedef struct _fragment_head {
 	 * an error, in which case it's the string for the error.
 	 */
 	const char *error;
+	/*
+	 * Bookkeeping for the reassembly table's limits and statistics;
+	 * private to reassemble.c.
+	 */
+	struct _fragment_head *lru_prev;	/**< previous incomplete reassembly, less recently used */
+	struct _fragment_head *lru_next;	/**< next incomplete reassembly, more recently used */
+	void *table_key;		/**< key in the fragment table, NULL if not in it */
+	uint32_t lru_frame;		/**< frame in which this reassembly was last used */
+	time_t lru_secs;		/**< capture time at which this reassembly was last used */
+	uint32_t lru_bytes;		/**< fragment bytes accounted to this reassembly */
+	bool lru_linked;		/**< on the table's list of incomplete reassemblies */
 } fragment_head;
 
 /*
@@ -132,6 +143,29 @@ typedef void * (*fragment_temporary_key)(const packet_info *pinfo,
 typedef void * (*fragment_persistent_key)(const packet_info *pinfo,
     const uint32_t id, const void *data);
 
+/*
+ * Limits on the incomplete reassemblies kept in a reassembly table.
+ * Once a limit is exceeded, the least recently used incomplete
+ * reassemblies are discarded. A value of 0 means no limit.
+ */
+typedef struct {
+	uint64_t max_bytes;		/* fragment data held by incomplete reassemblies */
+	uint32_t max_age_frames;	/* frames since an incomplete reassembly was last used */
+	uint32_t max_age_secs;		/* seconds since an incomplete reassembly was last used */
+} reassembly_table_limits;
+
+/*
+ * Statistics for a reassembly table, covering the current capture file.
+ */
+typedef struct {
+	const char *name;		/* protocol that first used the table, or NULL */
+	unsigned entries;		/* incomplete reassemblies */
+	uint64_t bytes;			/* fragment data held by incomplete reassemblies */
+	uint64_t peak_bytes;		/* maximum of "bytes" */
+	uint64_t evictions;		/* incomplete reassemblies discarded due to limits */
+	uint64_t evicted_bytes;		/* fragment data discarded due to limits */
+} reassembly_table_stats;
+
 /*
  * Data structure to keep track of fragments and reassemblies.
  */
@@ -141,6 +175,11 @@ typedef struct {
 	fragment_temporary_key temporary_key_func;
 	fragment_persistent_key persistent_key_func;
 	GDestroyNotify free_temporary_key_func;		/* temporary key destruction function */
+	struct _fragment_head *lru_first;	/* least recently used incomplete reassembly */
+	struct _fragment_head *lru_last;	/* most recently used incomplete reassembly */
+	reassembly_table_limits limits;		/* see reassembly_table_set_limits() */
+	bool has_limits;
+	reassembly_table_stats stats;
 } reassembly_table;
 
 /*
@@ -186,6 +225,46 @@ reassembly_table_init(reassembly_table *table,
 WS_DLL_PUBLIC void
 reassembly_table_destroy(reassembly_table *table);
 
+/*
+ * Set the limits for the incomplete reassemblies of a table, overriding
+ * the "reassembly" preferences that apply to tables without their own
+ * limits. Passing NULL reverts to the preferences.
+ *
+ * Limits are enforced on the first pass only, when a fragment is added.
+ * Each discarded reassembly is counted in the table's statistics. The
+ * frame whose fragment caused reassemblies to be discarded gets a
+ * "_ws.reassembly.evicting" expert info item from process_reassembled_data(),
+ * also on the first pass; when they are dissected again, frames whose
+ * fragments were discarded get a "_ws.reassembly.evicted" item.
+ *
+ * The fragment_add_check(), fragment_add_seq_check() and similar
+ * functions look up the reassembled table on later passes, so discarded
+ * reassemblies stay discarded. fragment_add() and fragment_add_seq()
+ * look up the fragment table instead, where a discarded reassembly
+ * is gone, and rebuild it from the fragments of the later pass; limits
+ * aren't enforced on those passes.
+ */
+WS_DLL_PUBLIC void
+reassembly_table_set_limits(reassembly_table *table,
+			    const reassembly_table_limits *limits);
+
+/*
+ * Get the statistics for a reassembly table.
+ */
+WS_DLL_PUBLIC void
+reassembly_table_get_stats(const reassembly_table *table,
+			   reassembly_table_stats *stats);
+
+/*
+ * Call a function with the statistics of each registered reassembly table.
+ */
+typedef void (*reassembly_table_stats_func)(const reassembly_table_stats *stats,
+					    void *user_data);
+
+WS_DLL_PUBLIC void
+reassembly_tables_foreach_stats(reassembly_table_stats_func func,
+				void *user_data);
+
 /*
  * This function adds a new fragment to the reassembly table
  * If this is the first fragment seen for this datagram, a new entry
@@ -557,6 +636,11 @@ show_fragment_seq_tree(fragment_head *ipfd_head, const fragment_items *fit,
  */
 extern void reassembly_tables_init(void);
 
+/* Register the pseudo-protocol with the reassembly limit preferences
+ * and expert info
+ */
+extern void register_reassembly_limits(void);
+
 /* Cleanup internal structures
  */
 extern void
@@ -3203,6 +3203,339 @@ test_fragment_add_check_duplicate_conflict(void)
         print_fragment_table();
     }
 }
+/**********************************************************************************
+ *
+ * Reassembly table limits
+ *
+ *********************************************************************************/
+
+/* Check the table statistics */
+static void
+check_reassembly_stats(unsigned entries, uint64_t bytes, uint64_t peak_bytes,
+                       uint64_t evictions, uint64_t evicted_bytes, int line)
+{
+    reassembly_table_stats stats;
+
+    reassembly_table_get_stats(&test_reassembly_table, &stats);
+    if (stats.entries != entries || stats.bytes != bytes ||
+        stats.peak_bytes != peak_bytes || stats.evictions != evictions ||
+        stats.evicted_bytes != evicted_bytes) {
+        failure = 1;
+        printf("Statistics mismatch at line %i: entries %u (%u), bytes %u (%u), peak %u (%u), "
+               "evictions %u (%u), evicted bytes %u (%u)\n", line,
+               stats.entries, entries, (unsigned)stats.bytes, (unsigned)bytes,
+               (unsigned)stats.peak_bytes, (unsigned)peak_bytes,
+               (unsigned)stats.evictions, (unsigned)evictions,
+               (unsigned)stats.evicted_bytes, (unsigned)evicted_bytes);
+        exit(1);
+    }
+}
+
+#define ASSERT_STATS(entries, bytes, peak_bytes, evictions, evicted_bytes) \
+    check_reassembly_stats(entries, bytes, peak_bytes, evictions, evicted_bytes, __LINE__)
+
+/* Look up a reassembly without marking it as used */
+static fragment_head *
+lookup_reassembly(uint32_t id)
+{
+    fragment_head *fd_head;
+
+    pinfo.fd->visited = 1;
+    fd_head = fragment_get(&test_reassembly_table, &pinfo, id, NULL);
+    pinfo.fd->visited = 0;
+    return fd_head;
+}
+
+/* When the fragment data goes over the byte limit, the least recently
+ * used incomplete reassemblies are discarded until it's under it again.
+ *
+ *    frame   id   len   (bytes before adding)
+ *    -----   --   ---
+ *      1      1    60
+ *      2      2    60
+ *      3      1    10    120 > 100: nothing older than frame 3 but 1 and 2;
+ *                        1 is the least recently used, discard it
+ *      4      3    50    60 + 10 = 70
+ *      5      4    10    120 > 100: 2 is now the least recently used
+ */
+static void
+test_reassembly_limits_bytes(void)
+{
+    reassembly_table_limits limits = { 100, 0, 0 };
+    fragment_head *fd_head;
+
+    printf("Starting test test_reassembly_limits_bytes\n");
+
+    reassembly_table_set_limits(&test_reassembly_table, &limits);
+
+    pinfo.num = 1;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 1, NULL,
+                           0, 60, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(1, 60, 60, 0, 0);
+
+    pinfo.num = 2;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 2, NULL,
+                           0, 60, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(2, 120, 120, 0, 0);
+
+    /* id 1 is the least recently used, but this fragment is added to it,
+     * so the idle id 2 is discarded instead. */
+    pinfo.num = 3;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 1, NULL,
+                           60, 10, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_EQ(1, g_hash_table_size(test_reassembly_table.fragment_table));
+    ASSERT_STATS(1, 70, 120, 1, 60);
+    ASSERT_EQ_POINTER(NULL, lookup_reassembly(2));
+    fd_head = lookup_reassembly(1);
+    ASSERT_NE_POINTER(NULL, fd_head);
+    ASSERT_EQ(1, fd_head->next->frame);
+    ASSERT_EQ(3, fd_head->next->next->frame);
+    ASSERT_EQ_POINTER(NULL, fd_head->next->next->next);
+
+    pinfo.num = 4;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 3, NULL,
+                           0, 50, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(2, 120, 120, 1, 60);
+
+    /* Now id 1 is idle and the least recently used. */
+    pinfo.num = 5;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 4, NULL,
+                           0, 10, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_EQ(2, g_hash_table_size(test_reassembly_table.fragment_table));
+    ASSERT_STATS(2, 60, 120, 2, 130);
+    ASSERT_EQ_POINTER(NULL, lookup_reassembly(1));
+    ASSERT_EQ_POINTER(NULL, lookup_reassembly(2));
+    ASSERT_NE_POINTER(NULL, lookup_reassembly(3));
+    ASSERT_NE_POINTER(NULL, lookup_reassembly(4));
+
+    reassembly_table_set_limits(&test_reassembly_table, NULL);
+}
+
+/* Incomplete reassemblies that haven't been used for more than
+ * max_age_frames frames, or max_age_secs seconds, are discarded.
+ */
+static void
+test_reassembly_limits_age(void)
+{
+    reassembly_table_limits limits = { 0, 2, 0 };
+    fragment_head *fd_head;
+
+    printf("Starting test test_reassembly_limits_age\n");
+
+    pinfo.abs_ts.secs = 0;
+    reassembly_table_set_limits(&test_reassembly_table, &limits);
+
+    pinfo.num = 1;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 1, NULL,
+                           0, 10, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+
+    pinfo.num = 2;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 2, NULL,
+                           0, 20, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(2, 30, 30, 0, 0);
+
+    /* Frame 3 is 2 frames after frame 1; that's not too old yet. */
+    pinfo.num = 3;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 3, NULL,
+                           0, 30, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(3, 60, 60, 0, 0);
+
+    /* Frame 4 is 3 frames after frame 1, and 2 after frame 2. */
+    pinfo.num = 4;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 3, NULL,
+                           30, 5, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(2, 55, 60, 1, 10);
+    ASSERT_EQ_POINTER(NULL, lookup_reassembly(1));
+    ASSERT_NE_POINTER(NULL, lookup_reassembly(2));
+
+    /* Now by capture time: ids 2 and 3 were last used at 0s. */
+    limits.max_age_frames = 0;
+    limits.max_age_secs = 60;
+    reassembly_table_set_limits(&test_reassembly_table, &limits);
+
+    pinfo.num = 5;
+    pinfo.abs_ts.secs = 50;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 3, NULL,
+                           35, 5, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(2, 60, 60, 1, 10);
+
+    /* 100s is more than 60s after id 2, but not after id 3. */
+    pinfo.num = 6;
+    pinfo.abs_ts.secs = 100;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 4, NULL,
+                           0, 5, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(2, 45, 60, 2, 30);
+    ASSERT_EQ_POINTER(NULL, lookup_reassembly(2));
+    ASSERT_NE_POINTER(NULL, lookup_reassembly(3));
+
+    pinfo.abs_ts.secs = 0;
+    reassembly_table_set_limits(&test_reassembly_table, NULL);
+}
+
+/* Reassemblies used in the current frame are never discarded, even if
+ * the table is over its limits, as the dissector may still refer to them.
+ */
+static void
+test_reassembly_limits_current_frame(void)
+{
+    reassembly_table_limits limits = { 10, 0, 0 };
+    fragment_head *fd_head;
+
+    printf("Starting test test_reassembly_limits_current_frame\n");
+
+    reassembly_table_set_limits(&test_reassembly_table, &limits);
+
+    pinfo.num = 1;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 1, NULL,
+                           0, 50, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    fd_head = fragment_add(&test_reassembly_table, tvb, 50, &pinfo, 2, NULL,
+                           0, 50, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_EQ(2, g_hash_table_size(test_reassembly_table.fragment_table));
+    ASSERT_STATS(2, 100, 100, 0, 0);
+
+    /* A reassembly last used in an earlier frame becomes current again
+     * when it's looked up. */
+    pinfo.num = 2;
+    ASSERT_NE_POINTER(NULL, fragment_get(&test_reassembly_table, &pinfo, 1, NULL));
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 3, NULL,
+                           0, 5, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(2, 55, 100, 1, 50);
+    ASSERT_NE_POINTER(NULL, lookup_reassembly(1));
+    ASSERT_EQ_POINTER(NULL, lookup_reassembly(2));
+
+    /* In the next frame, id 1 is the least recently used; discarding it
+     * is enough. */
+    pinfo.num = 3;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 4, NULL,
+                           0, 5, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_EQ(2, g_hash_table_size(test_reassembly_table.fragment_table));
+    ASSERT_STATS(2, 10, 100, 2, 100);
+    ASSERT_EQ_POINTER(NULL, lookup_reassembly(1));
+    ASSERT_NE_POINTER(NULL, lookup_reassembly(3));
+
+    reassembly_table_set_limits(&test_reassembly_table, NULL);
+}
+
+/* Completed reassemblies are not counted and never discarded, as later
+ * passes still need them.
+ */
+static void
+test_reassembly_limits_complete(void)
+{
+    reassembly_table_limits limits = { 10, 1, 0 };
+    fragment_head *fd_head, *fdh0;
+
+    printf("Starting test test_reassembly_limits_complete\n");
+
+    reassembly_table_set_limits(&test_reassembly_table, &limits);
+
+    /* Both fragments in the same frame, so the first isn't discarded. */
+    pinfo.num = 1;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 1, NULL,
+                           0, 50, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(1, 50, 50, 0, 0);
+
+    fd_head = fragment_add(&test_reassembly_table, tvb, 50, &pinfo, 1, NULL,
+                           50, 20, false);
+    ASSERT_NE_POINTER(NULL, fd_head);
+    ASSERT_EQ(FD_DEFRAGMENTED|FD_DATALEN_SET, fd_head->flags);
+    ASSERT_STATS(0, 0, 50, 0, 0);
+    fdh0 = fd_head;
+
+    pinfo.num = 3;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 2, NULL,
+                           0, 20, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(1, 20, 50, 0, 0);
+
+    /* id 2 is over both limits; id 1 is complete and stays. */
+    pinfo.num = 10;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 3, NULL,
+                           0, 5, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(1, 5, 50, 1, 20);
+    ASSERT_EQ_POINTER(fdh0, lookup_reassembly(1));
+    ASSERT_EQ_POINTER(NULL, lookup_reassembly(2));
+
+    /* Revisiting the complete reassembly still finds it. */
+    pinfo.fd->visited = 1;
+    pinfo.num = 1;
+    fd_head = fragment_add(&test_reassembly_table, tvb, 0, &pinfo, 1, NULL,
+                           0, 50, true);
+    ASSERT_EQ_POINTER(fdh0, fd_head);
+    ASSERT_EQ(1, fd_head->reassembled_in);
+    pinfo.fd->visited = 0;
+
+    reassembly_table_set_limits(&test_reassembly_table, NULL);
+}
+
+/* fragment_add_check() moves completed reassemblies to the reassembled
+ * table; the limits only look at the fragment table.
+ */
+static void
+test_reassembly_limits_check(void)
+{
+    reassembly_table_limits limits = { 10, 0, 0 };
+    fragment_head *fd_head;
+
+    printf("Starting test test_reassembly_limits_check\n");
+
+    reassembly_table_set_limits(&test_reassembly_table, &limits);
+
+    pinfo.num = 1;
+    fd_head = fragment_add_check(&test_reassembly_table, tvb, 0, &pinfo, 1, NULL,
+                                 0, 30, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    fd_head = fragment_add_check(&test_reassembly_table, tvb, 0, &pinfo, 2, NULL,
+                                 0, 30, true);
+    ASSERT_EQ_POINTER(NULL, fd_head);
+    ASSERT_STATS(2, 60, 60, 0, 0);
+
+    /* id 1 is discarded; id 2 gets its last fragment and is complete. */
+    pinfo.num = 2;
+    fd_head = fragment_add_check(&test_reassembly_table, tvb, 30, &pinfo, 2, NULL,
+                                 30, 10, false);
+    ASSERT_NE_POINTER(NULL, fd_head);
+    ASSERT_EQ(2, fd_head->reassembled_in);
+    ASSERT_STATS(0, 0, 60, 1, 30);
+    ASSERT_EQ(0, g_hash_table_size(test_reassembly_table.fragment_table));
+    ASSERT_EQ(1, g_hash_table_size(test_reassembly_table.reassembled_table));
+
+    pinfo.num = 3;
+    fd_head = fragment_add_check(&test_reassembly_table, tvb, 0, &pinfo, 4, NULL,
+                                 0, 10, false);
+    ASSERT_NE_POINTER(NULL, fd_head);
+    ASSERT_EQ(3, fd_head->reassembled_in);
+    ASSERT_EQ(0, g_hash_table_size(test_reassembly_table.fragment_table));
+    ASSERT_EQ(2, g_hash_table_size(test_reassembly_table.reassembled_table));
+    ASSERT_STATS(0, 0, 60, 1, 30);
+
+    /* Later passes find it in the reassembled table. */
+    pinfo.fd->visited = 1;
+    fd_head = fragment_add_check(&test_reassembly_table, tvb, 0, &pinfo, 4, NULL,
+                                 0, 10, false);
+    ASSERT_NE_POINTER(NULL, fd_head);
+    ASSERT_EQ(3, fd_head->reassembled_in);
+    pinfo.fd->visited = 0;
+
+    reassembly_table_set_limits(&test_reassembly_table, NULL);
+}
 /**********************************************************************************
  *
  * main
@@ -3251,6 +3584,11 @@ main(int argc _U_, char **argv _U_)
         test_fragment_add_check_duplicate_last,
 #endif
         test_fragment_add_check_duplicate_conflict,
+        test_reassembly_limits_bytes,
+        test_reassembly_limits_age,
+        test_reassembly_limits_current_frame,
+        test_reassembly_limits_complete,
+        test_reassembly_limits_check,
     };
 
     /* a tvbuff for testing with */
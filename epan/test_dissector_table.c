@@ -0,0 +1,247 @@
+/*
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include "epan.h"
+#include "packet.h"
+#include <wiretap/wtap.h>
+#include <wsutil/filesystem.h>
+#include <wsutil/report_message.h>
+
+/*
+ * Report routines that just print the message, so that this doesn't
+ * need libui for the ones in ui/failure_message.c.
+ */
+static void
+test_vreport_message(const char *msg_format, va_list ap)
+{
+    vfprintf(stderr, msg_format, ap);
+    fputc('\n', stderr);
+}
+
+static void
+test_report_open_failure(const char *filename, int err, bool for_writing)
+{
+    fprintf(stderr, "Can't open \"%s\" for %s: %s\n", filename,
+        for_writing ? "writing" : "reading", g_strerror(err));
+}
+
+static void
+test_report_read_failure(const char *filename, int err)
+{
+    fprintf(stderr, "Can't read \"%s\": %s\n", filename, g_strerror(err));
+}
+
+static void
+test_report_write_failure(const char *filename, int err)
+{
+    fprintf(stderr, "Can't write \"%s\": %s\n", filename, g_strerror(err));
+}
+
+static void
+test_report_cfile_open_failure(const char *filename, int err, char *err_info)
+{
+    fprintf(stderr, "Can't open \"%s\": error %d%s%s\n", filename, err,
+        err_info ? ", " : "", err_info ? err_info : "");
+    g_free(err_info);
+}
+
+static void
+test_report_cfile_dump_open_failure(const char *filename, int err, char *err_info,
+    int file_type_subtype _U_)
+{
+    test_report_cfile_open_failure(filename, err, err_info);
+}
+
+static void
+test_report_cfile_write_failure(const char *in_filename _U_, const char *out_filename,
+    int err, char *err_info, uint64_t framenum _U_, int file_type_subtype _U_)
+{
+    test_report_cfile_open_failure(out_filename, err, err_info);
+}
+
+static int
+test_dissect_nothing(tvbuff_t *tvb _U_, packet_info *pinfo _U_, proto_tree *tree _U_, void *data _U_)
+{
+    return 0;
+}
+
+static void
+test_dissector_table_uint(void)
+{
+    dissector_table_t table;
+    dissector_handle_t a, b, c;
+
+    table = register_dissector_table("test.uint", "Test uint table", -1, FT_UINT32, BASE_DEC);
+    a = create_dissector_handle(test_dissect_nothing, -1);
+    b = create_dissector_handle(test_dissect_nothing, -1);
+    /* dissector_delete_all() matches handles by protocol */
+    c = create_dissector_handle(test_dissect_nothing, proto_get_id_by_filter_name("data"));
+
+    /* Values on both sides of the direct index limit, added before the first lookup */
+    dissector_add_uint("test.uint", 6, a);
+    dissector_add_uint("test.uint", 65535, a);
+    dissector_add_uint("test.uint", 65536, b);
+    g_assert_true(dissector_get_uint_handle(table, 6) == a);
+    g_assert_true(dissector_get_uint_handle(table, 65535) == a);
+    g_assert_true(dissector_get_uint_handle(table, 65536) == b);
+    g_assert_null(dissector_get_uint_handle(table, 7));
+    g_assert_null(dissector_get_uint_handle(table, 0));
+    g_assert_null(dissector_get_uint_handle(table, 0xffffffff));
+
+    /* ...and after it */
+    dissector_add_uint("test.uint", 17, b);
+    dissector_add_uint("test.uint", 0x86dd, b);
+    dissector_add_uint("test.uint", 0x1000000, c);
+    g_assert_true(dissector_get_uint_handle(table, 17) == b);
+    g_assert_true(dissector_get_uint_handle(table, 0x86dd) == b);
+    g_assert_true(dissector_get_uint_handle(table, 0x1000000) == c);
+    g_assert_null(dissector_get_uint_handle(table, 0x86de));
+
+    /* Replacing an entry */
+    dissector_add_uint("test.uint", 17, c);
+    g_assert_true(dissector_get_uint_handle(table, 17) == c);
+
+    /* Decode As changes and resets */
+    dissector_change_uint("test.uint", 6, c);
+    g_assert_true(dissector_get_uint_handle(table, 6) == c);
+    g_assert_true(dissector_is_uint_changed(table, 6));
+    dissector_reset_uint("test.uint", 6);
+    g_assert_true(dissector_get_uint_handle(table, 6) == a);
+    dissector_change_uint("test.uint", 1234, a);
+    g_assert_true(dissector_get_uint_handle(table, 1234) == a);
+    dissector_reset_uint("test.uint", 1234);
+    g_assert_null(dissector_get_uint_handle(table, 1234));
+    dissector_change_uint("test.uint", 4321, a);
+    dissector_change_uint("test.uint", 4321, NULL);
+    g_assert_null(dissector_get_uint_handle(table, 4321));
+
+    /* Deleting entries */
+    dissector_delete_uint("test.uint", 0x86dd, b);
+    dissector_delete_uint("test.uint", 65536, b);
+    g_assert_null(dissector_get_uint_handle(table, 0x86dd));
+    g_assert_null(dissector_get_uint_handle(table, 65536));
+    g_assert_true(dissector_get_uint_handle(table, 65535) == a);
+
+    /* Deleting all the entries of a handle drops the index; the next lookup rebuilds it */
+    dissector_add_uint("test.uint", 80, c);
+    dissector_add_uint("test.uint", 0x2000000, c);
+    g_assert_true(dissector_get_uint_handle(table, 80) == c);
+    dissector_delete_all("test.uint", c);
+    g_assert_null(dissector_get_uint_handle(table, 17));
+    g_assert_null(dissector_get_uint_handle(table, 80));
+    g_assert_null(dissector_get_uint_handle(table, 0x1000000));
+    g_assert_null(dissector_get_uint_handle(table, 0x2000000));
+    g_assert_true(dissector_get_uint_handle(table, 6) == a);
+    g_assert_true(dissector_get_uint_handle(table, 65535) == a);
+    dissector_add_uint("test.uint", 80, b);
+    g_assert_true(dissector_get_uint_handle(table, 80) == b);
+}
+
+/*
+ * Look up the values that a TCP/IP capture would, in the tables used for
+ * them, to measure the cost of the table dispatch by itself.
+ */
+static void
+test_dissector_table_perf(void)
+{
+#define DISPATCH_PERF_ROUNDS (1000 * 1000)
+    static const uint32_t ethertypes[] = { 0x0800, 0x86dd, 0x0806, 0x8100 };
+    static const uint32_t ip_protos[] = { 6, 17, 1, 58 };
+    static const uint32_t ports[] = { 443, 53, 80, 123, 5353, 8080, 51234, 61000 };
+    dissector_table_t ethertype, ip_proto, tcp_port, udp_port;
+    unsigned found = 0;
+    double elapsed;
+
+    ethertype = find_dissector_table("ethertype");
+    ip_proto = find_dissector_table("ip.proto");
+    tcp_port = find_dissector_table("tcp.port");
+    udp_port = find_dissector_table("udp.port");
+    g_assert_nonnull(ethertype);
+    g_assert_nonnull(ip_proto);
+    g_assert_nonnull(tcp_port);
+    g_assert_nonnull(udp_port);
+
+    g_test_timer_start();
+    for (unsigned i = 0; i < DISPATCH_PERF_ROUNDS; i++) {
+        found += dissector_get_uint_handle(ethertype, ethertypes[i % G_N_ELEMENTS(ethertypes)]) != NULL;
+        found += dissector_get_uint_handle(ip_proto, ip_protos[i % G_N_ELEMENTS(ip_protos)]) != NULL;
+        found += dissector_get_uint_handle(tcp_port, ports[i % G_N_ELEMENTS(ports)]) != NULL;
+        found += dissector_get_uint_handle(udp_port, ports[(i + 1) % G_N_ELEMENTS(ports)]) != NULL;
+    }
+    elapsed = g_test_timer_elapsed();
+    g_test_minimized_result(elapsed * 1e9 / (4.0 * DISPATCH_PERF_ROUNDS),
+        "uint dissector table lookup: %.1f ns (%u of %u found)",
+        elapsed * 1e9 / (4.0 * DISPATCH_PERF_ROUNDS), found, 4 * DISPATCH_PERF_ROUNDS);
+    g_assert_cmpuint(found, >, 0);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    char *configuration_init_error;
+    static const struct report_message_routines test_report_routines = {
+        test_vreport_message,
+        test_vreport_message,
+        test_report_open_failure,
+        test_report_read_failure,
+        test_report_write_failure,
+        test_report_cfile_open_failure,
+        test_report_cfile_dump_open_failure,
+        test_report_cfile_open_failure,
+        test_report_cfile_write_failure,
+        test_report_cfile_open_failure
+    };
+
+    ws_log_init("test_dissector_table", NULL);
+
+    g_test_init(&argc, &argv, NULL);
+
+    configuration_init_error = configuration_init(argv[0], NULL);
+    if (configuration_init_error != NULL) {
+        fprintf(stderr, "Error: Can't get pathname of directory containing "
+                        "the test_dissector_table program: %s.\n",
+            configuration_init_error);
+        g_free(configuration_init_error);
+    }
+
+    init_report_message("test_dissector_table", &test_report_routines);
+
+    wtap_init(false);
+    if (!epan_init(NULL, NULL, false))
+        return 2;
+
+    g_test_add_func("/dissector_table/uint", test_dissector_table_uint);
+
+    if (g_test_perf()) {
+        g_test_add_func("/dissector_table/perf", test_dissector_table_perf);
+    }
+
+    ret = g_test_run();
+
+    epan_cleanup();
+    wtap_cleanup();
+
+    return ret;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
@@ -235,7 +235,8 @@ ws_epan_new(capture_file *cf)
         cap_file_provider_get_frame_ts,
         cap_file_provider_get_interface_name,
         cap_file_provider_get_interface_description,
-        cap_file_provider_get_modified_block
+        cap_file_provider_get_modified_block,
+        cap_file_provider_get_shift_offset
     };
 
     return epan_new(&cf->provider, &funcs);
@@ -400,6 +401,10 @@ cf_close(capture_file *cf)
         g_tree_destroy(cf->provider.frames_modified_blocks);
         cf->provider.frames_modified_blocks = NULL;
     }
+    if (cf->provider.frames_shift_offsets) {
+        g_tree_destroy(cf->provider.frames_shift_offsets);
+        cf->provider.frames_shift_offsets = NULL;
+    }
     cf_unselect_packet(cf);   /* nothing to select */
     cf->first_displayed = 0;
     cf->last_displayed = 0;
@@ -608,6 +613,16 @@ cf_read(capture_file *cf, bool reloading)
     wtap_rec_init(&rec);
     ws_buffer_init(&buf, 1514);
 
+    /*
+     * XXX - this reads, and dissects, every record in the file, even if
+     * we've opened the same file before.  Persisting the frame_data
+     * sequence (offsets, lengths, time stamps, cumulative byte counts)
+     * and the wiretap fast-seek points in a sidecar index would only
+     * save the reading part: the first pass dissection done by
+     * add_packet_to_packet_list() is what builds the conversation,
+     * reassembly and other per-frame state that later random-access
+     * dissections depend on, so it can't be skipped on reopen.
+     */
     TRY {
         int64_t file_pos;
         int64_t data_offset;
@@ -1226,43 +1241,54 @@ add_packet_to_packet_list(frame_data *fdata, capture_file *cf,
             &cf->provider.ref, cf->provider.prev_dis);
     cf->provider.prev_cap = fdata;
 
-    if (dfcode != NULL) {
-        epan_dissect_prime_with_dfilter(edt, dfcode);
-    }
+    if (edt == NULL) {
+        /* Nothing needs this frame dissected (see rescan_packets());
+           with no display filter, it's displayed unless a dissector
+           hid it when it was dissected. */
+        ws_assert(dfcode == NULL);
+        fdata->passed_dfilter = fdata->hidden_by_dissector ? 0 : 1;
+    } else {
+        if (dfcode != NULL) {
+            epan_dissect_prime_with_dfilter(edt, dfcode);
+        }
 #if 0
-    /* Prepare coloring rules, this ensures that display filter rules containing
-     * frame.color_rule references are still processed.
-     * TODO: actually detect that situation or maybe apply other optimizations? */
-    if (edt->tree && color_filters_used()) {
-        color_filters_prime_edt(edt);
-        fdata->need_colorize = 1;
-    }
+        /* Prepare coloring rules, this ensures that display filter rules containing
+         * frame.color_rule references are still processed.
+         * TODO: actually detect that situation or maybe apply other optimizations? */
+        if (edt->tree && color_filters_used()) {
+            color_filters_prime_edt(edt);
+            fdata->need_colorize = 1;
+        }
 #endif
 
-    if (!fdata->visited) {
-        /* This is the first pass, so prime the epan_dissect_t with the
-           hfids postdissectors want on the first pass. */
-        prime_epan_dissect_with_postdissector_wanted_hfids(edt);
-    }
+        if (!fdata->visited) {
+            /* This is the first pass, so prime the epan_dissect_t with the
+               hfids postdissectors want on the first pass. */
+            prime_epan_dissect_with_postdissector_wanted_hfids(edt);
+        }
 
-    /* Initialize passed_dfilter here so that dissectors can hide packets. */
-    /* XXX We might want to add a separate "visible" bit to frame_data instead. */
-    fdata->passed_dfilter = 1;
+        /* Initialize passed_dfilter here so that dissectors can hide packets. */
+        /* XXX We might want to add a separate "visible" bit to frame_data instead. */
+        fdata->passed_dfilter = 1;
 
-    /* Dissect the frame. */
-    epan_dissect_run_with_taps(edt, cf->cd_t, rec,
-            frame_tvbuff_new_buffer(&cf->provider, fdata, buf),
-            fdata, cinfo);
+        /* Dissect the frame. */
+        epan_dissect_run_with_taps(edt, cf->cd_t, rec,
+                frame_tvbuff_new_buffer(&cf->provider, fdata, buf),
+                fdata, cinfo);
 
-    if (fdata->passed_dfilter && dfcode != NULL) {
-        fdata->passed_dfilter = dfilter_apply_edt(dfcode, edt) ? 1 : 0;
+        /* Remember if a dissector hid it, for when we don't dissect it. */
+        fdata->hidden_by_dissector = fdata->passed_dfilter ? 0 : 1;
 
-        if (fdata->passed_dfilter && edt->pi.fd->dependent_frames) {
-            /* This frame passed the display filter but it may depend on other
-             * (potentially not displayed) frames.  Find those frames and mark them
-             * as depended upon.
-             */
-            g_hash_table_foreach(edt->pi.fd->dependent_frames, find_and_mark_frame_depended_upon, cf->provider.frames);
+        if (fdata->passed_dfilter && dfcode != NULL) {
+            fdata->passed_dfilter = dfilter_apply_edt(dfcode, edt) ? 1 : 0;
+
+            if (fdata->passed_dfilter && edt->pi.fd->dependent_frames) {
+                /* This frame passed the display filter but it may depend on other
+                 * (potentially not displayed) frames.  Find those frames and mark them
+                 * as depended upon.
+                 */
+                g_hash_table_foreach(edt->pi.fd->dependent_frames, find_and_mark_frame_depended_upon, cf->provider.frames);
+            }
         }
     }
 
@@ -1296,7 +1322,8 @@ add_packet_to_packet_list(frame_data *fdata, capture_file *cf,
         cf->last_displayed = fdata->num;
     }
 
-    epan_dissect_reset(edt);
+    if (edt != NULL)
+        epan_dissect_reset(edt);
 }
 
 /*
@@ -1688,6 +1715,7 @@ rescan_packets(capture_file *cf, const char *action, const char *action_item, bo
     bool        filtering_tap_listeners = false;
     unsigned    tap_flags;
     bool        add_to_packet_list = false;
+    bool        need_dissection;
     bool        compiled _U_;
     uint32_t    frames_count;
     rescan_type queued_rescan_type = RESCAN_NONE;
@@ -1858,6 +1886,15 @@ rescan_packets(capture_file *cf, const char *action, const char *action_item, bo
 
     epan_dissect_init(&edt, cf->epan, create_proto_tree, false);
 
+    /*
+     * If we're only refiltering, there's no display filter (i.e. it's
+     * being cleared), and no tap listener needs the packets, every frame
+     * is displayed, and we don't have to read or dissect any of them;
+     * this is the same test TShark uses to decide whether to dissect.
+     */
+    need_dissection = redissect || cf->dfcode != NULL ||
+        tap_listeners_require_dissection();
+
     if (redissect) {
         /*
          * Decryption secrets and name resolution blocks are read while
@@ -1945,7 +1982,7 @@ rescan_packets(capture_file *cf, const char *action, const char *action_item, bo
         /* Frame dependencies from the previous dissection/filtering are no longer valid. */
         fdata->dependent_of_displayed = 0;
 
-        if (!cf_read_record(cf, fdata, &rec, &buf))
+        if (need_dissection && !cf_read_record(cf, fdata, &rec, &buf))
             break; /* error reading the frame */
 
         /* If the previous frame is displayed, and we haven't yet seen the
@@ -1956,8 +1993,8 @@ rescan_packets(capture_file *cf, const char *action, const char *action_item, bo
             preceding_frame = prev_frame;
         }
 
-        add_packet_to_packet_list(fdata, cf, &edt, cf->dfcode,
-                cinfo, &rec, &buf,
+        add_packet_to_packet_list(fdata, cf, need_dissection ? &edt : NULL,
+                cf->dfcode, cinfo, &rec, &buf,
                 add_to_packet_list);
 
         /* If this frame is displayed, and this is the first frame we've
@@ -5245,9 +5282,12 @@ save_record(capture_file *cf, frame_data *fdata, wtap_rec *rec,
     new_rec.block  = pkt_block;
     new_rec.block_was_modified = fdata->has_modified_block ? true : false;
 
-    if (!nstime_is_zero(&fdata->shift_offset)) {
+    if (fdata->has_shift_offset) {
         if (new_rec.presence_flags & WTAP_HAS_TS) {
-            nstime_add(&new_rec.ts, &fdata->shift_offset);
+            nstime_t shift_offset;
+
+            cap_file_provider_get_shift_offset(&cf->provider, fdata, &shift_offset);
+            nstime_add(&new_rec.ts, &shift_offset);
         }
     }
 
@@ -5270,7 +5310,9 @@ save_record(capture_file *cf, frame_data *fdata, wtap_rec *rec,
      * If we're exporting to a different file, then don't do that.
      */
     if (!args->export && new_rec.presence_flags & WTAP_HAS_TS) {
-        nstime_set_zero(&fdata->shift_offset);
+        nstime_t shift_offset = NSTIME_INIT_ZERO;
+
+        cap_file_provider_set_shift_offset(&cf->provider, fdata, &shift_offset);
     }
 
     return true;
@@ -113,3 +113,36 @@ cap_file_provider_set_modified_block(struct packet_provider_data *prov, frame_da
 
   fd->has_modified_block = 1;
 }
+
+void
+cap_file_provider_get_shift_offset(struct packet_provider_data *prov, const frame_data *fd, nstime_t *shift_offset)
+{
+  const nstime_t *offset = NULL;
+
+  if (fd->has_shift_offset && prov->frames_shift_offsets)
+    offset = (const nstime_t *)g_tree_lookup(prov->frames_shift_offsets, fd);
+
+  if (offset)
+    *shift_offset = *offset;
+  else
+    nstime_set_zero(shift_offset);
+}
+
+void
+cap_file_provider_set_shift_offset(struct packet_provider_data *prov, frame_data *fd, const nstime_t *shift_offset)
+{
+  if (nstime_is_zero(shift_offset)) {
+    /* Most frames are never shifted; don't keep entries for them. */
+    if (fd->has_shift_offset && prov->frames_shift_offsets)
+      g_tree_remove(prov->frames_shift_offsets, fd);
+    fd->has_shift_offset = 0;
+    return;
+  }
+
+  if (!prov->frames_shift_offsets)
+    prov->frames_shift_offsets = g_tree_new_full(frame_cmp, NULL, NULL, g_free);
+
+  g_tree_replace(prov->frames_shift_offsets, fd, g_memdup2(shift_offset, sizeof *shift_offset));
+
+  fd->has_shift_offset = 1;
+}
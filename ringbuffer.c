@@ -52,6 +52,7 @@
 #endif
 
 #include "ringbuffer.h"
+#include "writecap/async_writer.h"
 #include <wsutil/array.h>
 #include <wsutil/file_util.h>
 
@@ -67,6 +68,35 @@ typedef z_stream zlib_stream;
 #endif /* HAVE_ZLIB */
 #endif
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+/* ZSTD_compressStream2() was added in zstd 1.4.0. */
+#if ZSTD_VERSION_NUMBER >= 10400
+#define HAVE_ZSTD_COMPRESSSTREAM2
+#endif
+#endif
+
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+#include <fcntl.h>
+
+/* Size of the pipe between the capture and the compressor, where we can set it */
+#define RINGBUF_ZSTD_PIPE_SIZE  (1024 * 1024)
+
+/*
+ * A thread compressing one ringbuffer file. The capture is written to
+ * a pipe, and the thread reads it and writes a zstd stream to the file,
+ * so the uncompressed data never reaches the disk.
+ */
+typedef struct _rb_zstd_stream {
+    GThread      *thread;
+    int           in_fd;               /**< Read end of the pipe */
+    int           out_fd;              /**< The ringbuffer file */
+    int           level;
+    int           threads;
+    int           err;                 /**< errno value if compression failed */
+} rb_zstd_stream;
+#endif
+
 /* Ringbuffer file structure */
 typedef struct _rb_file {
     char          *name;
@@ -87,9 +117,17 @@ typedef struct _ringbuf_data {
     int           fd;                  /**< Current ringbuffer file descriptor */
     FILE         *pdh;
     char         *io_buffer;              /**< The IO buffer used to write to the file */
+    size_t        write_buffer_size;   /**< If non-zero, write through an async_writer with buffers this large */
+    bool          direct_io;           /**< Use direct I/O with the async_writer */
+    async_writer *writer;              /**< The async_writer of the current file, if any */
     bool          group_read_access;   /**< true if files need to be opened with group read access */
     FILE         *name_h;              /**< write names of completed files to this handle */
     char         *compress_type;       /**< compress type */
+    int           compress_level;      /**< zstd compression level */
+    int           compress_threads;    /**< zstd worker threads */
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+    rb_zstd_stream *zstd_stream;       /**< Compressor of the current file */
+#endif
 
     GMutex        mutex;               /**< mutex for oldnames */
     char         *oldnames[MAX_FILENAME_QUEUE];       /**< filename list of pending to be deleted */
@@ -216,6 +254,155 @@ ringbuf_start_compress_file(rb_file* rfile)
 }
 #endif
 
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+static bool
+ringbuf_write_all(int fd, const uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t nwritten = ws_write(fd, buf, (unsigned int)MIN(len, G_MAXINT));
+
+        if (nwritten < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buf += nwritten;
+        len -= nwritten;
+    }
+    return true;
+}
+
+/*
+ * thread to compress the data written to a ringbuffer file
+ */
+static void*
+ringbuf_zstd_thread(void* arg)
+{
+    rb_zstd_stream *zs = (rb_zstd_stream *)arg;
+    size_t     in_size = ZSTD_CStreamInSize();
+    size_t     out_size = ZSTD_CStreamOutSize();
+    uint8_t   *in_buf = (uint8_t *)g_malloc(in_size);
+    uint8_t   *out_buf = (uint8_t *)g_malloc(out_size);
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ssize_t    nread;
+
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, zs->level);
+    /* This fails, and we compress in this thread, if libzstd has no thread support. */
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, zs->threads);
+
+    for (;;) {
+        ZSTD_EndDirective mode;
+        ZSTD_inBuffer input;
+        bool finished;
+
+        nread = ws_read(zs->in_fd, in_buf, (unsigned int)in_size);
+        if (nread < 0) {
+            if (errno == EINTR)
+                continue;
+            if (zs->err == 0)
+                zs->err = errno;
+            break;
+        }
+        if (zs->err != 0) {
+            /* Keep draining the pipe so that the capture doesn't block. */
+            if (nread == 0)
+                break;
+            continue;
+        }
+
+        mode = nread == 0 ? ZSTD_e_end : ZSTD_e_continue;
+        input.src = in_buf;
+        input.size = (size_t)nread;
+        input.pos = 0;
+        do {
+            ZSTD_outBuffer output = { out_buf, out_size, 0 };
+            size_t remaining = ZSTD_compressStream2(cctx, &output, &input, mode);
+
+            if (ZSTD_isError(remaining)) {
+                zs->err = EIO;
+                break;
+            }
+            if (!ringbuf_write_all(zs->out_fd, out_buf, output.pos)) {
+                zs->err = errno;
+                break;
+            }
+            finished = (mode == ZSTD_e_end) ? (remaining == 0) : (input.pos == input.size);
+        } while (!finished);
+
+        if (nread == 0)
+            break;
+    }
+
+    ws_close(zs->in_fd);
+    if (ws_close(zs->out_fd) != 0 && zs->err == 0) {
+        zs->err = errno;
+    }
+    ZSTD_freeCCtx(cctx);
+    g_free(in_buf);
+    g_free(out_buf);
+    return NULL;
+}
+
+/*
+ * start a thread to compress everything written to the returned
+ * descriptor into out_fd
+ */
+static int
+ringbuf_zstd_start(int out_fd, int *err)
+{
+    rb_zstd_stream *zs;
+    int fds[2];
+
+#ifdef _WIN32
+    if (_pipe(fds, RINGBUF_ZSTD_PIPE_SIZE, O_BINARY) != 0) {
+#else
+    if (pipe(fds) != 0) {
+#endif
+        if (err != NULL)
+            *err = errno;
+        ws_close(out_fd);
+        return -1;
+    }
+#ifdef F_SETPIPE_SZ
+    /* Failing is harmless; the capture just waits for the compressor more often. */
+    fcntl(fds[1], F_SETPIPE_SZ, RINGBUF_ZSTD_PIPE_SIZE);
+#endif
+
+    zs = g_new0(rb_zstd_stream, 1);
+    zs->in_fd = fds[0];
+    zs->out_fd = out_fd;
+    zs->level = rb_data.compress_level;
+    zs->threads = rb_data.compress_threads;
+    zs->thread = g_thread_new("ringbuf_zstd", &ringbuf_zstd_thread, zs);
+    rb_data.zstd_stream = zs;
+    return fds[1];
+}
+
+/*
+ * wait for a compressor to finish; the write end of its pipe must have
+ * been closed
+ */
+static bool
+ringbuf_zstd_finish(rb_zstd_stream **zsp, int *err)
+{
+    rb_zstd_stream *zs = *zsp;
+    bool ok = true;
+
+    if (zs == NULL)
+        return true;
+
+    g_thread_join(zs->thread);
+    if (zs->err != 0) {
+        if (err != NULL)
+            *err = zs->err;
+        ok = false;
+    }
+    g_free(zs);
+    *zsp = NULL;
+    return ok;
+}
+#endif /* HAVE_ZSTD_COMPRESSSTREAM2 */
+
 /*
  * create the next filename and open a new binary file with that name
  */
@@ -270,6 +457,12 @@ ringbuf_open_file(rb_file *rfile, int *err)
         *err = errno;
     }
 
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+    if (rb_data.fd != -1 && rb_data.compress_type != NULL && strcmp(rb_data.compress_type, "zstd") == 0) {
+        rb_data.fd = ringbuf_zstd_start(rb_data.fd, err);
+    }
+#endif
+
     return rb_data.fd;
 }
 
@@ -278,11 +471,13 @@ ringbuf_open_file(rb_file *rfile, int *err)
  */
 int
 ringbuf_init(const char *capfile_name, unsigned num_files, bool group_read_access,
-        char *compress_type, bool has_nametimenum)
+        char *compress_type, int compress_level, int compress_threads,
+        bool has_nametimenum)
 {
     unsigned int i;
     char        *pfx;
     char        *dir_name, *base_name;
+    bool         zst_suffix = false;
 
     rb_data.files = NULL;
     rb_data.curr_file_num = 0;
@@ -293,9 +488,12 @@ ringbuf_init(const char *capfile_name, unsigned num_files, bool group_read_acces
     rb_data.fd = -1;
     rb_data.pdh = NULL;
     rb_data.io_buffer = NULL;
+    rb_data.writer = NULL;
     rb_data.group_read_access = group_read_access;
     rb_data.name_h = NULL;
     rb_data.compress_type = compress_type;
+    rb_data.compress_level = compress_level;
+    rb_data.compress_threads = compress_threads;
     g_mutex_init(&rb_data.mutex);
 
     /* just to be sure ... */
@@ -316,28 +514,44 @@ ringbuf_init(const char *capfile_name, unsigned num_files, bool group_read_acces
     base_name = g_path_get_basename(capfile_name);
     dir_name = g_path_get_dirname(capfile_name);
     pfx = strrchr(base_name, '.');
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+    if (pfx != NULL && compress_type != NULL && strcmp(compress_type, "zstd") == 0 &&
+        strcmp(pfx, ".zst") == 0) {
+        /* We add the compression suffix after the file type suffix ourselves. */
+        pfx[0] = '\0';
+        pfx = strrchr(base_name, '.');
+        zst_suffix = true;
+    }
+#endif
     if (pfx != NULL) {
         /* The basename has a "." in it.
 
            Treat it as a separator between the rest of the file name and
            the file name suffix, and arrange that the names given to the
            ring buffer files have the specified suffix, i.e. put the
-           changing part of the name *before* the suffix.
-
-           XXX - If we ever handle writing compressed files directly
-           (#19159) make sure we deal with any compression suffix
-           appropriately. */
+           changing part of the name *before* the suffix. */
         pfx[0] = '\0';
         rb_data.fprefix = g_build_filename(dir_name, base_name, NULL);
         pfx[0] = '.'; /* restore capfile_name */
         rb_data.fsuffix = g_strdup(pfx);
     } else {
         /* The last component has no suffix. */
-        rb_data.fprefix = g_strdup(capfile_name);
+        if (zst_suffix) {
+            rb_data.fprefix = g_build_filename(dir_name, base_name, NULL);
+        } else {
+            rb_data.fprefix = g_strdup(capfile_name);
+        }
         rb_data.fsuffix = NULL;
     }
     g_free(dir_name);
     g_free(base_name);
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+    if (compress_type != NULL && strcmp(compress_type, "zstd") == 0) {
+        char *fsuffix = g_strconcat(rb_data.fsuffix ? rb_data.fsuffix : "", ".zst", NULL);
+        g_free(rb_data.fsuffix);
+        rb_data.fsuffix = fsuffix;
+    }
+#endif
 
     /* allocate rb_file structures (only one if unlimited since there is no
        need to save all file names in that case) */
@@ -410,12 +624,39 @@ ringbuf_current_filename(void)
     return rb_data.files[rb_data.curr_file_num % rb_data.num_files].name;
 }
 
+/*
+ * Write the ringbuffer files through an async_writer
+ */
+void
+ringbuf_set_async_writer(size_t buffer_size, bool direct_io)
+{
+    rb_data.write_buffer_size = buffer_size;
+    rb_data.direct_io = direct_io;
+}
+
+async_writer *
+ringbuf_async_writer(void)
+{
+    return rb_data.writer;
+}
+
 /*
  * Calls ws_fdopen() for the current ringbuffer file
  */
 FILE *
 ringbuf_init_libpcap_fdopen(int *err)
 {
+    if (rb_data.write_buffer_size != 0) {
+        int open_err = 0;
+
+        rb_data.pdh = async_writer_fdopen(rb_data.fd, rb_data.write_buffer_size,
+                                          rb_data.direct_io, &rb_data.writer, &open_err);
+        if (rb_data.pdh == NULL && err != NULL) {
+            *err = open_err;
+        }
+        return rb_data.pdh;
+    }
+
     rb_data.pdh = ws_fdopen(rb_data.fd, "wb");
     if (rb_data.pdh == NULL) {
         if (err != NULL) {
@@ -457,6 +698,7 @@ ringbuf_switch_file(FILE **pdh, char **save_file, int *save_file_fd, int *err)
         }
         ws_close(rb_data.fd);  /* XXX - the above should have closed this already */
         rb_data.pdh = NULL;    /* it's still closed, we just got an error while closing */
+        rb_data.writer = NULL;
         rb_data.fd = -1;
         g_free(rb_data.io_buffer);
         rb_data.io_buffer = NULL;
@@ -464,8 +706,20 @@ ringbuf_switch_file(FILE **pdh, char **save_file, int *save_file_fd, int *err)
     }
 
     rb_data.pdh = NULL;
+    rb_data.writer = NULL;
     rb_data.fd  = -1;
 
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+    /*
+     * Closing the file closed the compressor's pipe; wait for it to
+     * write the end of the zstd stream, so that the file is complete
+     * before we report it as such.
+     */
+    if (!ringbuf_zstd_finish(&rb_data.zstd_stream, err)) {
+        return false;
+    }
+#endif
+
     if (rb_data.name_h != NULL) {
         fprintf(rb_data.name_h, "%s\n", ringbuf_current_filename());
         fflush(rb_data.name_h);
@@ -511,12 +765,19 @@ ringbuf_libpcap_dump_close(char **save_file, int *err)
             ret_val = false;
         }
         rb_data.pdh = NULL;
+        rb_data.writer = NULL;
         rb_data.fd  = -1;
         g_free(rb_data.io_buffer);
         rb_data.io_buffer = NULL;
 
     }
 
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+    if (!ringbuf_zstd_finish(&rb_data.zstd_stream, err)) {
+        ret_val = false;
+    }
+#endif
+
     if (rb_data.name_h != NULL) {
         fprintf(rb_data.name_h, "%s\n", ringbuf_current_filename());
         fflush(rb_data.name_h);
@@ -575,6 +836,7 @@ ringbuf_error_cleanup(void)
             rb_data.fd = -1;
         }
         rb_data.pdh = NULL;
+        rb_data.writer = NULL;
     }
 
     /* close directly if still open */
@@ -583,6 +845,10 @@ ringbuf_error_cleanup(void)
         rb_data.fd = -1;
     }
 
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+    ringbuf_zstd_finish(&rb_data.zstd_stream, NULL);
+#endif
+
     if (rb_data.files != NULL) {
         for (i=0; i < rb_data.num_files; i++) {
             if (rb_data.files[i].name != NULL) {
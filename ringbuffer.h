@@ -14,6 +14,7 @@
 
 #include <stdio.h>
 #include "wiretap/wtap.h"
+#include "writecap/async_writer.h"
 
 #define RINGBUFFER_UNLIMITED_FILES 0
 /* Minimum number of ringbuffer files */
@@ -25,9 +26,11 @@
 #define RINGBUFFER_WARN_NUM_FILES 65535
 
 int ringbuf_init(const char *capture_name, unsigned num_files, bool group_read_access, char* compress_type,
-                 bool nametimenum);
+                 int compress_level, int compress_threads, bool nametimenum);
 bool ringbuf_is_initialized(void);
 const char *ringbuf_current_filename(void);
+void ringbuf_set_async_writer(size_t buffer_size, bool direct_io);
+async_writer *ringbuf_async_writer(void);
 FILE *ringbuf_init_libpcap_fdopen(int *err);
 bool ringbuf_switch_file(FILE **pdh, char **save_file, int *save_file_fd,
                              int *err);
@@ -40,6 +40,8 @@
 #include <wsutil/strtoi.h>
 #include <wsutil/version_info.h>
 
+#include <epan/proto.h>
+
 #include "sharkd.h"
 
 #ifdef _WIN32
@@ -368,6 +370,15 @@ sharkd_loop(int argc _U_, char* argv[])
         return sharkd_session_main(mode);
     }
 
+#ifndef _WIN32
+    /* Sessions are forked from this process after epan_init() and the
+     * preferences have been loaded, so the dissector registrations, field
+     * tables and preferences are shared copy-on-write between them.  Do
+     * the lazily-deferred registration of prefixed fields here, once,
+     * rather than in every session that looks up a field by name. */
+    proto_initialize_all_prefixes();
+#endif
+
     while (1)
     {
 #ifndef _WIN32
@@ -389,7 +400,8 @@ sharkd_loop(int argc _U_, char* argv[])
             continue;
         }
 
-        /* wireshark is not ready for handling multiple capture files in single process, so fork(), and handle it in separate process */
+        /* wireshark is not ready for handling multiple capture files in single process, so fork(), and handle it in separate process.
+         * The child starts with epan already initialized, see above. */
 #ifndef _WIN32
         pid = fork();
         if (pid == 0)
@@ -119,6 +119,11 @@ def cmd_tshark(program):
     return program('tshark')
 
 
+@pytest.fixture(scope='session')
+def cmd_reordercap(program):
+    return program('reordercap')
+
+
 @pytest.fixture(scope='session')
 def cmd_text2pcap(program):
     return program('text2pcap')
@@ -183,6 +188,7 @@ def features(cmd_tshark, make_env):
         have_pkcs11='and PKCS #11 support' in tshark_v,
         have_brotli='with brotli' in tshark_v,
         have_zstd='with Zstandard' in tshark_v,
+        have_lz4='with LZ4' in tshark_v,
         have_plugins='binary plugins supported' in tshark_v,
     )
 
@@ -304,6 +304,62 @@ def check_dumpcap_ringbuffer_stdin(cmd_dumpcap, cmd_capinfos, result_file):
     return check_dumpcap_ringbuffer_stdin_real
 
 
+@pytest.fixture
+def check_dumpcap_write_buffer_stdin(cmd_dumpcap, cmd_tshark, cmd_capinfos, result_file):
+    if sys.platform == 'win32':
+        pytest.skip('--write-buffer is not supported on Windows.')
+    if sysconfig.get_platform().startswith('mingw'):
+        pytest.skip('FIXME Pipes are broken with the MSYS2 shell')
+
+    def packet_dump(cap_file, env):
+        return subprocess.check_output((cmd_tshark, '-r', cap_file, '-x'), encoding='utf-8', env=env)
+
+    def check_dumpcap_write_buffer_stdin_real(self, to_pipe=False, env=None):
+        # Similar to check_dumpcap_autostop_stdin.
+        cat100_dhcp_cmd = cat_dhcp_command('cat100')
+        cmd_ = '"{}"'.format(cmd_dumpcap)
+        baseline_file = result_file('baseline.pcapng')
+        testout_file = result_file(testout_pcapng)
+
+        subprocesstest.check_run(cat100_dhcp_cmd + ' | ' + ' '.join((cmd_,
+            '-i', '-',
+            '-w', baseline_file,
+        )), shell=True, env=env)
+
+        if to_pipe:
+            # The write buffer isn't used for pipes; a reader that can't
+            # keep up must still get every packet.
+            capture_proc = subprocess.Popen(cat100_dhcp_cmd + ' | ' + ' '.join((cmd_,
+                '-i', '-',
+                '-w', '-',
+                '--write-buffer', '1',
+            )), shell=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE, env=env)
+            with open(testout_file, 'wb') as f:
+                while True:
+                    data = capture_proc.stdout.read(4096)
+                    if not data:
+                        break
+                    f.write(data)
+                    time.sleep(0.01)
+            stderr = capture_proc.stderr.read().decode('utf-8', 'replace')
+            assert capture_proc.wait() == 0
+            assert not grep_output(stderr, 'Write buffer:')
+        else:
+            capture_proc = subprocesstest.check_run(cat100_dhcp_cmd + ' | ' + ' '.join((cmd_,
+                '-i', '-',
+                '-w', testout_file,
+                '--write-buffer', '1',
+            )), shell=True, capture_output=True, env=env)
+            # Everything went through the writer thread, and how often the
+            # capture had to wait for it is reported.
+            assert grep_output(capture_proc.stderr,
+                r'Write buffer: \d+ bytes written, capture waited for the disk \d+ times?')
+
+        check_packet_count(cmd_capinfos, 100, testout_file)
+        assert packet_dump(testout_file, env) == packet_dump(baseline_file, env)
+    return check_dumpcap_write_buffer_stdin_real
+
+
 @pytest.fixture
 def check_dumpcap_pcapng_sections(cmd_dumpcap, cmd_tshark, cmd_capinfos, capture_file, result_file):
     if sys.platform == 'win32':
@@ -574,6 +630,16 @@ class TestDumpcapRingbuffer:
         check_dumpcap_ringbuffer_stdin(self, packets=47, env=base_env) # Last prime before 50. Arbitrary.
 
 
+class TestDumpcapWriteBuffer:
+    def test_dumpcap_write_buffer_to_file(self, check_dumpcap_write_buffer_stdin, base_env):
+        '''Capture from stdin using Dumpcap and write the file from a separate thread'''
+        check_dumpcap_write_buffer_stdin(self, env=base_env)
+
+    def test_dumpcap_write_buffer_to_pipe(self, check_dumpcap_write_buffer_stdin, base_env):
+        '''Capture from stdin using Dumpcap with a write buffer to a slow pipe'''
+        check_dumpcap_write_buffer_stdin(self, to_pipe=True, env=base_env)
+
+
 class TestDumpcapPcapngSections:
     def test_dumpcap_pcapng_single_in_single_out(self, check_dumpcap_pcapng_sections, base_env):
         '''Capture from a single pcapng source using Dumpcap and write a single file'''
@@ -314,6 +314,44 @@ class TestTsharkZExpert:
         assert not grep_output(proc.stdout, 'Chats')
 
 
+class TestTsharkHeuristics:
+    # DTLS on UDP port 4433 is only found by its heuristic dissector.
+    def test_tshark_z_heur_stat(self, cmd_tshark, capture_file, test_env):
+        proc = subprocesstest.run((cmd_tshark, '-q', '-z', 'heur,stat',
+            '-r', capture_file('dtls12-aes128ccm8.pcap')), capture_output=True, env=test_env)
+        assert proc.returncode == 0
+        assert grep_output(proc.stdout, 'Heuristic Dissectors:')
+        # Attempts, and at least one accept.
+        assert grep_output(proc.stdout, r'^dtls_udp\s+udp\s+[1-9]\d*\s+[1-9]')
+
+    def test_tshark_z_heur_stat_attempts(self, cmd_tshark, capture_file, test_env):
+        proc = subprocesstest.run((cmd_tshark, '-q', '-z', 'heur,stat,attempts',
+            '-r', capture_file('dtls12-aes128ccm8.pcap')), capture_output=True, env=test_env)
+        assert proc.returncode == 0
+        assert grep_output(proc.stdout, r'^dtls_udp\s+udp\s+[1-9]')
+
+    def test_tshark_z_heur_stat_invalid(self, cmd_tshark, capture_file, test_env):
+        proc = subprocesstest.run((cmd_tshark, '-q', '-z', 'heur,stat,bytes',
+            '-r', capture_file('dtls12-aes128ccm8.pcap')), capture_output=True, env=test_env)
+        assert proc.returncode == ExitCodes.COMMAND_LINE
+        assert grep_output(proc.stderr, 'Invalid "heur,stat,bytes" option')
+
+    def test_tshark_heur_conversation_cache(self, cmd_tshark, capture_file, test_env):
+        '''Trying the cached heuristic dissector first doesn't change the dissection'''
+        outputs = []
+        for conversation_cache in ('FALSE', 'TRUE'):
+            proc = subprocesstest.run((cmd_tshark,
+                '-r', capture_file('dtls12-aes128ccm8.pcap'),
+                '-o', 'dtls.psk:ca19e028a8a372ad2d325f950fcaceed',
+                '-o', '_ws.heuristic.conversation_cache:' + conversation_cache,
+                '-V', '-x',
+            ), capture_output=True, env=test_env)
+            assert proc.returncode == 0
+            assert count_output(proc.stdout, 'Works for me!.') == 2
+            outputs.append(proc.stdout)
+        assert outputs[0] == outputs[1]
+
+
 class TestTsharkExtcap:
     # dumpcap dependency has been added to run this test only with capture support
     def test_tshark_extcap_interfaces(self, cmd_tshark, cmd_dumpcap, test_env, home_path):
@@ -171,6 +171,16 @@ class TestDfilterEquality:
         dfilter = "udp.port != 5060"
         checkDFilterCount(dfilter, 1)
 
+    def test_test_tree_1(self, checkDFilterSucceed):
+        # Field compared with a constant is fused into one instruction
+        dfilter = "udp.port == 5060"
+        checkDFilterSucceed(dfilter, "TEST_TREE")
+
+    def test_test_tree_2(self, checkDFilterCount):
+        # Register shared between two tests is not fused
+        dfilter = "udp.port == 5060 and udp.port !== 5060"
+        checkDFilterCount(dfilter, 3)
+
     def test_root_1(self, checkDFilterCount):
         dfilter = "udp.srcport == .udp.dstport"
         checkDFilterCount(dfilter, 2)
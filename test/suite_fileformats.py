@@ -10,6 +10,7 @@
 
 import os.path
 from subprocesstest import count_output
+import struct
 import subprocess
 import pytest
 from pathlib import PurePath
@@ -262,3 +263,124 @@ class TestFileFormatMime:
                 '-e', 'pcapng.block.length_trailer',
             ), encoding='utf-8', env=test_env)
         assert proc_stdout.strip() == '480\t128,88,132,132\t128,88,132,132'
+
+
+import struct
+
+def _xxh32(data, seed=0):
+    '''XXH32, for the LZ4 frame header checksum.'''
+    p1, p2, p3, p4, p5 = 2654435761, 2246822519, 3266489917, 668265263, 374761393
+    mask = 0xffffffff
+
+    def rotl(x, r):
+        return ((x << r) | (x >> (32 - r))) & mask
+
+    def rnd(acc, lane):
+        return (rotl((acc + lane * p2) & mask, 13) * p1) & mask
+
+    pos = 0
+    if len(data) >= 16:
+        v = [(seed + p1 + p2) & mask, (seed + p2) & mask, seed, (seed - p1) & mask]
+        while pos + 16 <= len(data):
+            lanes = struct.unpack_from('<4I', data, pos)
+            v = [rnd(a, l) for a, l in zip(v, lanes)]
+            pos += 16
+        h = (rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18)) & mask
+    else:
+        h = (seed + p5) & mask
+    h = (h + len(data)) & mask
+    while pos + 4 <= len(data):
+        h = (rotl((h + struct.unpack_from('<I', data, pos)[0] * p3) & mask, 17) * p4) & mask
+        pos += 4
+    while pos < len(data):
+        h = (rotl((h + data[pos] * p5) & mask, 11) * p1) & mask
+        pos += 1
+    h = ((h ^ (h >> 15)) * p2) & mask
+    h = ((h ^ (h >> 13)) * p3) & mask
+    return h ^ (h >> 16)
+
+
+def _zstd_frame(data):
+    '''A single-segment zstd frame holding data in raw blocks.'''
+    frame = struct.pack('<IBI', 0xfd2fb528, 0xa0, len(data))
+    for pos in range(0, len(data), 65536):
+        block = data[pos:pos + 65536]
+        last = 1 if pos + 65536 >= len(data) else 0
+        frame += struct.pack('<I', last | (len(block) << 3))[:3] + block
+    return frame
+
+
+def _lz4_frame(data):
+    '''An LZ4 frame holding data in uncompressed blocks.'''
+    descriptor = bytes((0x60, 0x70))
+    frame = struct.pack('<I', 0x184d2204) + descriptor + bytes(((_xxh32(descriptor) >> 8) & 0xff,))
+    for pos in range(0, len(data), 65536):
+        block = data[pos:pos + 65536]
+        frame += struct.pack('<I', 0x80000000 | len(block)) + block
+    return frame + struct.pack('<I', 0)
+
+
+def _skippable_frame(data):
+    return struct.pack('<II', 0x184d2a5e, len(data)) + data
+
+
+def _write_framed(path, data, make_frame, frame_size, skippable=False):
+    '''Write data as one frame per frame_size bytes, optionally with skippable frames between them.'''
+    with open(path, 'wb') as f:
+        for pos in range(0, len(data), frame_size):
+            f.write(make_frame(data[pos:pos + frame_size]))
+            if skippable:
+                f.write(_skippable_frame(b'seek table' * 10))
+
+
+def _interleaved_pcap(num_packets, packet_len):
+    '''A pcap whose time order alternates between its first and second half.'''
+    pcap = struct.pack('<IHHiIII', 0xa1b2c3d4, 2, 4, 0, 0, 65535, 1)
+    half = num_packets // 2
+    for i in range(num_packets):
+        ts = 2 * i if i < half else 2 * (i - half) + 1
+        payload = bytes((i + j) & 0xff for j in range(packet_len))
+        pcap += struct.pack('<IIII', 1000000000 + ts, 0, packet_len, packet_len) + payload
+    return pcap
+
+
+class TestFileFormatsCompressedFrames:
+    '''Random access to captures compressed as many zstd or LZ4 frames.'''
+    num_packets = 600
+
+    @pytest.mark.parametrize('compression', ['zstd', 'lz4'])
+    @pytest.mark.parametrize('skippable', [False, True], ids=['frames', 'skippable'])
+    def test_multi_frame_seek(self, cmd_reordercap, cmd_tshark, features, result_file, compression, skippable, test_env):
+        '''Seeking back and forth across frames reads the same packets as an uncompressed file.'''
+        if compression == 'zstd':
+            if not features.have_zstd:
+                pytest.skip('Requires zstd.')
+            make_frame, suffix = _zstd_frame, '.zst'
+        else:
+            if not features.have_lz4:
+                pytest.skip('Requires LZ4.')
+            make_frame, suffix = _lz4_frame, '.lz4'
+        # About 2.4 MB, so that reordercap's seeks go more than a fast seek
+        # span (1 MiB) back and forth.
+        pcap = _interleaved_pcap(self.num_packets, 4000)
+        plain_file = result_file('interleaved.pcap')
+        with open(plain_file, 'wb') as f:
+            f.write(pcap)
+        compressed_file = result_file('interleaved.pcap' + suffix)
+        _write_framed(compressed_file, pcap, make_frame, 100000, skippable)
+
+        plain_out = result_file('plain-sorted.pcap')
+        compressed_out = result_file('compressed-sorted.pcap')
+        subprocess.check_call((cmd_reordercap, plain_file, plain_out), env=test_env)
+        subprocess.check_call((cmd_reordercap, compressed_file, compressed_out), env=test_env)
+        with open(plain_out, 'rb') as f:
+            plain_sorted = f.read()
+        with open(compressed_out, 'rb') as f:
+            assert f.read() == plain_sorted
+
+        proc_stdout = subprocess.check_output((cmd_tshark,
+                '-r', compressed_file,
+                '-2',
+                '-Tfields', '-e', 'frame.len',
+            ), encoding='utf-8', env=test_env)
+        assert proc_stdout.split() == ['4000'] * self.num_packets
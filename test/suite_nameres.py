@@ -11,6 +11,7 @@
 import os.path
 import shutil
 import subprocess
+import time
 from subprocesstest import grep_output
 import pytest
 
@@ -104,3 +105,26 @@ class TestNameResolution:
                 ), encoding='utf-8')
         assert '174.137.42.65\twww.wireshark.org' not in stdout
         assert 'fe80::6233:4bff:fe13:c558\tCrunch.local' in stdout
+
+    def test_dns_cache(self, cmd_tshark, capture_file, conf_path, test_env):
+        '''Names are loaded from the DNS cache file, expired entries are not.'''
+        # External lookups stay off, so that the test doesn't depend on
+        # the network and only cached names can show up.
+        now = int(time.time())
+        dns_cache_path = os.path.join(conf_path, 'dns_cache')
+        with open(dns_cache_path, 'w') as f:
+            f.write('192.168.43.9 cached-43-9 {}\n'.format(now + 3600))
+            f.write('192.168.43.1 expired-43-1 {}\n'.format(now - 3600))
+        stdout = subprocess.check_output((cmd_tshark,
+                '-r', capture_file('dns+icmp.pcapng.gz'),
+                '-o', 'nameres.network_name: TRUE',
+                '-o', 'nameres.use_external_name_resolver: FALSE',
+                '-o', 'nameres.dns_cache_lifetime: 1',
+                ), encoding='utf-8', env=test_env)
+        assert 'cached-43-9' in stdout
+        assert 'expired-43-1' not in stdout
+        # The expired entry is dropped when the cache is written back.
+        with open(dns_cache_path, 'r') as f:
+            dns_cache = f.read()
+        assert 'cached-43-9' in dns_cache
+        assert 'expired-43-1' not in dns_cache
@@ -47,6 +47,12 @@ class TestUnitTests:
             '--verbose'
         ), env=base_env)
 
+    def test_unit_dissector_table(self, program, base_env):
+        '''dissector table unit tests'''
+        subprocess.check_call((program('test_dissector_table'),
+            '--verbose'
+        ), env=base_env)
+
     def test_unit_wsutil(self, program, base_env):
         '''wsutil unit tests'''
         subprocess.check_call((program('test_wsutil'),
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+'''
+Write a capture file containing many short UDP flows, each a single DNS
+query and response between a random client address and port and one of a
+handful of resolvers. Every flow creates a new conversation, which makes
+the file useful for benchmarking conversation lookups, e.g.
+
+    tools/generate_dns_flows_pcap.py --flows 2000000 --outfile dns-flows.pcap
+    time tshark -n -r dns-flows.pcap -Q
+    time tshark -n -r dns-flows.pcap -q -z conv,udp
+
+SPDX-License-Identifier: GPL-2.0-or-later
+'''
+
+from argparse import ArgumentParser
+import random
+import struct
+import sys
+
+RESOLVERS = (
+    bytes((8, 8, 8, 8)),
+    bytes((8, 8, 4, 4)),
+    bytes((1, 1, 1, 1)),
+    bytes((9, 9, 9, 9)),
+)
+
+
+def ip_checksum(header):
+    total = sum(struct.unpack('!10H', header))
+    total = (total >> 16) + (total & 0xffff)
+    total += total >> 16
+    return ~total & 0xffff
+
+
+def udp_packet(src, sport, dst, dport, payload):
+    udp = struct.pack('!HHHH', sport, dport, 8 + len(payload), 0) + payload
+    ip = struct.pack('!BBHHHBBH4s4s', 0x45, 0, 20 + len(udp), 0, 0x4000, 64, 17, 0, src, dst)
+    ip = ip[:10] + struct.pack('!H', ip_checksum(ip)) + ip[12:]
+    # Ethernet, IPv4
+    return b'\x02\x00\x00\x00\x00\x01\x02\x00\x00\x00\x00\x02\x08\x00' + ip + udp
+
+
+def dns_query(txid, name):
+    qname = b''.join(bytes((len(label),)) + label for label in name.split(b'.')) + b'\x00'
+    return struct.pack('!HHHHHH', txid, 0x0100, 1, 0, 0, 0) + qname + struct.pack('!HH', 1, 1)
+
+
+def dns_response(txid, name, addr):
+    query = dns_query(txid, name)
+    answer = struct.pack('!HHHIH4s', 0xc00c, 1, 1, 300, 4, addr)
+    return struct.pack('!HH', txid, 0x8180) + query[4:6] + b'\x00\x01' + query[8:] + answer
+
+
+def main():
+    parser = ArgumentParser()
+    parser.add_argument('--flows', type=int, default=1000000,
+                        help='The number of query/response flows')
+    parser.add_argument('--seed', type=int, default=0,
+                        help='The random seed')
+    parser.add_argument('--outfile', default='-',
+                        help='The PCAP output file, or "-" for stdout')
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+
+    outfile_name = args.outfile.strip()
+    if outfile_name != '-':
+        outfile = open(outfile_name, 'wb')
+    else:
+        outfile = sys.stdout.buffer
+
+    # Little-endian pcap, microsecond timestamps, Ethernet
+    outfile.write(struct.pack('<IHHiIII', 0xa1b2c3d4, 2, 4, 0, 0, 65535, 1))
+
+    ts_usec = 1700000000 * 1000000
+    for flow in range(args.flows):
+        client = bytes((10, rng.randrange(256), rng.randrange(256), rng.randrange(1, 255)))
+        cport = rng.randrange(1024, 65536)
+        resolver = RESOLVERS[flow % len(RESOLVERS)]
+        txid = rng.randrange(65536)
+        name = b'host%d.example.com' % (flow,)
+        answer = bytes((192, 0, 2, flow % 254 + 1))
+
+        for pkt, delay in ((udp_packet(client, cport, resolver, 53, dns_query(txid, name)), 10),
+                           (udp_packet(resolver, 53, client, cport, dns_response(txid, name, answer)), 490)):
+            ts_usec += delay
+            outfile.write(struct.pack('<IIII', ts_usec // 1000000, ts_usec % 1000000, len(pkt), len(pkt)))
+            outfile.write(pkt)
+
+    outfile.close()
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -134,6 +134,12 @@
 #define INVALID_TAP             2
 #define INVALID_CAPTURE         2
 
+/*
+ * Size of the standard output buffer to use when we're writing packet
+ * information in bulk, i.e. not line-buffered and not to a terminal.
+ */
+#define BULK_OUTPUT_BUFFER_SIZE (1024 * 1024)
+
 #define LONGOPT_EXPORT_OBJECTS          LONGOPT_BASE_APPLICATION+1
 #define LONGOPT_COLOR                   LONGOPT_BASE_APPLICATION+2
 #define LONGOPT_NO_DUPLICATE_KEYS       LONGOPT_BASE_APPLICATION+3
@@ -2390,6 +2396,16 @@ main(int argc, char *argv[])
     cfile.dfcode = dfcode;
 
     if (print_packet_info) {
+        /* If we're not flushing the standard output after every packet,
+           and it isn't a terminal, we're probably exporting in bulk (e.g.,
+           "-T fields" or "-T ek" to a file or pipe).  Dissection is done
+           one packet at a time on this thread, as epan keeps per-capture
+           state (conversations, reassembly, name resolution) that isn't
+           safe to share between threads, so at least don't make a write
+           system call every few kilobytes of output. */
+        if (!line_buffered && !ws_isatty(ws_fileno(stdout)))
+            setvbuf(stdout, NULL, _IOFBF, BULK_OUTPUT_BUFFER_SIZE);
+
         /* If we're printing as text or PostScript, we have
            to create a print stream. */
         if (output_action == WRITE_TEXT) {
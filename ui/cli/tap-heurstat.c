@@ -0,0 +1,174 @@
+/* tap-heurstat.c
+ * Report how often each heuristic dissector was tried and how long it took
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <glib.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stat_tap_ui.h>
+
+#include <wsutil/cmdarg_err.h>
+
+void register_tap_listener_heurstat(void);
+
+typedef struct _heurstat_t {
+	bool       sort_by_attempts;
+	GPtrArray *entries;
+} heurstat_t;
+
+static tap_packet_status
+heurstat_packet(void *phs _U_, packet_info *pinfo _U_, epan_dissect_t *edt _U_, const void *phi _U_, tap_flags_t flags _U_)
+{
+	return TAP_PACKET_DONT_REDRAW;
+}
+
+static void
+heurstat_collect_entry(const char *table_name _U_, struct heur_dtbl_entry *hdtbl_entry, void *user_data)
+{
+	heurstat_t *hs = (heurstat_t *)user_data;
+
+	if (hdtbl_entry->attempts > 0)
+		g_ptr_array_add(hs->entries, hdtbl_entry);
+}
+
+static void
+heurstat_collect_table(const char *table_name, struct heur_dissector_list *table _U_, void *user_data)
+{
+	heur_dissector_table_foreach(table_name, heurstat_collect_entry, user_data);
+}
+
+static int
+heurstat_compare_time(const void *a, const void *b)
+{
+	const heur_dtbl_entry_t *entry_a = *(const heur_dtbl_entry_t **)a;
+	const heur_dtbl_entry_t *entry_b = *(const heur_dtbl_entry_t **)b;
+
+	if (entry_a->time_ns != entry_b->time_ns)
+		return entry_a->time_ns < entry_b->time_ns ? 1 : -1;
+	if (entry_a->attempts != entry_b->attempts)
+		return entry_a->attempts < entry_b->attempts ? 1 : -1;
+	return strcmp(entry_a->short_name, entry_b->short_name);
+}
+
+static int
+heurstat_compare_attempts(const void *a, const void *b)
+{
+	const heur_dtbl_entry_t *entry_a = *(const heur_dtbl_entry_t **)a;
+	const heur_dtbl_entry_t *entry_b = *(const heur_dtbl_entry_t **)b;
+
+	if (entry_a->attempts != entry_b->attempts)
+		return entry_a->attempts < entry_b->attempts ? 1 : -1;
+	return heurstat_compare_time(a, b);
+}
+
+static void
+heurstat_draw(void *phs)
+{
+	heurstat_t *hs = (heurstat_t *)phs;
+	unsigned i;
+
+	g_ptr_array_set_size(hs->entries, 0);
+	dissector_all_heur_tables_foreach_table(heurstat_collect_table, hs, NULL);
+	g_ptr_array_sort(hs->entries, hs->sort_by_attempts ? heurstat_compare_attempts : heurstat_compare_time);
+
+	printf("\n");
+	printf("==========================================================================================================\n");
+	printf("Heuristic Dissectors:\n");
+	printf("%-32s %-16s %12s %12s %8s %12s %10s %10s\n",
+	       "Heuristic", "List", "Attempts", "Accepts", "Accept %", "Time (ms)", "ns/Attempt", "Cached");
+	for (i = 0; i < hs->entries->len; i++) {
+		const heur_dtbl_entry_t *hdtbl_entry = (const heur_dtbl_entry_t *)g_ptr_array_index(hs->entries, i);
+
+		printf("%-32s %-16s %12" PRIu64 " %12" PRIu64 " %8.2f %12.3f %10" PRIu64 " %10" PRIu64 "\n",
+		       hdtbl_entry->short_name, hdtbl_entry->list_name,
+		       hdtbl_entry->attempts, hdtbl_entry->accepts,
+		       100.0 * (double)hdtbl_entry->accepts / (double)hdtbl_entry->attempts,
+		       (double)hdtbl_entry->time_ns / 1000000.0,
+		       hdtbl_entry->time_ns / hdtbl_entry->attempts,
+		       hdtbl_entry->cache_hits);
+	}
+	printf("==========================================================================================================\n");
+}
+
+static void
+heurstat_finish(void *phs)
+{
+	heurstat_t *hs = (heurstat_t *)phs;
+
+	heur_dissector_set_timing(false);
+	g_ptr_array_free(hs->entries, TRUE);
+	g_free(hs);
+}
+
+static void
+heurstat_init(const char *opt_arg, void *userdata _U_)
+{
+	heurstat_t *hs;
+	GString *error_string;
+
+	hs = g_new0(heurstat_t, 1);
+	if (strcmp(opt_arg, "heur,stat") == 0 || strcmp(opt_arg, "heur,stat,time") == 0) {
+		hs->sort_by_attempts = false;
+	} else if (strcmp(opt_arg, "heur,stat,attempts") == 0) {
+		hs->sort_by_attempts = true;
+	} else {
+		cmdarg_err("Invalid \"%s\" option for heur,stat; use heur,stat[,time|attempts]", opt_arg);
+		g_free(hs);
+		exit(1);
+	}
+	hs->entries = g_ptr_array_new();
+
+	error_string = register_tap_listener("frame", hs, NULL, TL_REQUIRES_NOTHING, NULL, heurstat_packet, heurstat_draw, heurstat_finish);
+	if (error_string) {
+		cmdarg_err("Couldn't register heur,stat tap: %s",
+			error_string->str);
+		g_string_free(error_string, TRUE);
+		g_ptr_array_free(hs->entries, TRUE);
+		g_free(hs);
+		exit(1);
+	}
+
+	heur_dissector_set_timing(true);
+}
+
+static stat_tap_ui heurstat_ui = {
+	REGISTER_STAT_GROUP_GENERIC,
+	NULL,
+	"heur,stat",
+	heurstat_init,
+	0,
+	NULL
+};
+
+void
+register_tap_listener_heurstat(void)
+{
+	register_stat_tap_ui(&heurstat_ui, NULL);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */
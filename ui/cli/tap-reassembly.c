@@ -0,0 +1,94 @@
+/* tap-reassembly.c
+ * Report the state of the reassembly tables
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <glib.h>
+
+#include <epan/packet_info.h>
+#include <epan/tap.h>
+#include <epan/stat_tap_ui.h>
+#include <epan/reassemble.h>
+
+#include <wsutil/cmdarg_err.h>
+
+void register_tap_listener_reassembly(void);
+
+static tap_packet_status
+reassembly_packet(void *prs _U_, packet_info *pinfo _U_, epan_dissect_t *edt _U_, const void *pri _U_, tap_flags_t flags _U_)
+{
+	return TAP_PACKET_DONT_REDRAW;
+}
+
+static void
+reassembly_print_table(const reassembly_table_stats *stats, void *user_data _U_)
+{
+	printf("%-24s %10u %14" PRIu64 " %14" PRIu64 " %10" PRIu64 " %14" PRIu64 "\n",
+	       stats->name, stats->entries, stats->bytes, stats->peak_bytes,
+	       stats->evictions, stats->evicted_bytes);
+}
+
+static void
+reassembly_draw(void *prs _U_)
+{
+	printf("\n");
+	printf("=================================================================================================\n");
+	printf("Reassembly Tables:\n");
+	printf("%-24s %10s %14s %14s %10s %14s\n",
+	       "Table", "Incomplete", "Bytes", "Peak Bytes", "Evicted", "Evicted Bytes");
+	reassembly_tables_foreach_stats(reassembly_print_table, NULL);
+	printf("=================================================================================================\n");
+}
+
+static void
+reassembly_init(const char *opt_arg _U_, void *userdata _U_)
+{
+	GString *error_string;
+
+	error_string = register_tap_listener("frame", NULL, NULL, TL_REQUIRES_NOTHING, NULL, reassembly_packet, reassembly_draw, NULL);
+	if (error_string) {
+		cmdarg_err("Couldn't register reassembly,stat tap: %s",
+			error_string->str);
+		g_string_free(error_string, TRUE);
+		exit(1);
+	}
+}
+
+static stat_tap_ui reassembly_ui = {
+	REGISTER_STAT_GROUP_GENERIC,
+	NULL,
+	"reassembly,stat",
+	reassembly_init,
+	0,
+	NULL
+};
+
+void
+register_tap_listener_reassembly(void)
+{
+	register_stat_tap_ui(&reassembly_ui, NULL);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */
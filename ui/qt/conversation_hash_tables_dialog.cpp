@@ -19,14 +19,16 @@
 #include "main_application.h"
 
 static void
-fill_named_table(void *key, void *value _U_, void *user_data)
+fill_named_table(void *key _U_, void *value, void *user_data)
 {
-    const conversation_element_t *elements = static_cast<const conversation_element_t *>(key);
+    // Not every table is keyed by element lists, but each conversation has one.
+    const conversation_t *conv = static_cast<const conversation_t *>(value);
     QString* html_table = static_cast<QString *>(user_data);
 
-    if (!elements || !html_table) {
+    if (!conv || !conv->key_ptr || !html_table) {
         return;
     }
+    const conversation_element_t *elements = conv->key_ptr;
 
     if (html_table->isEmpty()) {
         html_table->append("<tr>");
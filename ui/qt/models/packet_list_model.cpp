@@ -38,6 +38,7 @@
 #include <QFontMetrics>
 #include <QModelIndex>
 #include <QElapsedTimer>
+#include <QSet>
 
 // Print timing information
 //#define DEBUG_PACKET_LIST_MODEL 1
@@ -53,6 +54,8 @@ class SortAbort : public std::runtime_error
 
 static PacketListModel * glbl_plist_model = Q_NULLPTR;
 static const int reserved_packets_ = 100000;
+// Roughly what a row of column text costs in the PacketListRecord cache.
+static const size_t sort_key_bytes_per_cached_row_ = 1024;
 
 unsigned
 packet_list_append(column_info *, frame_data *fdata)
@@ -78,6 +81,9 @@ PacketListModel::PacketListModel(QObject *parent, capture_file *cf) :
     number_to_row_(QVector<int>()),
     max_row_height_(0),
     max_line_count_(1),
+    sort_key_column_(-1),
+    sort_key_bytes_(0),
+    keep_sort_keys_(false),
     idle_dissection_row_(0)
 {
     Q_ASSERT(glbl_plist_model == Q_NULLPTR);
@@ -144,6 +150,13 @@ int PacketListModel::packetNumberToRow(int packet_num) const
 
 unsigned PacketListModel::recreateVisibleRows()
 {
+    /*
+     * We're only called when refiltering without redissecting, which
+     * doesn't change column text, so the sort keys can be kept when
+     * captureFileReadFinished invalidates the column strings.
+     */
+    keep_sort_keys_ = sortKeysSurviveRescan(sort_key_column_);
+
     beginResetModel();
     visible_rows_.resize(0);
     number_to_row_.fill(0);
@@ -172,6 +185,7 @@ void PacketListModel::clear() {
     beginResetModel();
     qDeleteAll(physical_rows_);
     PacketListRecord::invalidateAllRecords();
+    invalidateSortKeys();
     physical_rows_.resize(0);
     visible_rows_.resize(0);
     new_visible_rows_.resize(0);
@@ -216,6 +230,11 @@ void PacketListModel::invalidateAllColumnStrings()
     emit layoutAboutToBeChanged();
 #endif
     PacketListRecord::invalidateAllRecords();
+    if (keep_sort_keys_) {
+        keep_sort_keys_ = false;
+    } else {
+        invalidateSortKeys();
+    }
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     emit layoutChanged();
 #else
@@ -232,6 +251,7 @@ void PacketListModel::resetColumns()
     if (cap_file_) {
         PacketListRecord::resetColumns(&cap_file_->cinfo);
     }
+    invalidateSortKeys();
 
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     emit layoutChanged();
@@ -378,6 +398,7 @@ void PacketListModel::toggleFrameRefTime(const QModelIndex &rt_index)
         cap_file_->displayed_count--;
     }
     record->resetColumns(&cap_file_->cinfo);
+    invalidateSortKeys();
     emit dataChanged(index(0, 0), index(rowCount() - 1, columnCount() - 1));
 }
 
@@ -396,6 +417,7 @@ void PacketListModel::unsetAllFrameRefTime()
     cap_file_->ref_time_count = 0;
     cf_reftime_packets(cap_file_);
     PacketListRecord::resetColumns(&cap_file_->cinfo);
+    invalidateSortKeys();
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     emit layoutChanged();
 #else
@@ -441,6 +463,7 @@ void PacketListModel::addFrameComment(const QModelIndexList &indices, const QByt
         // of just the frames changed.
         record->invalidateColorized();
         record->invalidateRecord();
+        invalidateSortKeys();
         emit dataChanged(index.sibling(index.row(), 0), index.sibling(index.row(), sectionMax),
                 QVector<int>() << Qt::BackgroundRole << Qt::ForegroundRole << Qt::DisplayRole);
     }
@@ -473,6 +496,7 @@ void PacketListModel::setFrameComment(const QModelIndex &index, const QByteArray
 
     record->invalidateColorized();
     record->invalidateRecord();
+    invalidateSortKeys();
     emit dataChanged(index.sibling(index.row(), 0), index.sibling(index.row(), sectionMax),
             QVector<int>() << Qt::BackgroundRole << Qt::ForegroundRole << Qt::DisplayRole);
 }
@@ -504,6 +528,7 @@ void PacketListModel::deleteFrameComments(const QModelIndexList &indices)
 
             record->invalidateColorized();
             record->invalidateRecord();
+            invalidateSortKeys();
             emit dataChanged(index.sibling(index.row(), 0), index.sibling(index.row(), sectionMax),
                     QVector<int>() << Qt::BackgroundRole << Qt::ForegroundRole << Qt::DisplayRole);
         }
@@ -531,6 +556,7 @@ void PacketListModel::deleteAllFrameComments()
 
             record->invalidateColorized();
             record->invalidateRecord();
+            invalidateSortKeys();
             row = packetNumberToRow(fdata->num);
             if (row > -1) {
                 emit dataChanged(index(row, 0), index(row, sectionMax),
@@ -578,27 +604,6 @@ void PacketListModel::sort(int column, Qt::SortOrder order)
 
     QString col_title = get_column_title(column);
 
-    if (text_sort_column_ >= 0 && (unsigned)visible_rows_.count() > prefs.gui_packet_list_cached_rows_max) {
-        /* Column not based on frame data but by column text that requires
-         * dissection, so to sort in a reasonable amount of time the column
-         * text needs to be cached.
-         */
-        /* If the sort is being triggered because the columns were already
-         * sorted and the filter is being cleared (or changed to something
-         * else with more rows than fit in the cache), then the temporary
-         * message will be immediately overwritten with the standard capture
-         * statistics by the packets_bar_update() call after thawing the rows.
-         * It will still blink yellow, and the user will get the message if
-         * they then click on the header file (wondering why it didn't sort.)
-         */
-        if (col_title.isEmpty()) {
-            col_title = tr("Column");
-        }
-        QString temp_msg = tr("%1 can only be sorted with %2 or fewer visible rows; increase cache size in Layout preferences").arg(col_title).arg(prefs.gui_packet_list_cached_rows_max);
-        mainApp->pushStatus(MainApplication::TemporaryStatus, temp_msg);
-        return;
-    }
-
     /* If we are currently in the middle of reading the capture file, don't
      * sort. PacketList::captureFileReadFinished invalidates all the cached
      * column strings and then tries to sort again.
@@ -630,6 +635,10 @@ void PacketListModel::sort(int column, Qt::SortOrder order)
      * overestimate?
      */
     exp_comps_ = log2(visible_rows_.count()) * visible_rows_.count();
+    if (text_sort_column_ >= 0) {
+        /* Plus fetching each row's sort key. */
+        exp_comps_ += visible_rows_.count();
+    }
     progress_frame_ = nullptr;
     if (qobject_cast<MainWindow *>(mainApp->mainWindow())) {
         MainWindow *mw = qobject_cast<MainWindow *>(mainApp->mainWindow());
@@ -645,7 +654,11 @@ void PacketListModel::sort(int column, Qt::SortOrder order)
     sort_column_is_numeric_ = isNumericColumn(sort_column_);
     QVector<PacketListRecord *> sorted_visible_rows_ = visible_rows_;
     try {
-        std::sort(sorted_visible_rows_.begin(), sorted_visible_rows_.end(), recordLessThan);
+        if (text_sort_column_ >= 0) {
+            sortKeys(sorted_visible_rows_);
+        } else {
+            std::sort(sorted_visible_rows_.begin(), sorted_visible_rows_.end(), recordLessThan);
+        }
 
         beginResetModel();
         visible_rows_.resize(0);
@@ -760,15 +773,8 @@ bool PacketListModel::isNumericColumn(int column)
     return true;
 }
 
-bool PacketListModel::recordLessThan(PacketListRecord *r1, PacketListRecord *r2)
+void PacketListModel::updateSortProgress()
 {
-    int cmp_val = 0;
-    comps_++;
-
-    // Wherein we try to cram the logic of packet_list_compare_records,
-    // _packet_list_compare_records, and packet_list_compare_custom from
-    // gtk/packet_list_store.c into one function
-
     if (busy_timer_.elapsed() > busy_timeout_) {
         if (progress_frame_) {
             progress_frame_->setValue(static_cast<int>(comps_/exp_comps_ * 100));
@@ -781,46 +787,186 @@ bool PacketListModel::recordLessThan(PacketListRecord *r1, PacketListRecord *r2)
         }
         busy_timer_.restart();
     }
-    if (sort_column_ < 0) {
-        // No column.
-        cmp_val = frame_data_compare(sort_cap_file_->epan, r1->frameData(), r2->frameData(), COL_NUMBER);
-    } else if (text_sort_column_ < 0) {
-        // Column comes directly from frame data
-        cmp_val = frame_data_compare(sort_cap_file_->epan, r1->frameData(), r2->frameData(), sort_cap_file_->cinfo.columns[sort_column_].col_fmt);
-    } else  {
-        QString r1String = r1->columnString(sort_cap_file_, sort_column_);
-        QString r2String = r2->columnString(sort_cap_file_, sort_column_);
-        // XXX: The naive string comparison compares Unicode code points.
-        // Proper collation is more expensive
-        cmp_val = r1String.compare(r2String);
-        if (cmp_val != 0 && sort_column_is_numeric_) {
-            // Custom column with numeric data (or something like a port number).
-            // Attempt to convert to numbers.
-            // XXX This is slow. Can we avoid doing this? Perhaps the actual
-            // values used for sorting should be cached too as QVariant[List].
-            // If so, we could consider using QCollatorSortKeys or similar
-            // for strings as well.
-            bool ok_r1, ok_r2;
-            double num_r1 = parseNumericColumn(r1String, &ok_r1);
-            double num_r2 = parseNumericColumn(r2String, &ok_r2);
-
-            if (!ok_r1 && !ok_r2) {
-                cmp_val = 0;
-            } else if (!ok_r1 || (ok_r2 && num_r1 < num_r2)) {
-                // either r1 is invalid (and sort it before others) or both
-                // r1 and r2 are valid (sort normally)
-                cmp_val = -1;
-            } else if (!ok_r2 || (num_r1 > num_r2)) {
-                cmp_val = 1;
+}
+
+// Sort by a column that requires dissection. Each row's column string is
+// fetched (dissecting at most once per row, even if the column text cache
+// is smaller than the number of rows) and numeric values are parsed once,
+// and then the compact keys are sorted, so the comparisons themselves never
+// dissect or parse. The keys are kept for sorting by the same column again,
+// unless they take more memory than the column text cache may.
+void PacketListModel::sortKeys(QVector<PacketListRecord *> &rows)
+{
+    QVector<SortKey> keys;
+    unsigned hits = 0;
+
+    if (sort_column_ != sort_key_column_) {
+        invalidateSortKeys();
+        sort_key_column_ = sort_column_;
+    }
+    if (sort_key_text_.size() < physical_rows_.count() + 1) {
+        sort_key_text_.resize(physical_rows_.count() + 1);
+        sort_key_num_.resize(physical_rows_.count() + 1);
+        sort_key_num_ok_.resize(physical_rows_.count() + 1);
+    }
+    keys.reserve(rows.count());
+
+    foreach (PacketListRecord *record, rows) {
+        uint32_t num = record->frameData()->num;
+        SortKey key;
+
+        comps_++;
+        key.record = record;
+        if (num < (uint32_t)sort_key_text_.size() && !sort_key_text_[num].isNull()) {
+            hits++;
+        } else {
+            updateSortProgress();
+            QString text = record->columnString(sort_cap_file_, sort_column_);
+            // Many custom column values repeat (addresses, ports,
+            // protocol names); share their storage.
+            QSet<QString>::const_iterator it = sort_key_strings_.constFind(text);
+            if (it != sort_key_strings_.constEnd()) {
+                text = *it;
+            } else {
+                sort_key_strings_.insert(text);
+                // The characters plus the string and hash node overhead.
+                sort_key_bytes_ += text.size() * sizeof(QChar) + 64;
             }
+            if (num >= (uint32_t)sort_key_text_.size()) {
+                sort_key_text_.resize(num + 1);
+                sort_key_num_.resize(num + 1);
+                sort_key_num_ok_.resize(num + 1);
+            }
+            sort_key_text_[num] = text;
+            if (sort_column_is_numeric_) {
+                bool ok;
+                sort_key_num_[num] = parseNumericColumn(text, &ok);
+                sort_key_num_ok_.setBit(num, ok);
+            }
+        }
+        key.text = sort_key_text_[num];
+        key.num = sort_key_num_[num];
+        key.num_ok = sort_key_num_ok_.testBit(num);
+        keys << key;
+    }
+
+    size_t bytes = sort_key_bytes_ +
+            sort_key_text_.size() * (sizeof(QString) + sizeof(double));
+    ws_info("sort keys for column %d: %u of %lld cached, %zu of %zu bytes",
+            sort_column_, hits, (long long)rows.count(), bytes, sortKeyBudget());
+    if (hits > 0) {
+        mainApp->pushStatus(MainApplication::TemporaryStatus,
+                tr("Sorted using %1 of %2 cached sort keys").arg(hits).arg(rows.count()));
+    }
+
+    std::sort(keys.begin(), keys.end(), sortKeyLessThan);
+
+    for (int i = 0; i < keys.count(); i++) {
+        rows[i] = keys[i].record;
+    }
+
+    if (bytes > sortKeyBudget()) {
+        // The keys of this sort hold their own references to the strings.
+        invalidateSortKeys();
+    }
+}
+
+void PacketListModel::invalidateSortKeys()
+{
+    sort_key_column_ = -1;
+    sort_key_text_.clear();
+    sort_key_num_.clear();
+    sort_key_num_ok_.clear();
+    sort_key_strings_.clear();
+    sort_key_bytes_ = 0;
+    keep_sort_keys_ = false;
+}
+
+// Let the sort keys use as much memory as the column text cache would
+// with "Maximum cached rows" rows.
+size_t PacketListModel::sortKeyBudget()
+{
+    return static_cast<size_t>(prefs.gui_packet_list_cached_rows_max) *
+            sort_key_bytes_per_cached_row_;
+}
+
+// Column text doesn't change when refiltering, with the exception of
+// fields that depend on which frames are displayed. Custom columns that
+// are display filter expressions (field_id 0) might also reference those,
+// so don't keep them either.
+bool PacketListModel::sortKeysSurviveRescan(int column)
+{
+    if (!cap_file_ || column < 0 || column >= cap_file_->cinfo.num_cols) {
+        return false;
+    }
+    if (cap_file_->cinfo.columns[column].col_fmt != COL_CUSTOM) {
+        return true;
+    }
+
+    header_field_info *delta_dis = proto_registrar_get_byname("frame.time_delta_displayed");
+    for (GSList *item = cap_file_->cinfo.columns[column].col_custom_fields_ids; item; item = item->next) {
+        col_custom_t *col_custom = (col_custom_t *) item->data;
+        if (col_custom->field_id == 0 ||
+            (delta_dis && col_custom->field_id == delta_dis->id)) {
+            return false;
         }
+    }
+    return true;
+}
 
-        if (cmp_val == 0) {
-            // All else being equal, compare column numbers.
-            cmp_val = frame_data_compare(sort_cap_file_->epan, r1->frameData(), r2->frameData(), COL_NUMBER);
+bool PacketListModel::sortKeyLessThan(const SortKey &k1, const SortKey &k2)
+{
+    int cmp_val;
+    comps_++;
+
+    updateSortProgress();
+    // XXX: The naive string comparison compares Unicode code points.
+    // Proper collation is more expensive
+    cmp_val = k1.text.compare(k2.text);
+    if (cmp_val != 0 && sort_column_is_numeric_) {
+        // Custom column with numeric data (or something like a port number).
+        if (!k1.num_ok && !k2.num_ok) {
+            cmp_val = 0;
+        } else if (!k1.num_ok || (k2.num_ok && k1.num < k2.num)) {
+            // either k1 is invalid (and sort it before others) or both
+            // k1 and k2 are valid (sort normally)
+            cmp_val = -1;
+        } else if (!k2.num_ok || (k1.num > k2.num)) {
+            cmp_val = 1;
         }
     }
 
+    if (cmp_val == 0) {
+        // All else being equal, compare column numbers.
+        cmp_val = frame_data_compare(sort_cap_file_->epan, k1.record->frameData(), k2.record->frameData(), COL_NUMBER);
+    }
+
+    if (sort_order_ == Qt::AscendingOrder) {
+        return cmp_val < 0;
+    } else {
+        return cmp_val > 0;
+    }
+}
+
+bool PacketListModel::recordLessThan(PacketListRecord *r1, PacketListRecord *r2)
+{
+    int cmp_val = 0;
+    comps_++;
+
+    // Wherein we try to cram the logic of packet_list_compare_records,
+    // _packet_list_compare_records, and packet_list_compare_custom from
+    // gtk/packet_list_store.c into one function
+
+    updateSortProgress();
+    if (sort_column_ < 0) {
+        // No column.
+        cmp_val = frame_data_compare(sort_cap_file_->epan, r1->frameData(), r2->frameData(), COL_NUMBER);
+    } else {
+        // Column comes directly from frame data; columns that need
+        // dissection are sorted by sortKeys() instead.
+        cmp_val = frame_data_compare(sort_cap_file_->epan, r1->frameData(), r2->frameData(), sort_cap_file_->cinfo.columns[sort_column_].col_fmt);
+    }
+
     if (sort_order_ == Qt::AscendingOrder) {
         return cmp_val < 0;
     } else {
@@ -17,7 +17,9 @@
 #include <epan/packet.h>
 
 #include <QAbstractItemModel>
+#include <QBitArray>
 #include <QFont>
+#include <QSet>
 #include <QVector>
 
 #include <ui/qt/progress_frame.h>
@@ -112,6 +114,33 @@ private:
     static bool recordLessThan(PacketListRecord *r1, PacketListRecord *r2);
     static double parseNumericColumn(const QString &val, bool *ok);
 
+    // The value of a text column for one row, fetched (and, for numeric
+    // columns, parsed) once before sorting instead of on every comparison.
+    struct SortKey {
+        PacketListRecord *record;
+        QString text;
+        double num;
+        bool num_ok;
+    };
+    void sortKeys(QVector<PacketListRecord *> &rows);
+    static bool sortKeyLessThan(const SortKey &k1, const SortKey &k2);
+    static void updateSortProgress();
+
+    // Sort keys of the last column sorted by sortKeys(), indexed by frame
+    // number, so that sorting again (e.g., after a display filter change)
+    // doesn't need to dissect. Only one column is kept at a time, and only
+    // as long as it fits in sortKeyBudget().
+    int sort_key_column_;
+    QVector<QString> sort_key_text_;    // null if not fetched
+    QVector<double> sort_key_num_;      // for numeric columns
+    QBitArray sort_key_num_ok_;
+    QSet<QString> sort_key_strings_;    // distinct values of sort_key_text_, shared
+    size_t sort_key_bytes_;             // estimated size of sort_key_strings_
+    bool keep_sort_keys_;
+    void invalidateSortKeys();
+    static size_t sortKeyBudget();
+    bool sortKeysSurviveRescan(int column);
+
     static bool stop_flag_;
     static ProgressFrame *progress_frame_;
     static double exp_comps_;
@@ -19,6 +19,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stddef.h>
 #include <string.h>
 #include "wtap-int.h"
 
@@ -356,7 +357,19 @@ fast_seek_header(FILE_T file, int64_t in_pos, int64_t out_pos,
         item = (struct fast_seek_point *)file->fast_seek->pdata[file->fast_seek->len - 1];
 
     if (!item || item->out < out_pos) {
-        struct fast_seek_point *val = g_new(struct fast_seek_point,1);
+        struct fast_seek_point *val;
+
+        if (compression == ZSTD || compression == LZ4) {
+            /*
+             * Decompression can restart at any frame, so there's no
+             * state to save; as with zlib, one point per SPAN is
+             * enough, and it doesn't need the zlib window.
+             */
+            if (item && item->compression == compression && item->out + SPAN > out_pos)
+                return;
+            val = (struct fast_seek_point *)g_malloc(offsetof(struct fast_seek_point, data));
+        } else
+            val = g_new(struct fast_seek_point,1);
         val->in = in_pos;
         val->out = out_pos;
         val->compression = compression;
@@ -882,6 +895,23 @@ check_for_zlib_compression(FILE_T state)
 }
 
 
+/*
+ * Zstandard and lz4 frames are each independently compressed, so each
+ * frame header is a point from which we can start decompressing after a
+ * seek, without any saved decompressor state; files written as many
+ * small frames (for example, in the zstd seekable format) thus get fast
+ * random access. Both formats also share "skippable" frames, which carry
+ * no capture data, such as the zstd seekable format's seek table; those
+ * are passed to the decompressor, which skips them.
+ */
+static bool
+is_skippable_frame(FILE_T state)
+{
+    return state->in.avail >= 4
+        && (state->in.next[0] & 0xf0) == 0x50 && state->in.next[1] == 0x2a
+        && state->in.next[2] == 0x4d && state->in.next[3] == 0x18;
+}
+
 /*
  * Zstandard compression.
  *
@@ -929,9 +959,11 @@ check_for_zstd_compression(FILE_T state)
      * Look for the Zstandard header, and, if we find it, return
      * success if we support Zstandard and an error if we don't.
      */
-    if (state->in.avail >= 4
-        && state->in.buf[0] == 0x28 && state->in.buf[1] == 0xb5
-        && state->in.buf[2] == 0x2f && state->in.buf[3] == 0xfd) {
+    bool skippable = state->last_compression == ZSTD && is_skippable_frame(state);
+
+    if (skippable || (state->in.avail >= 4
+        && state->in.next[0] == 0x28 && state->in.next[1] == 0xb5
+        && state->in.next[2] == 0x2f && state->in.next[3] == 0xfd)) {
 #ifdef HAVE_ZSTD
         const size_t ret = ZSTD_initDStream(state->zstd_dctx);
         if (ZSTD_isError(ret)) {
@@ -940,6 +972,8 @@ check_for_zstd_compression(FILE_T state)
             return -1;
         }
 
+        if (state->fast_seek && !skippable)
+            fast_seek_header(state, state->raw_pos - state->in.avail, state->pos, ZSTD);
         state->compression = ZSTD;
         state->is_compressed = true;
         return 1;
@@ -1003,9 +1037,11 @@ check_for_lz4_compression(FILE_T state)
      * Look for the lz4 header, and, if we find it, return success
      * if we support lz4 and an error if we don't.
      */
-    if (state->in.avail >= 4
-        && state->in.buf[0] == 0x04 && state->in.buf[1] == 0x22
-        && state->in.buf[2] == 0x4d && state->in.buf[3] == 0x18) {
+    bool skippable = state->last_compression == LZ4 && is_skippable_frame(state);
+
+    if (skippable || (state->in.avail >= 4
+        && state->in.next[0] == 0x04 && state->in.next[1] == 0x22
+        && state->in.next[2] == 0x4d && state->in.next[3] == 0x18)) {
 #ifdef USE_LZ4
 #if LZ4_VERSION_NUMBER >= 10800
         LZ4F_resetDecompressionContext(state->lz4_dctx);
@@ -1018,6 +1054,8 @@ check_for_lz4_compression(FILE_T state)
             return -1;
         }
 #endif /* LZ4_VERSION_NUMBER >= 10800 */
+        if (state->fast_seek && !skippable)
+            fast_seek_header(state, state->raw_pos - state->in.avail, state->pos, LZ4);
         state->compression = LZ4;
         state->is_compressed = true;
         return 1;
@@ -1057,6 +1095,18 @@ check_for_compression(FILE_T state)
             return 0;
     }
 
+    /*
+     * If we're at the end of a compressed frame, the next frame's header
+     * might be split across reads; move what we have to the beginning of
+     * the input buffer and read the rest, so the checks below see it.
+     */
+    if (state->in.avail < 4 && !state->eof) {
+        memmove(state->in.buf, state->in.next, state->in.avail);
+        state->in.next = state->in.buf;
+        if (fill_in_buffer(state) == -1)
+            return -1;
+    }
+
     /*
      * Check for the compression types we support.
      */
@@ -1598,7 +1648,11 @@ file_seek(FILE_T file, int64_t offset, int whence, int *err)
             off2 = here->out;
         } else
 #endif /* USE_ZLIB_OR_ZLIBNG */
-        {
+        if (here->compression == ZSTD || here->compression == LZ4) {
+            /* Start of a frame; decompress forward from there. */
+            off = here->in;
+            off2 = here->out;
+        } else {
             off2 = (file->pos + offset);
             off = here->in + (off2 - here->out);
         }
@@ -1648,6 +1702,13 @@ file_seek(FILE_T file, int64_t offset, int whence, int *err)
             file->compression = ZLIB;
         } else
 #endif /* USE_ZLIB_OR_ZLIBNG */
+        if (here->compression == ZSTD || here->compression == LZ4) {
+            /*
+             * Have check_for_compression() look at the frame header
+             * and reset the decompressor for us.
+             */
+            file->compression = UNKNOWN;
+        } else
             file->compression = here->compression;
 
         offset = (file->pos + offset) - off2;
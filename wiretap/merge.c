@@ -305,21 +305,124 @@ merge_select_frame_type(const int file_type, int in_file_count, merge_in_file_t
 }
 
 /*
- * returns true if first argument is earlier than second
+ * Binary min-heap of the input files that currently have a record
+ * present, ordered by the time stamp of that record, so that picking
+ * the earliest record is O(log N) rather than a scan of every input;
+ * that matters when merging thousands of ring buffer files.
+ */
+typedef struct {
+    merge_in_file_t **files;        /* heap array, earliest record at files[0] */
+    unsigned          count;        /* number of files in the heap */
+    unsigned          in_file_count; /* number of input files */
+    unsigned          next_unread;  /* index of the next input not yet read */
+    merge_in_file_t  *last;         /* file whose record we last returned */
+} merge_heap_t;
+
+static void
+merge_heap_init(merge_heap_t *heap, unsigned in_file_count)
+{
+    heap->files = g_new(merge_in_file_t *, in_file_count);
+    heap->count = 0;
+    heap->in_file_count = in_file_count;
+    heap->next_unread = 0;
+    heap->last = NULL;
+}
+
+static void
+merge_heap_cleanup(merge_heap_t *heap)
+{
+    g_free(heap->files);
+    heap->files = NULL;
+}
+
+/*
+ * returns true if the record in the first file should be written before
+ * the record in the second one
+ *
+ * Records with no time stamp are treated as earlier than all other
+ * records. Ties go to the later file, as the linear scan this replaced
+ * did, so that the merged output is unchanged.
  */
 static bool
-is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
+merge_heap_before(const merge_in_file_t *l, const merge_in_file_t *r)
 {
-    if (l->secs > r->secs) {  /* left is later */
-        return false;
-    } else if (l->secs < r->secs) { /* left is earlier */
+    bool l_has_ts = (l->rec.presence_flags & WTAP_HAS_TS) != 0;
+    bool r_has_ts = (r->rec.presence_flags & WTAP_HAS_TS) != 0;
+    int cmp;
+
+    if (!l_has_ts || !r_has_ts) {
+        if (l_has_ts != r_has_ts)
+            return !l_has_ts;
+        return l < r;
+    }
+    cmp = nstime_cmp(&l->rec.ts, &r->rec.ts);
+    if (cmp != 0)
+        return cmp < 0;
+    return l > r;
+}
+
+static void
+merge_heap_push(merge_heap_t *heap, merge_in_file_t *in_file)
+{
+    unsigned i = heap->count++;
+
+    while (i > 0) {
+        unsigned parent = (i - 1) / 2;
+
+        if (!merge_heap_before(in_file, heap->files[parent]))
+            break;
+        heap->files[i] = heap->files[parent];
+        i = parent;
+    }
+    heap->files[i] = in_file;
+}
+
+static merge_in_file_t *
+merge_heap_pop(merge_heap_t *heap)
+{
+    merge_in_file_t *top = heap->files[0];
+    merge_in_file_t *moved = heap->files[--heap->count];
+    unsigned i = 0;
+
+    for (;;) {
+        unsigned child = 2 * i + 1;
+
+        if (child >= heap->count)
+            break;
+        if (child + 1 < heap->count &&
+            merge_heap_before(heap->files[child + 1], heap->files[child]))
+            child++;
+        if (!merge_heap_before(heap->files[child], moved))
+            break;
+        heap->files[i] = heap->files[child];
+        i = child;
+    }
+    if (heap->count > 0)
+        heap->files[i] = moved;
+    return top;
+}
+
+/*
+ * Read the next record from a file and, if we got one, add the file to
+ * the heap. Returns false on a read error.
+ */
+static bool
+merge_heap_fill(merge_heap_t *heap, merge_in_file_t *in_file,
+                int *err, char **err_info)
+{
+    int64_t data_offset;
+
+    if (!wtap_read(in_file->wth, &in_file->rec, &in_file->frame_buffer,
+                   err, err_info, &data_offset)) {
+        if (*err != 0) {
+            in_file->state = GOT_ERROR;
+            return false;
+        }
+        in_file->state = AT_EOF;
         return true;
-    } else if (l->nsecs > r->nsecs) { /* tv_sec equal, l.usec later */
-        return false;
     }
-    /* either one < two or one == two
-     * either way, return one
-     */
+    in_file->state = RECORD_PRESENT;
+    merge_heap_push(heap, in_file);
     return true;
 }
 
@@ -335,7 +438,7 @@ is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
  * On an EOF (meaning all the files are at EOF), set *err to 0 and return
  * NULL.
  *
- * @param in_file_count number of entries in in_files
+ * @param heap heap of input files, set up with merge_heap_init()
  * @param in_files input file array
  * @param err wiretap error, if failed
  * @param err_info wiretap error string, if failed
@@ -344,80 +447,50 @@ is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
  * all files
  */
 static merge_in_file_t *
-merge_read_packet(int in_file_count, merge_in_file_t in_files[],
+merge_read_packet(merge_heap_t *heap, merge_in_file_t in_files[],
                   int *err, char **err_info)
 {
-    int i;
-    int ei = -1;
-    nstime_t tv = NSTIME_INIT_MAX;
-    wtap_rec *rec;
+    merge_in_file_t *in_file;
 
     /*
-     * Make sure we have a record available from each file that's not at
-     * EOF, and search for the record with the earliest time stamp or
-     * with no time stamp (those records are treated as earlier than
-     * all other records).  Yes, this means you won't get a chronological
-     * merge of those records, but you obviously *can't* get that.
+     * Only the file whose record we returned last time needs a new
+     * record; every other file with a record present is still in the
+     * heap. On the first call(s), prime every file, resuming after any
+     * file on which we got a read error.
      */
-    for (i = 0; i < in_file_count; i++) {
-        int64_t data_offset;
-
-        if (in_files[i].state == RECORD_NOT_PRESENT) {
-            /*
-             * No packet available, and we haven't seen an error or EOF yet,
-             * so try to read the next packet.
-             */
-            if (!wtap_read(in_files[i].wth, &in_files[i].rec,
-                           &in_files[i].frame_buffer, err, err_info,
-                           &data_offset)) {
-                if (*err != 0) {
-                    in_files[i].state = GOT_ERROR;
-                    return &in_files[i];
-                }
-                in_files[i].state = AT_EOF;
-            } else
-                in_files[i].state = RECORD_PRESENT;
-        }
-
-        if (in_files[i].state == RECORD_PRESENT) {
-            rec = &in_files[i].rec;
-            if (!(rec->presence_flags & WTAP_HAS_TS)) {
-                /*
-                 * No time stamp.  Pick this record, and stop looking.
-                 */
-                ei = i;
-                break;
-            }
-            if (is_earlier(&rec->ts, &tv)) {
-                /*
-                 * This record's time stamp is earlier than any of the
-                 * records we've seen so far.  Pick it, for now, but
-                 * keep looking.
-                 */
-                tv = rec->ts;
-                ei = i;
-            }
-        }
+    if (heap->last != NULL) {
+        in_file = heap->last;
+        heap->last = NULL;
+        if (!merge_heap_fill(heap, in_file, err, err_info))
+            return in_file;
+    }
+    while (heap->next_unread < heap->in_file_count) {
+        in_file = &in_files[heap->next_unread++];
+        if (!merge_heap_fill(heap, in_file, err, err_info))
+            return in_file;
     }
 
-    if (ei == -1) {
+    if (heap->count == 0) {
         /* All the streams are at EOF.  Return an EOF indication. */
         *err = 0;
         return NULL;
     }
 
+    in_file = merge_heap_pop(heap);
+
     /* We'll need to read another packet from this file. */
-    in_files[ei].state = RECORD_NOT_PRESENT;
+    in_file->state = RECORD_NOT_PRESENT;
+    heap->last = in_file;
 
     /* Count this packet. */
-    in_files[ei].packet_num++;
+    in_file->packet_num++;
 
     /*
      * Return a pointer to the merge_in_file_t of the file from which the
      * packet was read.
      */
     *err = 0;
-    return &in_files[ei];
+    return in_file;
 }
 
 /** Read the next packet, in file sequence order, from the set of files
@@ -1035,6 +1108,9 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
     int                 count = 0;
     bool                stop_flag = false;
     wtap_rec *rec,      snap_rec;
+    merge_heap_t        heap;
+
+    merge_heap_init(&heap, in_file_count);
 
     for (;;) {
         *err = 0;
@@ -1044,8 +1120,7 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
                                                err_info);
         }
         else {
-            in_file = merge_read_packet(in_file_count, in_files, err,
-                                        err_info);
+            in_file = merge_read_packet(&heap, in_files, err, err_info);
         }
 
         if (in_file == NULL) {
@@ -1167,6 +1242,8 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
         wtap_rec_reset(rec);
     }
 
+    merge_heap_cleanup(&heap);
+
     if (cb)
         cb->callback_func(MERGE_EVENT_DONE, count, in_files, in_file_count, cb->data);
 
@@ -0,0 +1,462 @@
+/* async_writer.c
+ * A FILE * that hands capture output to a separate writer thread, so
+ * that a slow disk doesn't hold up the capture.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <config.h>
+
+#define _GNU_SOURCE /* For fopencookie() and O_DIRECT */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <glib.h>
+
+#include <ws_attributes.h>
+
+#include "async_writer.h"
+
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+#define HAVE_ASYNC_WRITER
+#endif
+
+#ifdef HAVE_ASYNC_WRITER
+
+/*
+ * Buffers are aligned to, and their sizes are multiples of, this. It's
+ * also the granularity of direct I/O writes.
+ */
+#define ASYNC_WRITER_ALIGN      4096
+#define ASYNC_WRITER_MIN_SIZE   (64 * 1024)
+
+struct _async_writer {
+    int          fd;
+    bool         direct_io;
+    size_t       buffer_size;
+    uint8_t     *buf[2];
+
+    /* Used by the capture thread only */
+    unsigned     fill;          /* Index of the buffer being filled */
+    size_t       fill_len;
+
+    /* Protected by mutex */
+    GMutex       mutex;
+    GCond        cond;
+    GThread     *thread;
+    const uint8_t *flight_buf;  /* Buffer being written by the writer thread */
+    size_t       flight_len;
+    bool         busy;          /* The writer thread has a buffer to write */
+    bool         closing;
+    int          err;           /* First write error, as an errno value */
+    uint64_t     bytes_written;
+    unsigned     stalls;
+};
+
+/* Totals of the writers that have been closed. */
+static uint64_t closed_bytes_written;
+static unsigned closed_stalls;
+
+static bool
+write_all(async_writer *writer, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t nwritten = write(writer->fd, data, len);
+
+        if (nwritten < 0) {
+            if (errno == EINTR)
+                continue;
+#ifdef O_DIRECT
+            if (errno == EINVAL && writer->direct_io) {
+                /*
+                 * The file system accepted O_DIRECT but not this write,
+                 * e.g. because its block size is larger than ours. Fall
+                 * back to ordinary writes.
+                 */
+                int flags = fcntl(writer->fd, F_GETFL);
+
+                if (flags != -1 && fcntl(writer->fd, F_SETFL, flags & ~O_DIRECT) != -1) {
+                    writer->direct_io = false;
+                    continue;
+                }
+            }
+#endif
+            return false;
+        }
+        data += nwritten;
+        len -= nwritten;
+    }
+    return true;
+}
+
+static void *
+async_writer_thread(void *arg)
+{
+    async_writer *writer = (async_writer *)arg;
+
+    g_mutex_lock(&writer->mutex);
+    for (;;) {
+        const uint8_t *buf;
+        size_t len;
+        bool ok;
+
+        while (!writer->busy && !writer->closing)
+            g_cond_wait(&writer->cond, &writer->mutex);
+        if (!writer->busy)
+            break;
+
+        buf = writer->flight_buf;
+        len = writer->flight_len;
+        g_mutex_unlock(&writer->mutex);
+
+        ok = write_all(writer, buf, len);
+
+        g_mutex_lock(&writer->mutex);
+        if (ok) {
+            writer->bytes_written += len;
+        } else if (writer->err == 0) {
+            g_atomic_int_set(&writer->err, errno);
+        }
+        writer->busy = false;
+        g_cond_broadcast(&writer->cond);
+    }
+    g_mutex_unlock(&writer->mutex);
+    return NULL;
+}
+
+/* Wait until the writer thread has finished its buffer. Called with the mutex held. */
+static void
+wait_idle(async_writer *writer, bool count_stall)
+{
+    if (writer->busy && count_stall)
+        writer->stalls++;
+    while (writer->busy)
+        g_cond_wait(&writer->cond, &writer->mutex);
+}
+
+/*
+ * Pass the first len bytes of the buffer being filled to the writer
+ * thread, and continue filling the other buffer, starting with the bytes
+ * that weren't passed.
+ */
+static void
+submit(async_writer *writer, size_t len)
+{
+    size_t tail = writer->fill_len - len;
+
+    g_mutex_lock(&writer->mutex);
+    wait_idle(writer, true);
+    writer->flight_buf = writer->buf[writer->fill];
+    writer->flight_len = len;
+    writer->busy = true;
+    g_cond_broadcast(&writer->cond);
+    g_mutex_unlock(&writer->mutex);
+
+    if (tail > 0)
+        memcpy(writer->buf[!writer->fill], writer->buf[writer->fill] + len, tail);
+    writer->fill = !writer->fill;
+    writer->fill_len = tail;
+}
+
+static ssize_t
+async_writer_write(void *cookie, const char *data, size_t len)
+{
+    async_writer *writer = (async_writer *)cookie;
+    int err = g_atomic_int_get(&writer->err);
+    size_t done = 0;
+
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+
+    while (done < len) {
+        size_t n = MIN(len - done, writer->buffer_size - writer->fill_len);
+
+        memcpy(writer->buf[writer->fill] + writer->fill_len, data + done, n);
+        writer->fill_len += n;
+        done += n;
+        if (writer->fill_len == writer->buffer_size)
+            submit(writer, writer->buffer_size);
+    }
+    return (ssize_t)len;
+}
+
+static int
+async_writer_close(void *cookie)
+{
+    async_writer *writer = (async_writer *)cookie;
+    size_t len = writer->fill_len;
+    size_t aligned = len;
+    int err;
+
+    g_mutex_lock(&writer->mutex);
+    wait_idle(writer, false);
+    writer->closing = true;
+    g_cond_broadcast(&writer->cond);
+    g_mutex_unlock(&writer->mutex);
+    g_thread_join(writer->thread);
+
+    /* Write what's left ourselves. */
+    err = writer->err;
+    if (err == 0 && len > 0) {
+        if (writer->direct_io)
+            aligned = len & ~(size_t)(ASYNC_WRITER_ALIGN - 1);
+        if (aligned > 0 && !write_all(writer, writer->buf[writer->fill], aligned))
+            err = errno;
+#ifdef O_DIRECT
+        if (err == 0 && aligned < len) {
+            /* The end of the file needn't be aligned; finish without direct I/O. */
+            int flags = fcntl(writer->fd, F_GETFL);
+
+            if (flags == -1 || fcntl(writer->fd, F_SETFL, flags & ~O_DIRECT) == -1)
+                err = errno;
+            else
+                writer->direct_io = false;
+        }
+#endif
+        if (err == 0 && aligned < len &&
+            !write_all(writer, writer->buf[writer->fill] + aligned, len - aligned))
+            err = errno;
+        if (err == 0)
+            writer->bytes_written += len;
+    }
+    if (close(writer->fd) != 0 && err == 0)
+        err = errno;
+
+    closed_bytes_written += writer->bytes_written;
+    closed_stalls += writer->stalls;
+
+    g_mutex_clear(&writer->mutex);
+    g_cond_clear(&writer->cond);
+    free(writer->buf[0]);
+    free(writer->buf[1]);
+    g_free(writer);
+
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+#if defined(HAVE_FUNOPEN) && !defined(HAVE_FOPENCOOKIE)
+static int
+async_writer_funopen_write(void *cookie, const char *data, int len)
+{
+    return (int)async_writer_write(cookie, data, (size_t)len);
+}
+#endif
+
+bool
+async_writer_is_supported(void)
+{
+    return true;
+}
+
+FILE *
+async_writer_fdopen(int fd, size_t buffer_size, bool direct_io,
+                    async_writer **writerp, int *err)
+{
+    async_writer *writer;
+    FILE *stream;
+
+    buffer_size = MAX(buffer_size, ASYNC_WRITER_MIN_SIZE);
+    buffer_size = (buffer_size + ASYNC_WRITER_ALIGN - 1) & ~(size_t)(ASYNC_WRITER_ALIGN - 1);
+
+    writer = g_new0(async_writer, 1);
+    writer->fd = fd;
+    writer->buffer_size = buffer_size;
+    if (posix_memalign((void **)&writer->buf[0], ASYNC_WRITER_ALIGN, buffer_size) != 0 ||
+        posix_memalign((void **)&writer->buf[1], ASYNC_WRITER_ALIGN, buffer_size) != 0) {
+        free(writer->buf[0]);
+        g_free(writer);
+        *err = ENOMEM;
+        return NULL;
+    }
+
+#ifdef O_DIRECT
+    if (direct_io) {
+        /*
+         * Only for regular files; on a pipe, e.g. to a compressor, O_DIRECT
+         * means something else. Setting it fails, and we use ordinary
+         * writes, if the file system doesn't support it.
+         */
+        struct stat statb;
+        int flags = fcntl(fd, F_GETFL);
+
+        if (fstat(fd, &statb) == 0 && S_ISREG(statb.st_mode) &&
+            flags != -1 && fcntl(fd, F_SETFL, flags | O_DIRECT) != -1)
+            writer->direct_io = true;
+    }
+#else
+    (void)direct_io;
+#endif
+
+#ifdef HAVE_FOPENCOOKIE
+    {
+        cookie_io_functions_t funcs = {
+            .read = NULL,
+            .write = async_writer_write,
+            .seek = NULL,
+            .close = async_writer_close,
+        };
+        stream = fopencookie(writer, "wb", funcs);
+    }
+#else
+    stream = funopen(writer, NULL, async_writer_funopen_write, NULL, async_writer_close);
+#endif
+    if (stream == NULL) {
+        *err = errno;
+        free(writer->buf[0]);
+        free(writer->buf[1]);
+        g_free(writer);
+        return NULL;
+    }
+    /* Our buffers do the buffering; don't copy everything twice. */
+    setvbuf(stream, NULL, _IONBF, 0);
+
+    g_mutex_init(&writer->mutex);
+    g_cond_init(&writer->cond);
+    writer->thread = g_thread_new("Capture write", async_writer_thread, writer);
+
+    *writerp = writer;
+    return stream;
+}
+
+/*
+ * With direct I/O, the data after the last page boundary stays buffered
+ * until the rest of the page has been filled. To make it readable now,
+ * write it without direct I/O at the current file offset, without moving
+ * the offset; it is written again, with the rest of its page, later.
+ * Called with the writer thread idle.
+ */
+static void
+write_tail(async_writer *writer)
+{
+#ifdef O_DIRECT
+    const uint8_t *data = writer->buf[writer->fill];
+    size_t len = writer->fill_len;
+    off_t offset = lseek(writer->fd, 0, SEEK_CUR);
+    int flags = fcntl(writer->fd, F_GETFL);
+    int err = 0;
+
+    if (offset == -1 || flags == -1 || fcntl(writer->fd, F_SETFL, flags & ~O_DIRECT) == -1) {
+        err = errno;
+    } else {
+        while (len > 0) {
+            ssize_t nwritten = pwrite(writer->fd, data, len, offset);
+
+            if (nwritten < 0) {
+                if (errno == EINTR)
+                    continue;
+                err = errno;
+                break;
+            }
+            data += nwritten;
+            len -= nwritten;
+            offset += nwritten;
+        }
+        if (fcntl(writer->fd, F_SETFL, flags) == -1) {
+            /* The file offset is unchanged, so ordinary writes still work. */
+            writer->direct_io = false;
+        }
+    }
+    if (err != 0 && g_atomic_int_get(&writer->err) == 0)
+        g_atomic_int_set(&writer->err, err);
+#else
+    (void)writer;
+#endif
+}
+
+void
+async_writer_flush(async_writer *writer, bool wait)
+{
+    size_t len = writer->fill_len;
+
+    if (writer->direct_io)
+        len &= ~(size_t)(ASYNC_WRITER_ALIGN - 1);
+    if (len > 0)
+        submit(writer, len);
+    if (wait) {
+        g_mutex_lock(&writer->mutex);
+        wait_idle(writer, false);
+        g_mutex_unlock(&writer->mutex);
+        if (writer->direct_io && writer->fill_len > 0)
+            write_tail(writer);
+    }
+}
+
+void
+async_writer_get_stats(async_writer *writer, async_writer_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->bytes_written = closed_bytes_written;
+    stats->stalls = closed_stalls;
+    if (writer != NULL) {
+        stats->buffer_size = writer->buffer_size;
+        stats->buffered = writer->fill_len;
+        stats->direct_io = writer->direct_io;
+        g_mutex_lock(&writer->mutex);
+        stats->in_flight = writer->busy ? writer->flight_len : 0;
+        stats->bytes_written += writer->bytes_written;
+        stats->stalls += writer->stalls;
+        g_mutex_unlock(&writer->mutex);
+    }
+}
+
+#else /* HAVE_ASYNC_WRITER */
+
+bool
+async_writer_is_supported(void)
+{
+    return false;
+}
+
+FILE *
+async_writer_fdopen(int fd _U_, size_t buffer_size _U_, bool direct_io _U_,
+                    async_writer **writerp _U_, int *err)
+{
+    *err = ENOTSUP;
+    return NULL;
+}
+
+void
+async_writer_flush(async_writer *writer _U_, bool wait _U_)
+{
+}
+
+void
+async_writer_get_stats(async_writer *writer _U_, async_writer_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* HAVE_ASYNC_WRITER */
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
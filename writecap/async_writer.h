@@ -0,0 +1,102 @@
+/** @file
+ *
+ * A FILE * that hands capture output to a separate writer thread.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef __WRITECAP_ASYNC_WRITER_H__
+#define __WRITECAP_ASYNC_WRITER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct _async_writer async_writer;
+
+typedef struct _async_writer_stats {
+    size_t   buffer_size;       /**< Size of each of the two buffers */
+    size_t   buffered;          /**< Bytes waiting in the buffer being filled */
+    size_t   in_flight;         /**< Bytes being written by the writer thread */
+    uint64_t bytes_written;     /**< Bytes written by the writer, over all files */
+    unsigned stalls;            /**< Times the capture had to wait for the writer, over all files */
+    bool     direct_io;         /**< true if the current file is written with direct I/O */
+} async_writer_stats;
+
+/** Returns true if async_writer_fdopen() is available on this platform. */
+extern bool
+async_writer_is_supported(void);
+
+/** Open a stream on fd whose data is written by a separate thread.
+ *
+ * Data written to the stream is copied into one of two buffers of
+ * buffer_size bytes. When a buffer is full it is passed to the writer
+ * thread, and the stream continues with the other one; the caller only
+ * waits if the writer thread is still busy with the previous buffer.
+ *
+ * If direct_io is true, fd is a regular file and its file system supports
+ * it, the file is written with O_DIRECT, bypassing the page cache.
+ *
+ * fclose() on the returned stream writes any remaining data, waits for
+ * the writer thread and closes fd. Write errors are returned by later
+ * writes to the stream, or by fclose().
+ *
+ * @param fd The file descriptor to write to.
+ * @param buffer_size The size of each buffer; it is rounded up to a
+ *        multiple of the page size.
+ * @param direct_io Whether to try to use direct I/O.
+ * @param[out] writer Set to the writer, for async_writer_flush() and
+ *        async_writer_get_stats(). It is valid until the stream is closed.
+ * @param[out] err Set to an errno value on failure.
+ * @return The stream, or NULL on failure.
+ */
+extern FILE *
+async_writer_fdopen(int fd, size_t buffer_size, bool direct_io,
+                    async_writer **writer, int *err);
+
+/** Pass the data buffered so far to the writer thread.
+ *
+ * With direct I/O, data after the last page boundary stays buffered;
+ * if wait is true, it is also written to the file, without direct I/O,
+ * and written again once the rest of its page is.
+ *
+ * @param writer The writer.
+ * @param wait If true, also wait until all the data has been written.
+ */
+extern void
+async_writer_flush(async_writer *writer, bool wait);
+
+/** Get the buffer statistics.
+ *
+ * @param writer The current writer, or NULL for the totals only.
+ * @param[out] stats The statistics.
+ */
+extern void
+async_writer_get_stats(async_writer *writer, async_writer_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __WRITECAP_ASYNC_WRITER_H__ */
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
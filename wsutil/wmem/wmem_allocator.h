@@ -35,6 +35,9 @@ struct _wmem_allocator_t {
     void  (*gc)(void *private_data);
     void  (*cleanup)(void *private_data);
 
+    /* Optional, NULL if the allocator keeps no statistics */
+    bool  (*stats)(void *private_data, struct _wmem_allocator_stats_t *stats);
+
     /* Callback List */
     struct _wmem_user_cb_container_t *callbacks;
 
@@ -0,0 +1,408 @@
+/* wmem_allocator_slab.c
+ * Wireshark Memory Manager Size-Class Slab Allocator
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "wmem_core.h"
+#include "wmem_allocator.h"
+#include "wmem_allocator_slab.h"
+
+/* Same alignment as the other block allocators, see the comment in
+ * wmem_allocator_block_fast.c */
+#define WMEM_ALIGN_AMOUNT (2 * sizeof (size_t))
+#define WMEM_ALIGN_SIZE(SIZE) ((~(WMEM_ALIGN_AMOUNT-1)) & \
+        ((SIZE) + (WMEM_ALIGN_AMOUNT-1)))
+
+#define WMEM_CHUNK_TO_DATA(CHUNK) ((void*)((uint8_t*)(CHUNK) + WMEM_CHUNK_HEADER_SIZE))
+#define WMEM_DATA_TO_CHUNK(DATA) ((wmem_slab_chunk_t*)((uint8_t*)(DATA) - WMEM_CHUNK_HEADER_SIZE))
+
+/* Allocations are rounded up to a power of two between these two sizes;
+ * anything larger is a jumbo allocation made directly from the system
+ * allocator. The smallest class must be able to hold a free list link. */
+#define WMEM_SLAB_MIN_CLASS_SIZE 16
+#define WMEM_SLAB_CLASS_SIZE(CLASS) ((size_t)WMEM_SLAB_MIN_CLASS_SIZE << (CLASS))
+#define WMEM_SLAB_MAX_CLASS_SIZE WMEM_SLAB_CLASS_SIZE(WMEM_STATS_SIZE_CLASSES - 1)
+
+/* Chunks are carved out of blocks of this size, like the other block
+ * allocators do. */
+#define WMEM_BLOCK_SIZE (2 * 1024 * 1024)
+
+/* The header for an entire OS-level 'block' of memory */
+typedef struct _wmem_slab_block {
+    struct _wmem_slab_block *next;
+
+    size_t pos;
+} wmem_slab_block_t;
+#define WMEM_BLOCK_HEADER_SIZE WMEM_ALIGN_SIZE(sizeof(wmem_slab_block_t))
+
+typedef struct {
+    uint32_t size_class;
+} wmem_slab_chunk_t;
+#define WMEM_CHUNK_HEADER_SIZE WMEM_ALIGN_SIZE(sizeof(wmem_slab_chunk_t))
+
+#define JUMBO_MAGIC 0xFFFFFFFF
+typedef struct _wmem_slab_jumbo {
+    struct _wmem_slab_jumbo *prev, *next;
+
+    size_t size;
+} wmem_slab_jumbo_t;
+#define WMEM_JUMBO_HEADER_SIZE WMEM_ALIGN_SIZE(sizeof(wmem_slab_jumbo_t))
+
+/* A free chunk stores the link to the next free chunk of its size class in
+ * its data area. */
+typedef struct _wmem_slab_free {
+    struct _wmem_slab_free *next;
+} wmem_slab_free_t;
+
+typedef struct {
+    /* All blocks; the ones after cur_block are empty and kept for reuse
+     * after a free_all until the next gc */
+    wmem_slab_block_t      *block_list;
+    wmem_slab_block_t      *cur_block;
+
+    wmem_slab_free_t       *free_lists[WMEM_STATS_SIZE_CLASSES];
+    wmem_slab_jumbo_t      *jumbo_list;
+
+    wmem_allocator_stats_t  stats;
+} wmem_slab_allocator_t;
+
+static inline unsigned
+wmem_slab_size_class(const size_t size)
+{
+    unsigned size_class = 0;
+
+    while (WMEM_SLAB_CLASS_SIZE(size_class) < size) {
+        size_class++;
+    }
+
+    return size_class;
+}
+
+static inline void
+wmem_slab_stats_add(wmem_slab_allocator_t *allocator, const size_t size)
+{
+    allocator->stats.alloc_count++;
+    allocator->stats.bytes_in_use += size;
+    if (allocator->stats.bytes_in_use > allocator->stats.peak_bytes) {
+        allocator->stats.peak_bytes = allocator->stats.bytes_in_use;
+    }
+}
+
+static void
+wmem_slab_stats_add_jumbo(wmem_slab_allocator_t *allocator, const size_t size)
+{
+    unsigned bucket = 0;
+
+    while (bucket < WMEM_STATS_JUMBO_BUCKETS - 1 &&
+            ((size_t)4096 << bucket) <= size) {
+        bucket++;
+    }
+    allocator->stats.jumbo_allocs[bucket]++;
+    wmem_slab_stats_add(allocator, size);
+}
+
+/* Makes the next block current, allocating a new one if there is no empty
+ * block left over from before the last free_all. */
+static void
+wmem_slab_next_block(wmem_slab_allocator_t *allocator)
+{
+    wmem_slab_block_t *block;
+
+    if (allocator->cur_block && allocator->cur_block->next) {
+        block = allocator->cur_block->next;
+    }
+    else {
+        block = (wmem_slab_block_t *)wmem_alloc(NULL, WMEM_BLOCK_SIZE);
+        block->next = NULL;
+        if (allocator->cur_block) {
+            allocator->cur_block->next = block;
+        }
+        else {
+            allocator->block_list = block;
+        }
+        allocator->stats.block_bytes += WMEM_BLOCK_SIZE;
+    }
+
+    block->pos = WMEM_BLOCK_HEADER_SIZE;
+    allocator->cur_block = block;
+}
+
+static void *
+wmem_slab_alloc_jumbo(wmem_slab_allocator_t *allocator, const size_t size)
+{
+    wmem_slab_jumbo_t *block;
+    wmem_slab_chunk_t *chunk;
+
+    block = (wmem_slab_jumbo_t *)wmem_alloc(NULL,
+            size + WMEM_JUMBO_HEADER_SIZE + WMEM_CHUNK_HEADER_SIZE);
+
+    block->size = size;
+    block->next = allocator->jumbo_list;
+    if (block->next) {
+        block->next->prev = block;
+    }
+    block->prev = NULL;
+    allocator->jumbo_list = block;
+
+    chunk = (wmem_slab_chunk_t *)((uint8_t *)block + WMEM_JUMBO_HEADER_SIZE);
+    chunk->size_class = JUMBO_MAGIC;
+
+    wmem_slab_stats_add_jumbo(allocator, size);
+
+    return WMEM_CHUNK_TO_DATA(chunk);
+}
+
+static void
+wmem_slab_unlink_jumbo(wmem_slab_allocator_t *allocator, wmem_slab_jumbo_t *block)
+{
+    if (block->prev) {
+        block->prev->next = block->next;
+    }
+    else {
+        allocator->jumbo_list = block->next;
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+}
+
+/* API */
+
+static void *
+wmem_slab_alloc(void *private_data, const size_t size)
+{
+    wmem_slab_allocator_t *allocator = (wmem_slab_allocator_t*) private_data;
+    wmem_slab_chunk_t     *chunk;
+    wmem_slab_free_t      *free_chunk;
+    unsigned               size_class;
+    size_t                 real_size;
+
+    if (size > WMEM_SLAB_MAX_CLASS_SIZE) {
+        return wmem_slab_alloc_jumbo(allocator, size);
+    }
+
+    size_class = wmem_slab_size_class(size);
+    allocator->stats.size_class_allocs[size_class]++;
+    wmem_slab_stats_add(allocator, WMEM_SLAB_CLASS_SIZE(size_class));
+
+    /* Reuse a freed chunk of the same class if there is one. */
+    free_chunk = allocator->free_lists[size_class];
+    if (free_chunk) {
+        allocator->free_lists[size_class] = free_chunk->next;
+        return free_chunk;
+    }
+
+    real_size = WMEM_SLAB_CLASS_SIZE(size_class) + WMEM_CHUNK_HEADER_SIZE;
+
+    /* Move on to the next block if necessary. */
+    if (!allocator->cur_block ||
+            (WMEM_BLOCK_SIZE - allocator->cur_block->pos) < real_size) {
+        wmem_slab_next_block(allocator);
+    }
+
+    chunk = (wmem_slab_chunk_t *) ((uint8_t *) allocator->cur_block + allocator->cur_block->pos);
+    chunk->size_class = size_class;
+
+    allocator->cur_block->pos += real_size;
+
+    /* and return the user's pointer */
+    return WMEM_CHUNK_TO_DATA(chunk);
+}
+
+static void
+wmem_slab_free(void *private_data, void *ptr)
+{
+    wmem_slab_allocator_t *allocator = (wmem_slab_allocator_t*) private_data;
+    wmem_slab_chunk_t     *chunk;
+    wmem_slab_free_t      *free_chunk;
+
+    chunk = WMEM_DATA_TO_CHUNK(ptr);
+    allocator->stats.free_count++;
+
+    if (chunk->size_class == JUMBO_MAGIC) {
+        wmem_slab_jumbo_t *block;
+
+        block = (wmem_slab_jumbo_t *)((uint8_t *)chunk - WMEM_JUMBO_HEADER_SIZE);
+        wmem_slab_unlink_jumbo(allocator, block);
+        allocator->stats.bytes_in_use -= block->size;
+        wmem_free(NULL, block);
+        return;
+    }
+
+    allocator->stats.bytes_in_use -= WMEM_SLAB_CLASS_SIZE(chunk->size_class);
+
+    free_chunk = (wmem_slab_free_t *)ptr;
+    free_chunk->next = allocator->free_lists[chunk->size_class];
+    allocator->free_lists[chunk->size_class] = free_chunk;
+}
+
+static void *
+wmem_slab_realloc(void *private_data, void *ptr, const size_t size)
+{
+    wmem_slab_allocator_t *allocator = (wmem_slab_allocator_t*) private_data;
+    wmem_slab_chunk_t     *chunk;
+    size_t                 old_size;
+    void                  *newptr;
+
+    chunk = WMEM_DATA_TO_CHUNK(ptr);
+
+    if (chunk->size_class == JUMBO_MAGIC) {
+        wmem_slab_jumbo_t *block;
+
+        block = (wmem_slab_jumbo_t *)((uint8_t *)chunk - WMEM_JUMBO_HEADER_SIZE);
+        old_size = block->size;
+
+        if (size > WMEM_SLAB_MAX_CLASS_SIZE) {
+            block = (wmem_slab_jumbo_t *)wmem_realloc(NULL, block,
+                    size + WMEM_JUMBO_HEADER_SIZE + WMEM_CHUNK_HEADER_SIZE);
+            if (block->prev) {
+                block->prev->next = block;
+            }
+            else {
+                allocator->jumbo_list = block;
+            }
+            if (block->next) {
+                block->next->prev = block;
+            }
+            block->size = size;
+
+            allocator->stats.bytes_in_use -= old_size;
+            wmem_slab_stats_add_jumbo(allocator, size);
+
+            return ((void*)((uint8_t*)(block) + WMEM_JUMBO_HEADER_SIZE + WMEM_CHUNK_HEADER_SIZE));
+        }
+    }
+    else {
+        old_size = WMEM_SLAB_CLASS_SIZE(chunk->size_class);
+
+        if (size <= old_size) {
+            /* still fits in its size class */
+            return ptr;
+        }
+    }
+
+    newptr = wmem_slab_alloc(private_data, size);
+    memcpy(newptr, ptr, MIN(old_size, size));
+    wmem_slab_free(private_data, ptr);
+
+    return newptr;
+}
+
+static void
+wmem_slab_free_all(void *private_data)
+{
+    wmem_slab_allocator_t *allocator = (wmem_slab_allocator_t*) private_data;
+    wmem_slab_jumbo_t     *cur_jum, *nxt_jum;
+
+    /* Keep all the blocks and start over with the first one; the free lists
+     * point into them, so they are simply forgotten. */
+    allocator->cur_block = allocator->block_list;
+    if (allocator->cur_block) {
+        allocator->cur_block->pos = WMEM_BLOCK_HEADER_SIZE;
+    }
+    memset(allocator->free_lists, 0, sizeof(allocator->free_lists));
+
+    /* now do the jumbo blocks, freeing all of them */
+    cur_jum = allocator->jumbo_list;
+    while (cur_jum) {
+        nxt_jum = cur_jum->next;
+        wmem_free(NULL, cur_jum);
+        cur_jum = nxt_jum;
+    }
+    allocator->jumbo_list = NULL;
+
+    allocator->stats.bytes_in_use = 0;
+}
+
+static void
+wmem_slab_gc(void *private_data)
+{
+    wmem_slab_allocator_t *allocator = (wmem_slab_allocator_t*) private_data;
+    wmem_slab_block_t     *cur, *nxt;
+
+    if (!allocator->cur_block) {
+        return;
+    }
+
+    /* return the empty blocks after the current one to the OS */
+    cur = allocator->cur_block->next;
+    allocator->cur_block->next = NULL;
+    while (cur) {
+        nxt = cur->next;
+        wmem_free(NULL, cur);
+        allocator->stats.block_bytes -= WMEM_BLOCK_SIZE;
+        cur = nxt;
+    }
+}
+
+static void
+wmem_slab_allocator_cleanup(void *private_data)
+{
+    wmem_slab_allocator_t *allocator = (wmem_slab_allocator_t*) private_data;
+    wmem_slab_block_t     *cur, *nxt;
+
+    /* wmem guarantees that free_all() is called directly before this, so
+     * only the blocks are left */
+    cur = allocator->block_list;
+    while (cur) {
+        nxt = cur->next;
+        wmem_free(NULL, cur);
+        cur = nxt;
+    }
+
+    /* then just free the allocator structs */
+    wmem_free(NULL, private_data);
+}
+
+static bool
+wmem_slab_stats(void *private_data, wmem_allocator_stats_t *stats)
+{
+    wmem_slab_allocator_t *allocator = (wmem_slab_allocator_t*) private_data;
+
+    *stats = allocator->stats;
+
+    return true;
+}
+
+void
+wmem_slab_allocator_init(wmem_allocator_t *allocator)
+{
+    wmem_slab_allocator_t *slab_allocator;
+
+    slab_allocator = wmem_new0(NULL, wmem_slab_allocator_t);
+
+    allocator->walloc   = &wmem_slab_alloc;
+    allocator->wrealloc = &wmem_slab_realloc;
+    allocator->wfree    = &wmem_slab_free;
+
+    allocator->free_all = &wmem_slab_free_all;
+    allocator->gc       = &wmem_slab_gc;
+    allocator->cleanup  = &wmem_slab_allocator_cleanup;
+    allocator->stats    = &wmem_slab_stats;
+
+    allocator->private_data = (void*) slab_allocator;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
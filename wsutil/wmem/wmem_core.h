@@ -57,13 +57,41 @@ typedef enum _wmem_allocator_type_t {
                 memory usage via things like canaries and scrubbing freed
                 memory. Valgrind is the better choice on platforms that support
                 it. */
-    WMEM_ALLOCATOR_BLOCK_FAST /**< A block allocator like WMEM_ALLOCATOR_BLOCK
+    WMEM_ALLOCATOR_BLOCK_FAST, /**< A block allocator like WMEM_ALLOCATOR_BLOCK
                 but even faster by tracking absolutely minimal metadata and
                 making 'free' a no-op. Useful only for very short-lived scopes
                 where there's no reason to free individual allocations because
                 the next free_all is always just around the corner. */
+    WMEM_ALLOCATOR_SLAB /**< An allocator that rounds requests up to a
+                power-of-two size class and keeps a free list per class, carving
+                new chunks out of 2 MB blocks. Freed memory is reused, free_all
+                keeps the blocks for the next round, and large allocations go
+                straight to the system allocator. Keeps allocation statistics
+                (see wmem_allocator_get_stats()). Like all pools, it must only
+                be used by one thread at a time. */
 } wmem_allocator_type_t;
 
+/** Number of size classes counted in wmem_allocator_stats_t. Class i holds
+ * allocations of up to (16 << i) bytes. */
+#define WMEM_STATS_SIZE_CLASSES     8
+
+/** Number of buckets in the jumbo allocation histogram of
+ * wmem_allocator_stats_t. Bucket i counts allocations too large for any size
+ * class and smaller than (4096 << i) bytes; the last one counts all larger
+ * ones. */
+#define WMEM_STATS_JUMBO_BUCKETS    12
+
+/** Allocation statistics of a pool, see wmem_allocator_get_stats(). */
+typedef struct _wmem_allocator_stats_t {
+    uint64_t alloc_count;   /**< Allocations, including moving reallocations */
+    uint64_t free_count;    /**< Explicit frees, not counting free_all */
+    uint64_t bytes_in_use;  /**< Bytes allocated, rounded up to the size class */
+    uint64_t peak_bytes;    /**< Highest value bytes_in_use has had */
+    uint64_t block_bytes;   /**< Bytes held in blocks from the system allocator */
+    uint64_t size_class_allocs[WMEM_STATS_SIZE_CLASSES];
+    uint64_t jumbo_allocs[WMEM_STATS_JUMBO_BUCKETS];
+} wmem_allocator_stats_t;
+
 /** Allocate the requested amount of memory in the given pool.
  *
  * @param allocator The allocator object to use to allocate the memory.
@@ -205,6 +233,17 @@ WS_DLL_PUBLIC
 wmem_allocator_t *
 wmem_allocator_new(const wmem_allocator_type_t type);
 
+/** Get the allocation statistics of a pool. Only some allocator types keep
+ * them (currently WMEM_ALLOCATOR_SLAB).
+ *
+ * @param allocator The allocator to query.
+ * @param stats Filled in with the statistics.
+ * @return true if the allocator keeps statistics, false otherwise.
+ */
+WS_DLL_PUBLIC
+bool
+wmem_allocator_get_stats(wmem_allocator_t *allocator, wmem_allocator_stats_t *stats);
+
 /** Initialize the wmem subsystem. This must be called before any other wmem
  * function, usually at the very beginning of your program.
  */
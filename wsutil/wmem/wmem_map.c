@@ -35,10 +35,22 @@ wmem_init_hashing(void)
     postseed = g_random_int();
 }
 
+/*
+ * The map uses open addressing with linear probing and Robin Hood
+ * insertion: an item being inserted takes the slot of any item it passes
+ * that is closer to its own home slot, which keeps probe sequences short
+ * and lets lookups for missing keys stop early. Items are stored inline in
+ * the table, so there are no per-item allocations, and each item caches its
+ * hash so that probing rarely calls the equality function and growing the
+ * table never calls the hash function. Removal shifts the following items
+ * of the probe sequence back, so no tombstones are needed.
+ */
 typedef struct _wmem_map_item_t {
     const void *key;
     void *value;
-    struct _wmem_map_item_t *next;
+    uint32_t hash;  /* hash_func(key) * x, see the HASH macro */
+    uint32_t psl;   /* probe sequence length: 1 + the distance from the
+                       item's home slot, 0 if the slot is empty */
 } wmem_map_item_t;
 
 struct _wmem_map_t {
@@ -50,7 +62,7 @@ struct _wmem_map_t {
      * logarithms is expensive. */
     size_t capacity;
 
-    wmem_map_item_t **table;
+    wmem_map_item_t *table;
 
     GHashFunc  hash_func;
     GEqualFunc eql_func;
@@ -63,25 +75,31 @@ struct _wmem_map_t {
 };
 
 /* As per the comment on the 'capacity' member of the wmem_map_t struct, this is
- * the base-2 logarithm, meaning the actual default capacity is 2^5 = 32 */
-#define WMEM_MAP_DEFAULT_CAPACITY 5
+ * the base-2 logarithm, meaning the actual default capacity is 2^4 = 16 */
+#define WMEM_MAP_DEFAULT_CAPACITY 4
 
 /* Macro for calculating the real capacity of the map by using a left-shift to
  * do the 2^x operation. */
 #define CAPACITY(MAP) (((size_t)1) << (MAP)->capacity)
 
+/* The table is grown when it would become more than 3/4 full; open
+ * addressing needs some free slots to keep probe sequences short. */
+#define MAX_COUNT(MAP) (CAPACITY(MAP) - (CAPACITY(MAP) >> 2))
+
 /* Efficient universal integer hashing:
  * https://en.wikipedia.org/wiki/Universal_hashing#Avoiding_modular_arithmetic
+ * HASH gives the full 32 bits, which are stored in the items; SLOT takes the
+ * top bits of that as the home slot for the current capacity.
  */
-#define HASH(MAP, KEY) \
-    ((uint32_t)(((MAP)->hash_func(KEY) * x) >> (32 - (MAP)->capacity)))
+#define HASH(MAP, KEY) ((uint32_t)((MAP)->hash_func(KEY) * x))
+#define SLOT(MAP, HASHVAL) ((size_t)((HASHVAL) >> (32 - (MAP)->capacity)))
 
 static void
 wmem_map_init_table(wmem_map_t *map)
 {
     map->count     = 0;
     map->capacity  = WMEM_MAP_DEFAULT_CAPACITY;
-    map->table     = wmem_alloc0_array(map->data_allocator, wmem_map_item_t*, CAPACITY(map));
+    map->table     = wmem_alloc0_array(map->data_allocator, wmem_map_item_t, CAPACITY(map));
 }
 
 wmem_map_t *
@@ -151,12 +169,39 @@ wmem_map_new_autoreset(wmem_allocator_t *metadata_scope, wmem_allocator_t *data_
     return map;
 }
 
+/* Places an item that is known not to be in the map yet. The table must
+ * have a free slot. */
+static inline void
+wmem_map_place(wmem_map_t *map, wmem_map_item_t item)
+{
+    wmem_map_item_t *cur, tmp;
+    size_t           mask = CAPACITY(map) - 1;
+    size_t           slot = SLOT(map, item.hash);
+
+    item.psl = 1;
+    for (;;) {
+        cur = &map->table[slot];
+        if (cur->psl == 0) {
+            *cur = item;
+            return;
+        }
+        if (cur->psl < item.psl) {
+            /* take the slot from the item that is closer to home and
+             * carry on placing that one instead */
+            tmp   = *cur;
+            *cur  = item;
+            item  = tmp;
+        }
+        slot = (slot + 1) & mask;
+        item.psl++;
+    }
+}
+
 static inline void
 wmem_map_grow(wmem_map_t *map)
 {
-    wmem_map_item_t **old_table, *cur, *nxt;
-    size_t            old_cap, i;
-    unsigned          slot;
+    wmem_map_item_t *old_table;
+    size_t           old_cap, i;
 
     /* store the old table and capacity */
     old_table = map->table;
@@ -165,17 +210,12 @@ wmem_map_grow(wmem_map_t *map)
     /* double the size (capacity is base-2 logarithm, so this just means
      * increment it) and allocate new table */
     map->capacity++;
-    map->table = wmem_alloc0_array(map->data_allocator, wmem_map_item_t*, CAPACITY(map));
+    map->table = wmem_alloc0_array(map->data_allocator, wmem_map_item_t, CAPACITY(map));
 
     /* copy all the elements over from the old table */
     for (i=0; i<old_cap; i++) {
-        cur = old_table[i];
-        while (cur) {
-            nxt              = cur->next;
-            slot             = HASH(map, cur->key);
-            cur->next        = map->table[slot];
-            map->table[slot] = cur;
-            cur              = nxt;
+        if (old_table[i].psl) {
+            wmem_map_place(map, old_table[i]);
         }
     }
 
@@ -183,45 +223,94 @@ wmem_map_grow(wmem_map_t *map)
     wmem_free(map->data_allocator, old_table);
 }
 
+/* Returns the item with the given key, or NULL. */
+static inline wmem_map_item_t *
+wmem_map_find(wmem_map_t *map, const void *key)
+{
+    wmem_map_item_t *item;
+    uint32_t         hash, psl;
+    size_t           mask, slot;
+
+    /* Make sure we have map and a table */
+    if (map == NULL || map->table == NULL) {
+        return NULL;
+    }
+
+    hash = HASH(map, key);
+    mask = CAPACITY(map) - 1;
+    slot = SLOT(map, hash);
+
+    for (psl = 1; ; psl++) {
+        item = &map->table[slot];
+        /* An empty slot, or an item closer to its home than we are to ours,
+         * means the key would have been placed before here. */
+        if (item->psl < psl) {
+            return NULL;
+        }
+        if (item->hash == hash && map->eql_func(key, item->key)) {
+            return item;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/* Removes the item from the table by shifting the rest of its probe
+ * sequence back by one slot. */
+static inline void
+wmem_map_remove_item(wmem_map_t *map, wmem_map_item_t *item)
+{
+    size_t mask = CAPACITY(map) - 1;
+    size_t slot = (size_t)(item - map->table);
+    size_t next;
+
+    for (;;) {
+        next = (slot + 1) & mask;
+        if (map->table[next].psl <= 1) {
+            /* empty, or at its home slot already */
+            map->table[slot].psl = 0;
+            break;
+        }
+        map->table[slot] = map->table[next];
+        map->table[slot].psl--;
+        slot = next;
+    }
+
+    map->count--;
+}
+
 void *
 wmem_map_insert(wmem_map_t *map, const void *key, void *value)
 {
-    wmem_map_item_t **item;
+    wmem_map_item_t *item, new_item;
     void *old_val;
 
+    /* check for an existing item with this key */
+    item = wmem_map_find(map, key);
+    if (item) {
+        /* replace and return old value for this key */
+        old_val = item->value;
+        item->value = value;
+        return old_val;
+    }
+
     /* Make sure we have a table */
     if (map->table == NULL) {
         wmem_map_init_table(map);
     }
 
-    /* get a pointer to the slot */
-    item = &(map->table[HASH(map, key)]);
-
-    /* check existing items in that slot */
-    while (*item) {
-        if (map->eql_func(key, (*item)->key)) {
-            /* replace and return old value for this key */
-            old_val = (*item)->value;
-            (*item)->value = value;
-            return old_val;
-        }
-        item = &((*item)->next);
+    /* increase size if we would be over-full */
+    if (map->count >= MAX_COUNT(map)) {
+        wmem_map_grow(map);
     }
 
     /* insert new item */
-    (*item) = wmem_new(map->data_allocator, wmem_map_item_t);
-
-    (*item)->key   = key;
-    (*item)->value = value;
-    (*item)->next  = NULL;
+    new_item.key   = key;
+    new_item.value = value;
+    new_item.hash  = HASH(map, key);
+    wmem_map_place(map, new_item);
 
     map->count++;
 
-    /* increase size if we are over-full */
-    if (map->count >= CAPACITY(map)) {
-        wmem_map_grow(map);
-    }
-
     /* no previous entry, return NULL */
     return NULL;
 }
@@ -229,25 +318,7 @@ wmem_map_insert(wmem_map_t *map, const void *key, void *value)
 bool
 wmem_map_contains(wmem_map_t *map, const void *key)
 {
-    wmem_map_item_t *item;
-
-    /* Make sure we have map and a table */
-    if (map == NULL || map->table == NULL) {
-        return false;
-    }
-
-    /* find correct slot */
-    item = map->table[HASH(map, key)];
-
-    /* scan list of items in this slot for the correct value */
-    while (item) {
-        if (map->eql_func(key, item->key)) {
-            return true;
-        }
-        item = item->next;
-    }
-
-    return false;
+    return wmem_map_find(map, key) != NULL;
 }
 
 void *
@@ -255,23 +326,9 @@ wmem_map_lookup(wmem_map_t *map, const void *key)
 {
     wmem_map_item_t *item;
 
-    /* Make sure we have map and a table */
-    if (map == NULL || map->table == NULL) {
-        return NULL;
-    }
-
-    /* find correct slot */
-    item = map->table[HASH(map, key)];
-
-    /* scan list of items in this slot for the correct value */
-    while (item) {
-        if (map->eql_func(key, item->key)) {
-            return item->value;
-        }
-        item = item->next;
-    }
+    item = wmem_map_find(map, key);
 
-    return NULL;
+    return item ? item->value : NULL;
 }
 
 bool
@@ -279,97 +336,59 @@ wmem_map_lookup_extended(wmem_map_t *map, const void *key, const void **orig_key
 {
     wmem_map_item_t *item;
 
-    /* Make sure we have map and a table */
-    if (map == NULL || map->table == NULL) {
+    item = wmem_map_find(map, key);
+    if (item == NULL) {
         return false;
     }
 
-    /* find correct slot */
-    item = map->table[HASH(map, key)];
-
-    /* scan list of items in this slot for the correct value */
-    while (item) {
-        if (map->eql_func(key, item->key)) {
-            if (orig_key) {
-                *orig_key = item->key;
-            }
-            if (value) {
-                *value = item->value;
-            }
-            return true;
-        }
-        item = item->next;
+    if (orig_key) {
+        *orig_key = item->key;
     }
-
-    return false;
+    if (value) {
+        *value = item->value;
+    }
+    return true;
 }
 
 void *
 wmem_map_remove(wmem_map_t *map, const void *key)
 {
-    wmem_map_item_t **item, *tmp;
+    wmem_map_item_t *item;
     void *value;
 
-    /* Make sure we have map and a table */
-    if (map == NULL || map->table == NULL) {
+    item = wmem_map_find(map, key);
+    if (item == NULL) {
+        /* didn't find it */
         return NULL;
     }
 
-    /* get a pointer to the slot */
-    item = &(map->table[HASH(map, key)]);
-
-    /* check the items in that slot */
-    while (*item) {
-        if (map->eql_func(key, (*item)->key)) {
-            /* found it */
-            tmp     = (*item);
-            value   = tmp->value;
-            (*item) = tmp->next;
-            wmem_free(map->data_allocator, tmp);
-            map->count--;
-            return value;
-        }
-        item = &((*item)->next);
-    }
+    value = item->value;
+    wmem_map_remove_item(map, item);
 
-    /* didn't find it */
-    return NULL;
+    return value;
 }
 
 bool
 wmem_map_steal(wmem_map_t *map, const void *key)
 {
-    wmem_map_item_t **item, *tmp;
+    wmem_map_item_t *item;
 
-    /* Make sure we have map and a table */
-    if (map == NULL || map->table == NULL) {
+    item = wmem_map_find(map, key);
+    if (item == NULL) {
+        /* didn't find it */
         return false;
     }
 
-    /* get a pointer to the slot */
-    item = &(map->table[HASH(map, key)]);
-
-    /* check the items in that slot */
-    while (*item) {
-        if (map->eql_func(key, (*item)->key)) {
-            /* found it */
-            tmp     = (*item);
-            (*item) = tmp->next;
-            map->count--;
-            return true;
-        }
-        item = &((*item)->next);
-    }
+    /* items are stored in the table, there is nothing else to free */
+    wmem_map_remove_item(map, item);
 
-    /* didn't find it */
-    return false;
+    return true;
 }
 
 wmem_list_t*
 wmem_map_get_keys(wmem_allocator_t *list_allocator, wmem_map_t *map)
 {
     size_t capacity, i;
-    wmem_map_item_t *cur;
     wmem_list_t* list = wmem_list_new(list_allocator);
 
     if (map->table != NULL) {
@@ -377,10 +396,8 @@ wmem_map_get_keys(wmem_allocator_t *list_allocator, wmem_map_t *map)
 
         /* copy all the elements into the list over from table */
         for (i=0; i<capacity; i++) {
-            cur = map->table[i];
-            while (cur) {
-                wmem_list_prepend(list, (void*)cur->key);
-                cur = cur->next;
+            if (map->table[i].psl) {
+                wmem_list_prepend(list, (void*)map->table[i].key);
             }
         }
     }
@@ -391,8 +408,8 @@ wmem_map_get_keys(wmem_allocator_t *list_allocator, wmem_map_t *map)
 void
 wmem_map_foreach(wmem_map_t *map, GHFunc foreach_func, void * user_data)
 {
-    wmem_map_item_t *cur;
-    unsigned i;
+    wmem_map_item_t *item;
+    size_t i;
 
     /* Make sure we have a table */
     if (map == NULL || map->table == NULL) {
@@ -400,10 +417,9 @@ wmem_map_foreach(wmem_map_t *map, GHFunc foreach_func, void * user_data)
     }
 
     for (i = 0; i < CAPACITY(map); i++) {
-        cur = map->table[i];
-        while (cur) {
-            foreach_func((void *)cur->key, (void *)cur->value, user_data);
-            cur = cur->next;
+        item = &map->table[i];
+        if (item->psl) {
+            foreach_func((void *)item->key, (void *)item->value, user_data);
         }
     }
 }
@@ -411,26 +427,33 @@ wmem_map_foreach(wmem_map_t *map, GHFunc foreach_func, void * user_data)
 unsigned
 wmem_map_foreach_remove(wmem_map_t *map, GHRFunc foreach_func, void * user_data)
 {
-    wmem_map_item_t **item, *tmp;
-    unsigned i, deleted = 0;
+    wmem_map_item_t *item;
+    size_t mask, start, slot, i;
+    unsigned deleted = 0;
 
     /* Make sure we have a table */
     if (map == NULL || map->table == NULL) {
         return 0;
     }
 
-    for (i = 0; i < CAPACITY(map); i++) {
-        item = &(map->table[i]);
-        while (*item) {
-            if (foreach_func((void *)(*item)->key, (void *)(*item)->value, user_data)) {
-                tmp   = *item;
-                *item = tmp->next;
-                wmem_free(map->data_allocator, tmp);
-                map->count--;
-                deleted++;
-            } else {
-                item = &((*item)->next);
-            }
+    /* Start right after an empty slot. Removing an item only moves the
+     * items after it in the same probe sequence back by one, and no
+     * sequence wraps past an empty slot, so this visits every item once. */
+    mask = CAPACITY(map) - 1;
+    for (start = 0; map->table[start].psl; start++)
+        ;
+
+    i = 1;
+    while (i <= mask) {
+        slot = (start + i) & mask;
+        item = &map->table[slot];
+        if (item->psl &&
+                foreach_func((void *)item->key, (void *)item->value, user_data)) {
+            /* another item may have moved into this slot */
+            wmem_map_remove_item(map, item);
+            deleted++;
+        } else {
+            i++;
         }
     }
     return deleted;
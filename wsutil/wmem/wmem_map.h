@@ -27,9 +27,10 @@ extern "C" {
  *
  *    A hash map implementation on top of wmem. Provides insertion, deletion and
  *    lookup in expected amortized constant time. Uses universal hashing to map
- *    keys into buckets, and provides a generic strong hash function that makes
- *    it secure against algorithmic complexity attacks, and suitable for use
- *    even with untrusted data.
+ *    keys into an open-addressing table with the items stored inline, and
+ *    provides a generic strong hash function that makes it secure against
+ *    algorithmic complexity attacks, and suitable for use even with untrusted
+ *    data.
  *
  *    @{
  */
@@ -155,7 +156,8 @@ wmem_map_get_keys(wmem_allocator_t *list_allocator, wmem_map_t *map);
 
 /** Run a function against all key/value pairs in the map. The order
  * of the calls is unpredictable, since it is based on the internal
- * storage of data.
+ * storage of data. The function must not insert into or remove from the
+ * map; use wmem_map_foreach_remove() to remove items while iterating.
  *
  * @param map The map to use. May be NULL.
  * @param foreach_func the function to call for each key/value pair
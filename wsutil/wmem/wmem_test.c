@@ -21,6 +21,7 @@
 #include "wmem_allocator_block_fast.h"
 #include "wmem_allocator_simple.h"
 #include "wmem_allocator_strict.h"
+#include "wmem_allocator_slab.h"
 
 #include <wsutil/time_util.h>
 
@@ -43,6 +44,7 @@ wmem_allocator_force_new(const wmem_allocator_type_t type)
     allocator->type = type;
     allocator->callbacks = NULL;
     allocator->in_scope = true;
+    allocator->stats = NULL;
 
     switch (type) {
         case WMEM_ALLOCATOR_SIMPLE:
@@ -57,6 +59,9 @@ wmem_allocator_force_new(const wmem_allocator_type_t type)
         case WMEM_ALLOCATOR_STRICT:
             wmem_strict_allocator_init(allocator);
             break;
+        case WMEM_ALLOCATOR_SLAB:
+            wmem_slab_allocator_init(allocator);
+            break;
         default:
             g_assert_not_reached();
             /* This is necessary to squelch MSVC errors; is there
@@ -369,6 +374,53 @@ wmem_test_allocator_strict(void)
     wmem_test_allocator_jumbo(WMEM_ALLOCATOR_STRICT, &wmem_strict_check_canaries);
 }
 
+static void
+wmem_test_allocator_slab(void)
+{
+    wmem_allocator_t       *allocator;
+    wmem_allocator_stats_t  stats;
+    char                   *ptr, *ptr1;
+
+    wmem_test_allocator(WMEM_ALLOCATOR_SLAB, NULL,
+            MAX_SIMULTANEOUS_ALLOCS*64);
+    wmem_test_allocator_jumbo(WMEM_ALLOCATOR_SLAB, NULL);
+
+    allocator = wmem_allocator_force_new(WMEM_ALLOCATOR_SLAB);
+
+    /* freed chunks are reused by allocations of the same size class */
+    ptr = (char *)wmem_alloc(allocator, 20);
+    wmem_free(allocator, ptr);
+    ptr1 = (char *)wmem_alloc(allocator, 20);
+    g_assert_true(ptr == ptr1);
+    /* and growing up to the size of the class doesn't move */
+    ptr1 = (char *)wmem_realloc(allocator, ptr1, 32);
+    g_assert_true(ptr == ptr1);
+
+    ptr = (char *)wmem_alloc(allocator, 5000);
+    g_assert_true(wmem_allocator_get_stats(allocator, &stats));
+    g_assert_cmpuint(stats.alloc_count, ==, 3);
+    g_assert_cmpuint(stats.free_count, ==, 1);
+    g_assert_cmpuint(stats.size_class_allocs[0], ==, 0);
+    g_assert_cmpuint(stats.size_class_allocs[1], ==, 2);
+    g_assert_cmpuint(stats.jumbo_allocs[1], ==, 1);
+    g_assert_cmpuint(stats.bytes_in_use, ==, 32 + 5000);
+    g_assert_cmpuint(stats.peak_bytes, ==, 32 + 5000);
+
+    wmem_free(allocator, ptr);
+    wmem_free_all(allocator);
+    g_assert_true(wmem_allocator_get_stats(allocator, &stats));
+    g_assert_cmpuint(stats.bytes_in_use, ==, 0);
+    g_assert_cmpuint(stats.peak_bytes, ==, 32 + 5000);
+    g_assert_cmpuint(stats.block_bytes, >, 0);
+
+    wmem_destroy_allocator(allocator);
+
+    /* other allocators don't keep statistics */
+    allocator = wmem_allocator_force_new(WMEM_ALLOCATOR_BLOCK_FAST);
+    g_assert_false(wmem_allocator_get_stats(allocator, &stats));
+    wmem_destroy_allocator(allocator);
+}
+
 /* UTILITY TESTING FUNCTIONS (/wmem/utils/) */
 
 static void
@@ -628,6 +680,127 @@ wmem_test_stringperf(void)
     g_free(str_ptr);
 }
 
+/* NOTE: You have to run "wmem_test -m perf" to run the performance tests. */
+static void
+wmem_test_allocatorperf(void)
+{
+#define PERF_PACKETS        (10 * 1000)
+#define PERF_ALLOCS_PER_PKT 200
+    static const struct {
+        wmem_allocator_type_t  type;
+        const char            *name;
+    } types[] = {
+        { WMEM_ALLOCATOR_BLOCK_FAST, "block_fast" },
+        { WMEM_ALLOCATOR_BLOCK,      "block" },
+        { WMEM_ALLOCATOR_SLAB,       "slab" },
+    };
+    wmem_allocator_t   *allocator;
+    char               *ptrs[PERF_ALLOCS_PER_PKT];
+    unsigned            sizes[PERF_ALLOCS_PER_PKT];
+    unsigned            i, pkt, t;
+    double              start_utime, start_stime, end_utime, end_stime, utime_ms, stime_ms;
+
+    /* Mostly small allocations with the occasional large one, roughly what
+     * the dissectors do in packet scope. */
+    for (i = 0; i < PERF_ALLOCS_PER_PKT; i++) {
+        sizes[i] = (i % 50 == 49) ? (unsigned)g_test_rand_int_range(2048, 65536) :
+                                    (unsigned)g_test_rand_int_range(1, 256);
+    }
+
+    for (t = 0; t < G_N_ELEMENTS(types); t++) {
+        allocator = wmem_allocator_force_new(types[t].type);
+
+        /* allocate and free_all, as the packet scope does */
+        RESOURCE_USAGE_START;
+        for (pkt = 0; pkt < PERF_PACKETS; pkt++) {
+            for (i = 0; i < PERF_ALLOCS_PER_PKT; i++) {
+                ptrs[i] = (char *)wmem_alloc(allocator, sizes[i]);
+                ptrs[i][0] = 0;
+            }
+            wmem_free_all(allocator);
+        }
+        RESOURCE_USAGE_END;
+        g_test_minimized_result(utime_ms + stime_ms,
+            "%s alloc/free_all: u %.3f ms s %.3f ms", types[t].name, utime_ms, stime_ms);
+
+        /* allocate, grow and free individually, as longer lived scopes do */
+        RESOURCE_USAGE_START;
+        for (pkt = 0; pkt < PERF_PACKETS; pkt++) {
+            for (i = 0; i < PERF_ALLOCS_PER_PKT; i++) {
+                ptrs[i] = (char *)wmem_alloc(allocator, sizes[i]);
+            }
+            for (i = 0; i < PERF_ALLOCS_PER_PKT; i += 2) {
+                ptrs[i] = (char *)wmem_realloc(allocator, ptrs[i], sizes[i] * 2);
+            }
+            for (i = 0; i < PERF_ALLOCS_PER_PKT; i++) {
+                wmem_free(allocator, ptrs[i]);
+            }
+        }
+        RESOURCE_USAGE_END;
+        g_test_minimized_result(utime_ms + stime_ms,
+            "%s alloc/realloc/free: u %.3f ms s %.3f ms", types[t].name, utime_ms, stime_ms);
+
+        wmem_destroy_allocator(allocator);
+    }
+}
+
+/* NOTE: You have to run "wmem_test -m perf" to run the performance tests. */
+static void
+wmem_test_mapperf(void)
+{
+#define MAP_PERF_KEYS (1000 * 1000)
+    wmem_allocator_t       *allocator;
+    wmem_allocator_stats_t  stats;
+    wmem_map_t             *map;
+    unsigned               *keys = g_new(unsigned, MAP_PERF_KEYS);
+    unsigned                i, found = 0;
+    double                  start_utime, start_stime, end_utime, end_stime, utime_ms, stime_ms;
+
+    /* The slab allocator is used for its statistics, to report the memory
+     * used per item. */
+    allocator = wmem_allocator_force_new(WMEM_ALLOCATOR_SLAB);
+    map = wmem_map_new(allocator, g_direct_hash, g_direct_equal);
+
+    /* Even keys are inserted, odd ones are looked up but missing. */
+    for (i = 0; i < MAP_PERF_KEYS; i++) {
+        keys[i] = g_random_int() & ~1U;
+    }
+
+    RESOURCE_USAGE_START;
+    for (i = 0; i < MAP_PERF_KEYS; i++) {
+        wmem_map_insert(map, GUINT_TO_POINTER(keys[i]), GUINT_TO_POINTER(i));
+    }
+    RESOURCE_USAGE_END;
+    g_test_minimized_result(utime_ms + stime_ms,
+        "wmem_map_insert: u %.3f ms s %.3f ms", utime_ms, stime_ms);
+
+    RESOURCE_USAGE_START;
+    for (i = 0; i < MAP_PERF_KEYS; i++) {
+        found += wmem_map_contains(map, GUINT_TO_POINTER(keys[(i * 7919) % MAP_PERF_KEYS]));
+    }
+    RESOURCE_USAGE_END;
+    g_test_minimized_result(utime_ms + stime_ms,
+        "wmem_map_lookup hits: u %.3f ms s %.3f ms", utime_ms, stime_ms);
+    g_assert_cmpuint(found, ==, MAP_PERF_KEYS);
+
+    RESOURCE_USAGE_START;
+    for (i = 0; i < MAP_PERF_KEYS; i++) {
+        found += wmem_map_contains(map, GUINT_TO_POINTER(keys[i] | 1));
+    }
+    RESOURCE_USAGE_END;
+    g_test_minimized_result(utime_ms + stime_ms,
+        "wmem_map_lookup misses: u %.3f ms s %.3f ms", utime_ms, stime_ms);
+    g_assert_cmpuint(found, ==, MAP_PERF_KEYS);
+
+    g_assert_true(wmem_allocator_get_stats(allocator, &stats));
+    g_test_message("wmem_map of %u items: %.1f bytes per item in use, %.1f at peak",
+        wmem_map_size(map), (double)stats.bytes_in_use / wmem_map_size(map),
+        (double)stats.peak_bytes / wmem_map_size(map));
+
+    wmem_destroy_allocator(allocator);
+    g_free(keys);
+}
+
 /* DATA STRUCTURE TESTING FUNCTIONS (/wmem/datastruct/) */
 
 static void
@@ -903,6 +1076,19 @@ equal_val_map(void * key _U_, void * val, void * user_data)
     return val == user_data;
 }
 
+static unsigned
+collide_hash_map(const void *key)
+{
+    /* only a few distinct hashes, so that the keys share probe sequences */
+    return GPOINTER_TO_UINT(key) % 3;
+}
+
+static gboolean
+odd_key_map(void * key, void * val _U_, void * user_data _U_)
+{
+    return GPOINTER_TO_UINT(key) % 2;
+}
+
 static void
 wmem_test_map(void)
 {
@@ -1015,6 +1201,25 @@ wmem_test_map(void)
     }
     g_assert_true(wmem_map_size(map) == CONTAINER_ITERS/2);
 
+    /* colliding keys: removals in the middle of probe sequences */
+    map = wmem_map_new(allocator, collide_hash_map, g_direct_equal);
+    for (i=0; i<CONTAINER_ITERS/10; i++) {
+        wmem_map_insert(map, GINT_TO_POINTER(i), GINT_TO_POINTER(i));
+    }
+    for (i=0; i<CONTAINER_ITERS/10; i+=3) {
+        ret = wmem_map_remove(map, GINT_TO_POINTER(i));
+        g_assert_true(ret == GINT_TO_POINTER(i));
+    }
+    for (i=0; i<CONTAINER_ITERS/10; i++) {
+        ret = wmem_map_lookup(map, GINT_TO_POINTER(i));
+        g_assert_true(ret == ((i % 3) ? GINT_TO_POINTER(i) : NULL));
+    }
+    wmem_map_foreach_remove(map, odd_key_map, NULL);
+    for (i=0; i<CONTAINER_ITERS/10; i++) {
+        g_assert_true(wmem_map_contains(map, GINT_TO_POINTER(i)) == ((i % 3) && !(i % 2)));
+    }
+    wmem_strict_check_canaries(allocator);
+
     wmem_destroy_allocator(extra_allocator);
     wmem_destroy_allocator(allocator);
 }
@@ -1456,6 +1661,7 @@ main(int argc, char **argv)
     g_test_add_func("/wmem/allocator/blk_fast",  wmem_test_allocator_block_fast);
     g_test_add_func("/wmem/allocator/simple",    wmem_test_allocator_simple);
     g_test_add_func("/wmem/allocator/strict",    wmem_test_allocator_strict);
+    g_test_add_func("/wmem/allocator/slab",      wmem_test_allocator_slab);
     g_test_add_func("/wmem/allocator/callbacks", wmem_test_allocator_callbacks);
 
     g_test_add_func("/wmem/utils/misc",    wmem_test_miscutls);
@@ -1463,6 +1669,8 @@ main(int argc, char **argv)
 
     if (g_test_perf()) {
         g_test_add_func("/wmem/utils/stringperf", wmem_test_stringperf);
+        g_test_add_func("/wmem/allocator/perf", wmem_test_allocatorperf);
+        g_test_add_func("/wmem/datastruct/map/perf", wmem_test_mapperf);
     }
 
     g_test_add_func("/wmem/datastruct/array",  wmem_test_array);